@@ -0,0 +1,43 @@
+#!/bin/sh
+# Times micro on generated programs of growing size, in default and -live
+# modes. Run from the top of the tree after make bench builds everything:
+#   sh bench/compile.sh [funcs ...]
+# Extra genlittle options can go in GENFLAGS, e.g. GENFLAGS="-depth 5".
+
+MICRO=./build/micro
+GEN=./build/genlittle
+SRC=${TMPDIR:-/tmp}/little_bench.$$.micro
+ERR=${TMPDIR:-/tmp}/little_bench.$$.err
+SIZES=${*:-10 50 200}
+
+if [ ! -x $MICRO ] || [ ! -x $GEN ]; then
+	echo "build micro and genlittle first (make bench)"
+	exit 1
+fi
+
+# the value of one line of micro -time output
+phase() {
+	sed -n "s/^$1: \([0-9.e+-]*\).*/\1/p" $ERR
+}
+
+printf "%6s %7s %-7s %10s %10s %9s %9s %9s %9s %9s\n" funcs lines mode \
+	"total ms" "lines/s" "rss KB" parse opts liveness codegen
+for n in $SIZES; do
+	$GEN -funcs $n $GENFLAGS > $SRC
+	lines=`wc -l < $SRC`
+	for mode in default live; do
+		flags=""
+		[ $mode = live ] && flags="-live"
+		if ! $MICRO $SRC $flags -time > /dev/null 2> $ERR; then
+			echo "micro failed on -funcs $n $flags"
+			continue
+		fi
+		echo $n $lines $mode `phase "time total"` `phase "peak rss"` \
+			`phase "time parse"` `phase "time passes"` \
+			`phase "time liveness"` `phase "time codegen"` |
+			awk '{ printf "%6d %7d %-7s %10.1f %10.0f %9d %9.1f %9.1f %9.1f %9.1f\n",
+				   $1, $2, $3, $4, ($4 > 0 ? $2 * 1000 / $4 : 0), $5,
+				   $6, $7, $8, $9 }'
+	done
+done
+rm -f $SRC $ERR
@@ -0,0 +1,172 @@
+/* Writes a synthetic LITTLE program to stdout, for timing the compiler on
+ * inputs bigger than the testcases. The same options always give the same
+ * program, and every program it writes terminates and only reads variables
+ * it has set, so its output doesn't depend on what was left on the stack. */
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+static unsigned int seed = 1;
+static int numFuncs = 10;
+static int depth = 3;
+static int nesting = 2;
+static int numGlobals = 8;
+static int numLocals = 6;
+static int numStmts = 8;
+
+// the same sequence everywhere, unlike rand()
+static int pick(int n) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 16) % n;
+}
+
+static std::string name(const char *pre, int i) {
+	std::stringstream tstr;
+	tstr << pre << i;
+	return tstr.str();
+}
+
+// numSet is how many of the locals have a value yet
+static std::string operand(int func, int numSet) {
+	int r = pick(4);
+	if (r == 0 || (numGlobals == 0 && r == 1)) {
+		return name("", 1 + pick(9));
+	} else if (r == 1) {
+		return name("g", pick(numGlobals));
+	} else if (r == 2) {
+		return pick(2) == 0 ? "a" : "b";
+	} else if (numSet == 0) {
+		return name("", 1 + pick(9));
+	}
+	return name("l", pick(numSet));
+}
+
+static std::string expr(int func, int d) {
+	// d levels of operators, so about 2^d temps
+	if (d == 0) {
+		return operand(func, numLocals);
+	}
+	const char *ops[] = { " + ", " - ", " * " };
+	std::string e = expr(func, d-1) + ops[pick(3)] + expr(func, d-1);
+	return pick(2) == 0 ? "(" + e + ")" : e;
+}
+
+static std::string cond(int func) {
+	const char *ops[] = { " < ", " > ", " = " };
+	return "(" + expr(func, 1) + ops[pick(3)] + expr(func, 1) + ")";
+}
+
+static void stmts(std::ostream &os, int func, int level, int n,
+				  std::string indent) {
+	for (int i=0; i<n; i++) {
+		int r = pick(6);
+		if (r == 0 && level < nesting) {
+			os << indent << "IF " << cond(func) << std::endl
+			   << indent << "THEN" << std::endl;
+			stmts(os, func, level+1, n/2, indent + "\t");
+			os << indent << "ELSE" << std::endl;
+			stmts(os, func, level+1, n/2, indent + "\t");
+			os << indent << "ENDIF" << std::endl;
+		} else if (r == 1 && level < nesting) {
+			// two trips, so runtime stays 2^nesting per function
+			std::string c = name("c", level);
+			os << indent << c << " := 0;" << std::endl
+			   << indent << "DO" << std::endl;
+			stmts(os, func, level+1, n/2, indent + "\t");
+			os << indent << "\t" << c << " := " << c << " + 1;" << std::endl
+			   << indent << "WHILE (" << c << " < 2);" << std::endl;
+		} else if (r == 2 && numGlobals > 0) {
+			os << indent << name("g", pick(numGlobals)) << " := "
+			   << expr(func, depth) << ";" << std::endl;
+		} else {
+			os << indent << name("l", pick(numLocals)) << " := "
+			   << expr(func, depth) << ";" << std::endl;
+		}
+	}
+}
+
+static void function(std::ostream &os, int func) {
+	os << "\tFUNCTION INT " << name("f", func) << "(INT a, INT b)" << std::endl
+	   << "\tBEGIN" << std::endl;
+	os << "\t\tINT ";
+	for (int i=0; i<numLocals; i++) {
+		os << name("l", i) << ", ";
+	}
+	for (int i=0; i<nesting; i++) {
+		os << name("c", i) << ", ";
+	}
+	os << "r;" << std::endl;
+	for (int i=0; i<numLocals; i++) {
+		os << "\t\t" << name("l", i) << " := " << operand(func, i) << ";"
+		   << std::endl;
+	}
+	// calls only go down the chain and never from a loop, so the whole
+	// program runs in time linear in its size
+	if (func > 0) {
+		os << "\t\tr := " << name("f", func-1) << "(" << expr(func, 1)
+		   << ", " << expr(func, 1) << ");" << std::endl;
+	} else {
+		os << "\t\tr := a;" << std::endl;
+	}
+	stmts(os, func, 0, numStmts, "\t\t");
+	os << "\t\tRETURN r + " << expr(func, depth) << ";" << std::endl
+	   << "\tEND" << std::endl << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+	for (int i=1; i+1<argc; i+=2) {
+		int v = atoi(argv[i+1]);
+		if (strcmp(argv[i],"-funcs") == 0) {
+			numFuncs = v;
+		} else if (strcmp(argv[i],"-depth") == 0) {
+			depth = v;
+		} else if (strcmp(argv[i],"-nest") == 0) {
+			nesting = v;
+		} else if (strcmp(argv[i],"-globals") == 0) {
+			numGlobals = v;
+		} else if (strcmp(argv[i],"-locals") == 0) {
+			numLocals = v > 0 ? v : 1;
+		} else if (strcmp(argv[i],"-stmts") == 0) {
+			numStmts = v;
+		} else if (strcmp(argv[i],"-seed") == 0) {
+			seed = v;
+		} else {
+			std::cerr << "usage: genlittle [-funcs N] [-depth N] [-nest N] "
+					  << "[-globals N] [-locals N] [-stmts N] [-seed N]"
+					  << std::endl;
+			return 1;
+		}
+	}
+
+	std::ostream &os = std::cout;
+	os << "PROGRAM bench" << std::endl << "BEGIN" << std::endl;
+	os << "\tSTRING eol := \"\\n\";" << std::endl;
+	if (numGlobals > 0) {
+		os << "\tINT ";
+		for (int i=0; i<numGlobals; i++) {
+			os << (i > 0 ? ", " : "") << name("g", i);
+		}
+		os << ";" << std::endl;
+	}
+	os << std::endl;
+	for (int i=0; i<numFuncs; i++) {
+		function(os, i);
+	}
+	os << "\tFUNCTION VOID main()" << std::endl
+	   << "\tBEGIN" << std::endl
+	   << "\t\tINT x;" << std::endl;
+	if (numFuncs > 0) {
+		os << "\t\tx := " << name("f", numFuncs-1) << "(1, 2);" << std::endl;
+	}
+	os << "\t\tWRITE(x, eol);" << std::endl;
+	for (int i=0; i<numGlobals; i++) {
+		os << "\t\tWRITE(" << name("g", i) << ", eol);" << std::endl;
+	}
+	os << "\tEND" << std::endl << "END" << std::endl;
+	return 0;
+}
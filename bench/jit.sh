@@ -0,0 +1,53 @@
+#!/bin/sh
+# Times every testcase under the TINY interpreter and the JIT.
+# Run from the top of the tree after make all:  sh bench/jit.sh [repeats]
+
+REPEAT=${1:-20}
+MICRO=./build/micro
+VM=./build/tinyvm
+OUT=${TMPDIR:-/tmp}/little_jit_bench.$$
+
+if [ ! -x $MICRO ] || [ ! -x $VM ]; then
+	echo "build micro and tinyvm first (make all)"
+	exit 1
+fi
+
+# input for the testcases that READ, big enough to take a while
+input_for() {
+	case $1 in
+		factorial) echo 12 ;;
+		fibonacci) echo 25 ;;
+		fma) printf "1.5\n2.0\n3.0\n" ;;
+		*) echo ;;
+	esac
+}
+
+# flags a testcase can't run without, on top of every setting's
+flags_for() {
+	case $1 in
+		mutual) echo -tailcall ;;
+	esac
+}
+
+time_run() {
+	input_for $1 | $VM -nostats -time -repeat $REPEAT $2 $OUT 2>&1 >/dev/null |
+		sed -n 's/run time: \(.*\) ms/\1/p'
+}
+
+printf "%-12s %-6s %12s %12s %8s\n" test mode "interp ms" "jit ms" speedup
+for f in testcases/*.micro; do
+	name=`basename $f .micro`
+	for mode in default live; do
+		if [ $mode = live ]; then
+			$MICRO $f -live `flags_for $name` > $OUT
+		else
+			$MICRO $f `flags_for $name` > $OUT
+		fi
+		interp=`time_run $name "-regs 4"`
+		jit=`time_run $name "-regs 4 -jit"`
+		echo "$name $mode $interp $jit" |
+			awk '{ printf "%-12s %-6s %12.3f %12.3f %7.1fx\n",
+				   $1, $2, $3, $4, ($4 > 0 ? $3/$4 : 0) }'
+	done
+done
+rm -f $OUT
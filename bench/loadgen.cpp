@@ -0,0 +1,168 @@
+/* Load generator for micro --server. CLIENTS threads each keep a connection
+ * open and send compile requests for the given programs in turn until
+ * REQUESTS have gone out, then it prints the throughput and the latency
+ * percentiles. With -spawn MICRO every request starts a new micro instead,
+ * which is what the server saves. */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+#include "../src/server.h"
+
+static std::string socketPath;
+static std::string spawnMicro;
+static std::vector< std::string> flags;
+static std::vector< std::string> programs;
+static int numRequests = 1000;
+static int numClients = 4;
+
+static int nextRequest = 0;
+static int failures = 0;
+static std::vector< double> latencies;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static double now() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+// the next request for this client to send, -1 when they're all out
+static int takeRequest() {
+	pthread_mutex_lock(&lock);
+	int i = nextRequest < numRequests ? nextRequest++ : -1;
+	pthread_mutex_unlock(&lock);
+	return i;
+}
+
+static void finished(double ms, bool ok) {
+	pthread_mutex_lock(&lock);
+	latencies.push_back(ms);
+	if (!ok) {
+		failures++;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+static bool spawnCompile(std::vector< std::string> &args) {
+	pid_t pid = fork();
+	if (pid == 0) {
+		int null = open("/dev/null", O_RDWR);
+		dup2(null, 0);
+		dup2(null, 1);
+		dup2(null, 2);
+		std::vector< char *> argv;
+		argv.push_back((char *)spawnMicro.c_str());
+		for (int i=0; i<args.size(); i++) {
+			argv.push_back((char *)args[i].c_str());
+		}
+		argv.push_back(NULL);
+		execv(spawnMicro.c_str(), &argv[0]);
+		_exit(127);
+	}
+	int status;
+	return pid > 0 && waitpid(pid, &status, 0) == pid &&
+			WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void *client(void *arg) {
+	int fd = -1;
+	if (spawnMicro.empty()) {
+		fd = little::connectServer(socketPath);
+		if (fd < 0) {
+			std::cerr << "no server on " << socketPath << std::endl;
+			exit(1);
+		}
+	}
+	int i;
+	while ((i = takeRequest()) >= 0) {
+		std::vector< std::string> args = flags;
+		args.push_back(programs[i % programs.size()]);
+		double start = now();
+		bool ok;
+		if (fd < 0) {
+			ok = spawnCompile(args);
+		} else {
+			int status;
+			std::string out;
+			std::string err;
+			ok = little::sendRequest(fd, args, "") &&
+					little::readReply(fd, status, out, err) && status == 0 &&
+					out.find("Not accepted") == std::string::npos;
+		}
+		finished(now() - start, ok);
+	}
+	if (fd >= 0) {
+		close(fd);
+	}
+	return NULL;
+}
+
+static double percentile(double p) {
+	int i = (int)(p/100 * latencies.size());
+	if (i >= latencies.size()) {
+		i = latencies.size() - 1;
+	}
+	return latencies[i];
+}
+
+int main(int argc, char *argv[])
+{
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i],"-socket") == 0 && i+1 < argc) {
+			socketPath = argv[++i];
+		} else if (strcmp(argv[i],"-spawn") == 0 && i+1 < argc) {
+			spawnMicro = argv[++i];
+		} else if (strcmp(argv[i],"-clients") == 0 && i+1 < argc) {
+			numClients = atoi(argv[++i]);
+		} else if (strcmp(argv[i],"-requests") == 0 && i+1 < argc) {
+			numRequests = atoi(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			flags.push_back(argv[i]); // for micro
+		} else {
+			// the server resolves paths in its own directory
+			char cwd[4096];
+			std::string p = argv[i];
+			if (p[0] != '/' && getcwd(cwd, sizeof(cwd)) != NULL) {
+				p = std::string(cwd) + "/" + p;
+			}
+			programs.push_back(p);
+		}
+	}
+	if ((socketPath.empty() == spawnMicro.empty()) || programs.empty() ||
+			numClients < 1 || numRequests < 1) {
+		std::cerr << "usage: loadgen -socket PATH | -spawn MICRO [-clients N]"
+				  << " [-requests N] [micro flags] program.micro..."
+				  << std::endl;
+		return 1;
+	}
+
+	double start = now();
+	std::vector< pthread_t> threads(numClients);
+	for (int i=0; i<numClients; i++) {
+		pthread_create(&threads[i], NULL, client, NULL);
+	}
+	for (int i=0; i<numClients; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	double elapsed = now() - start;
+
+	std::sort(latencies.begin(), latencies.end());
+	printf("%d requests, %d clients, %d failed\n", numRequests, numClients,
+		   failures);
+	printf("throughput %.1f compiles/s\n", numRequests / (elapsed/1000));
+	printf("latency ms: p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+		   percentile(50), percentile(90), percentile(99),
+		   latencies.back());
+	return failures > 0 ? 1 : 0;
+}
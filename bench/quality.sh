@@ -0,0 +1,153 @@
+#!/bin/sh
+# Runs every testcase and a generated corpus at each optimization setting
+# and records what the generated code does: instructions executed, loads,
+# stores, calls and cycles. Results are checked against bench/quality.baseline
+# and the run fails if any of them got more than THRESHOLD percent worse.
+# Each setting's output has to match the default one's, and that has to
+# match the testcase's .expected file when it has one; a wrong output, or a
+# run that fails or takes more than TIMEOUT seconds, fails the check and
+# can't go in the baseline.
+# Run from the top of the tree after make bench builds everything:
+#   sh bench/quality.sh            compare against the baseline
+#   sh bench/quality.sh -update    write a new baseline
+
+MICRO=./build/micro
+GEN=./build/genlittle
+BASELINE=bench/quality.baseline
+THRESHOLD=${THRESHOLD:-1}
+TIMEOUT=${TIMEOUT:-10}
+DIR=${TMPDIR:-/tmp}/little_quality.$$
+RESULTS=$DIR/results
+
+if [ ! -x $MICRO ] || [ ! -x $GEN ]; then
+	echo "build micro and genlittle first (make bench)"
+	exit 1
+fi
+mkdir -p $DIR
+
+# the corpus: the testcases, plus generated programs bigger than any of them
+for f in testcases/*.micro; do
+	cp $f $DIR/
+done
+$GEN -funcs 8 -seed 1 > $DIR/gen_small.micro
+$GEN -funcs 30 -depth 4 -nest 3 -seed 2 > $DIR/gen_deep.micro
+$GEN -funcs 60 -globals 20 -locals 12 -stmts 12 -seed 3 > $DIR/gen_wide.micro
+
+limit() {
+	if command -v timeout > /dev/null; then
+		timeout $TIMEOUT "$@"
+	else
+		"$@"
+	fi
+}
+
+input_for() {
+	case $1 in
+		factorial) echo 7 ;;
+		fibonacci) echo 15 ;;
+		fma) printf "1.5\n2.0\n3.0\n" ;;
+		*) echo ;;
+	esac
+}
+
+# flags a testcase can't run without, on top of every setting's
+flags_for() {
+	case $1 in
+		mutual) echo -tailcall ;;
+	esac
+}
+
+# value of "name" in the vm statistics
+stat() {
+	sed -n "s/.*$1[:=] *\([0-9]*\).*/\1/p" $DIR/err | head -1
+}
+
+: > $RESULTS
+for f in $DIR/*.micro; do
+	name=`basename $f .micro`
+	for setting in default:"" inline:"-inline" tailcall:"-tailcall" \
+			ipa:"-ipa" all:"-ipa -inline -tailcall" live:"-live" \
+			live-all:"-live -ipa -inline -tailcall"; do
+		label=${setting%%:*}
+		flags="${setting#*:} `flags_for $name`"
+		if input_for $name | limit $MICRO $f $flags --run -stats \
+				> $DIR/out 2> $DIR/err; then
+			if [ $label = default ]; then
+				mv $DIR/out $DIR/expected
+				if [ -f testcases/$name.expected ] &&
+						! cmp -s testcases/$name.expected $DIR/expected; then
+					echo $name $label wrong >> $RESULTS
+					continue
+				fi
+			elif ! cmp -s $DIR/expected $DIR/out; then
+				echo $name $label wrong >> $RESULTS
+				continue
+			fi
+			echo $name $label `stat "#Instructions"` `stat "#Loads"` \
+				`stat "#Stores"` `stat "#Calls"` `stat "Total Cycles "` \
+				>> $RESULTS
+		else
+			echo $name $label fail >> $RESULTS
+		fi
+	done
+done
+
+if [ "$1" = "-update" ]; then
+	if grep -q " fail$\| wrong$" $RESULTS; then
+		echo "not writing $BASELINE, these runs failed or printed the wrong output:"
+		grep " fail$\| wrong$" $RESULTS
+		rm -rf $DIR
+		exit 1
+	fi
+	echo "# program setting instructions loads stores calls cycles" \
+		> $BASELINE
+	cat $RESULTS >> $BASELINE
+	echo "wrote $BASELINE"
+	rm -rf $DIR
+	exit 0
+fi
+
+# one line per program and setting, and a nonzero exit on any regression
+awk -v threshold=$THRESHOLD '
+	FNR == NR {
+		if ($1 != "#") base[$1 " " $2] = $0
+		next
+	}
+	{
+		key = $1 " " $2
+		if ($3 == "fail" || $3 == "wrong") {
+			printf "%-12s %-9s %s\n", $1, $2,
+				($3 == "fail" ? "FAILED" : "WRONG OUTPUT")
+			bad++
+			next
+		}
+		if (!(key in base)) {
+			printf "%-12s %-9s new\n", $1, $2
+			next
+		}
+		split(base[key], b, " ")
+		if (b[3] !~ /^[0-9]+$/) {
+			printf "%-12s %-9s BAD BASELINE (%s)\n", $1, $2, b[3]
+			bad++
+			next
+		}
+		worst = 0; what = ""
+		split("instructions loads stores calls cycles", names, " ")
+		for (i = 3; i <= 7; i++) {
+			change = b[i] > 0 ? ($i - b[i]) * 100 / b[i] : ($i > 0 ? 100 : 0)
+			if (change > worst) { worst = change; what = names[i-2] }
+		}
+		cycles = b[7] > 0 ? ($7 - b[7]) * 100 / b[7] : 0
+		status = "ok"
+		if (worst > threshold) { status = "REGRESSED (" what ")"; bad++ }
+		printf "%-12s %-9s %10d cycles %+7.2f%%  %s\n", $1, $2, $7, cycles, status
+	}
+	END {
+		if (bad > 0) {
+			printf "%d failed, wrong or regressed over %s%%\n", bad, threshold
+			exit 1
+		}
+	}' $BASELINE $RESULTS
+status=$?
+rm -rf $DIR
+exit $status
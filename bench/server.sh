@@ -0,0 +1,37 @@
+#!/bin/sh
+# Compares compiling the testcases through micro --server with starting a
+# micro for each one, at 1 and CLIENTS concurrent clients.
+# Run from the top of the tree after make loadgen:  sh bench/server.sh
+# REQUESTS sets how many compiles each run sends.
+
+MICRO=./build/micro
+LOADGEN=./build/loadgen
+REQUESTS=${REQUESTS:-2000}
+CLIENTS=${CLIENTS:-4}
+SOCK=${TMPDIR:-/tmp}/little_server.$$
+
+if [ ! -x $MICRO ] || [ ! -x $LOADGEN ]; then
+	echo "build micro and loadgen first (make loadgen)"
+	exit 1
+fi
+
+$MICRO --server $SOCK &
+server=$!
+while [ ! -S $SOCK ]; do
+	sleep 0.1
+done
+
+status=0
+for clients in 1 $CLIENTS; do
+	for flags in "" "-live"; do
+		echo "== server, $clients clients ${flags:-default}"
+		$LOADGEN -socket $SOCK -clients $clients -requests $REQUESTS $flags \
+			testcases/*.micro || status=1
+		echo "== a micro per compile, $clients clients ${flags:-default}"
+		$LOADGEN -spawn $MICRO -clients $clients -requests $REQUESTS $flags \
+			testcases/*.micro || status=1
+	done
+done
+
+kill $server
+exit $status
@@ -0,0 +1,191 @@
+#!/bin/sh
+# Checks that optimizing doesn't change what a program does. Every testcase
+# and RANDOM_PROGRAMS generated ones are compiled at each optimization setting,
+# with and without -live, and run through every backend: the interpreter,
+# the JIT, the object format and C. Each output has to match the same program
+# compiled with no flags and interpreted, and that has to match the
+# testcase's .expected file when it has one. For the settings that pass, the
+# speedup is the drop in executed instructions from that unoptimized run.
+# The testcases' .ir files are malformed IR that micro has to reject.
+# Run from the top of the tree after make validate builds everything:
+#   sh bench/validate.sh
+# SEED picks the generated programs (it's printed, to repeat a failure),
+# TIMEOUT caps each run in seconds, and CC="" leaves out the C backend.
+
+MICRO=./build/micro
+VM=./build/tinyvm
+GEN=./build/genlittle
+RANDOM_PROGRAMS=${RANDOM_PROGRAMS:-10}
+SEED=${SEED:-`date +%s`}
+TIMEOUT=${TIMEOUT:-10}
+CC=${CC-cc}
+DIR=${TMPDIR:-/tmp}/little_validate.$$
+
+if [ ! -x $MICRO ] || [ ! -x $VM ] || [ ! -x $GEN ]; then
+	echo "build micro, tinyvm and genlittle first (make validate)"
+	exit 1
+fi
+if [ -n "$CC" ] && ! command -v $CC > /dev/null; then
+	echo "no $CC, leaving out the C backend"
+	CC=""
+fi
+mkdir -p $DIR
+
+# the corpus: the testcases, plus programs of random shape from genlittle
+for f in testcases/*.micro; do
+	cp $f $DIR/
+done
+s=$SEED
+i=0
+while [ $i -lt $RANDOM_PROGRAMS ]; do
+	s=$(( (s * 1103515245 + 12345) % 2147483648 ))
+	$GEN -funcs $(( 1 + s % 20 )) -depth $(( 1 + s / 20 % 4 )) \
+		-nest $(( s / 80 % 4 )) -globals $(( s / 320 % 10 )) \
+		-locals $(( 1 + s / 3200 % 10 )) -stmts $(( 1 + s / 32000 % 12 )) \
+		-seed $s > $DIR/rand_$s.micro
+	i=$(( i + 1 ))
+done
+
+input_for() {
+	case $1 in
+		factorial) echo 7 ;;
+		fibonacci) echo 15 ;;
+		fma) printf "1.5\n2.0\n3.0\n" ;;
+		*) echo ;;
+	esac
+}
+
+# flags a testcase can't run without, on top of every setting's
+flags_for() {
+	case $1 in
+		mutual) echo -tailcall ;;
+	esac
+}
+
+# a miscompiled loop shouldn't hang the whole run
+limit() {
+	if command -v timeout > /dev/null; then
+		timeout $TIMEOUT "$@"
+	else
+		"$@"
+	fi
+}
+
+# run one backend of $name compiled with $flags, output into $DIR/out
+run_backend() {
+	case $1 in
+		interp)
+			input_for $name | limit $MICRO $f $flags --run -stats \
+				> $DIR/out 2> $DIR/err ;;
+		jit)
+			input_for $name | limit $MICRO $f $flags --run -jit \
+				> $DIR/out 2> /dev/null ;;
+		obj)
+			$MICRO $f $flags -obj > $DIR/prog.obj 2> /dev/null &&
+				input_for $name | limit $VM -nostats -regs 4 $DIR/prog.obj \
+					> $DIR/out 2> /dev/null ;;
+		c)
+			# -O2 for gcc's sibling calls, which deep tail recursion needs
+			$MICRO $f $flags -emitc > $DIR/prog.c 2> /dev/null &&
+				$CC -O2 -w -o $DIR/prog $DIR/prog.c 2> /dev/null &&
+				input_for $name | limit $DIR/prog > $DIR/out 2> /dev/null ;;
+	esac
+}
+
+instructions() {
+	sed -n 's/.*#Instructions[:=] *\([0-9]*\).*/\1/p' $DIR/err | head -1
+}
+
+SETTINGS='default: inline:-inline tailcall:-tailcall ipa:-ipa
+	all:-ipa_-inline_-tailcall live:-live live-inline:-live_-inline
+	live-tailcall:-live_-tailcall live-ipa:-live_-ipa
+	live-all:-live_-ipa_-inline_-tailcall pgo:-inline_-profile-use
+	live-pgo:-live_-inline_-profile-use O1:-O1 O2:-O2'
+BACKENDS="interp jit obj"
+[ -n "$CC" ] && BACKENDS="$BACKENDS c"
+
+echo "seed $SEED"
+printf "%-16s %-14s %-22s %12s %8s\n" program setting backends \
+	instructions speedup
+failures=0
+: > $DIR/speedups
+# malformed IR files have to be turned away with the error in their .expected
+for f in testcases/*.ir; do
+	[ -f $f ] || continue
+	name=`basename $f .ir`
+	if $MICRO $f > /dev/null 2> $DIR/err &&
+			cmp -s testcases/$name.expected $DIR/err; then
+		printf "%-16s %-14s rejected\n" $name ir
+	else
+		printf "%-16s %-14s not rejected like testcases/%s.expected\n" \
+			$name ir $name
+		cp $DIR/err $DIR/$name.err
+		failures=$(( failures + 1 ))
+	fi
+done
+for f in $DIR/*.micro; do
+	name=`basename $f .micro`
+	flags=`flags_for $name`
+	if ! run_backend interp; then
+		printf "%-16s %-14s reference run failed\n" $name none
+		failures=$(( failures + 1 ))
+		continue
+	fi
+	mv $DIR/out $DIR/expected
+	# a testcase with a .expected file says what it has to print, which
+	# every setting agreeing on can't show
+	if [ -f testcases/$name.expected ] &&
+			! cmp -s testcases/$name.expected $DIR/expected; then
+		printf "%-16s %-14s wrong output, see testcases/%s.expected\n" \
+			$name none $name
+		cp $DIR/expected $DIR/$name.out
+		failures=$(( failures + 1 ))
+		continue
+	fi
+	base=`instructions`
+	# the pgo settings use a profile of the unoptimized run
+	input_for $name | $MICRO $f `flags_for $name` --run -profile-gen $DIR/$name.prof > /dev/null
+	for setting in $SETTINGS; do
+		label=${setting%%:*}
+		flags=`echo ${setting#*:} \`flags_for $name\` | tr _ ' ' |
+			sed "s|-profile-use|-profile-use $DIR/$name.prof|"`
+		status=""
+		count=0
+		bad=0
+		for backend in $BACKENDS; do
+			# C has its own register allocation, so -live is the same program
+			case "$backend $flags" in "c "*-live*) continue ;; esac
+			if run_backend $backend && cmp -s $DIR/expected $DIR/out; then
+				status="$status $backend"
+				[ $backend = interp ] && count=`instructions`
+			else
+				status="$status $backend:FAIL"
+				bad=1
+				cp $DIR/out $DIR/$name.$label.$backend.out 2> /dev/null
+			fi
+		done
+		if [ $bad = 1 ]; then
+			failures=$(( failures + 1 ))
+			printf "%-16s %-14s %-22s %12s %8s\n" $name $label "${status# }" - -
+		else
+			# only a correct run counts towards the speedup
+			echo $base $count >> $DIR/speedups
+			speedup=`echo $base $count |
+				awk '{ printf "%.3fx", ($2 > 0 ? $1 / $2 : 0) }'`
+			printf "%-16s %-14s %-22s %12d %8s\n" $name $label "${status# }" \
+				$count $speedup
+		fi
+	done
+done
+
+awk '$2 > 0 { logs += log($1 / $2); n++ }
+	END { if (n > 0) printf "%d correct runs, geometric mean speedup %.3fx\n",
+		n, exp(logs / n) }' $DIR/speedups
+if [ $failures -gt 0 ]; then
+	rm -f $DIR/out $DIR/err $DIR/prog $DIR/prog.c $DIR/prog.obj \
+		$DIR/speedups
+	echo "$failures failures, programs and outputs kept in $DIR"
+	exit 1
+fi
+rm -rf $DIR
+exit 0
@@ -0,0 +1,613 @@
+/* The compile caches. The per-function one keeps each function's TINY in a
+ * file named for a hash of its source, so a function that hasn't changed
+ * is parsed but skips its IR, the passes, liveness and codegen, and its
+ * code is spliced in; with whole program passes, or from an IR file, the
+ * hash is of its IR after the passes instead. The output one keeps the
+ * whole program's TINY under a hash of the source and the options, so an
+ * identical compile doesn't even parse. */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <utime.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+#include "driver.h"
+
+#define FUNCTION_CACHE_VERSION "little function cache 2"
+#define OUTPUT_CACHE_VERSION "little output cache 1"
+// a rebuilt compiler may generate different code for the same input
+#define COMPILER_BUILD __DATE__ " " __TIME__
+
+namespace little {
+
+// FNV-1a, which is plenty to tell functions apart
+static unsigned long long hashText(const std::string &s,
+								   unsigned long long h = 14695981039346656037ULL) {
+	for (int i=0; i<s.size(); i++) {
+		h ^= (unsigned char)s[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+// like mkdir -p, so pointing a cache at a new directory just works
+static bool makeCacheDir(const std::string &dir) {
+	for (int i=1; i<=dir.size(); i++) {
+		if (i < dir.size() && dir[i] != '/') {
+			continue;
+		}
+		std::string part = dir.substr(0, i);
+		struct stat st;
+		if (mkdir(part.c_str(), 0755) != 0 && (stat(part.c_str(), &st) != 0 ||
+				!S_ISDIR(st.st_mode))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Driver::setFunctionCache(std::string dir) {
+	if (!makeCacheDir(dir)) {
+		*errStream << "could not create cache directory " << dir << std::endl;
+		return false;
+	}
+	functionCacheDir = dir;
+	return true;
+}
+
+void Driver::setSkipCachedIR(bool s) {
+	skipCachedIR = s;
+}
+
+// temps, labels and inlined locals are numbered across the whole program,
+// so one more of them early on would change the key of every function
+// after it; numbered in the order they come up instead, a function's key
+// only changes with the function
+static std::string renumberNames(const std::string &text) {
+	static const char *prefixes[] = {TEMP_VAR_PRE, TEMP_LABEL_PRE,
+									 INLINE_VAR_PRE};
+	std::map< std::string, std::string> names;
+	std::string out;
+	int i = 0;
+	while (i < text.size()) {
+		int end = i;
+		while (end < text.size() && text[end] != ' ' && text[end] != '\n') {
+			end++;
+		}
+		std::string token = text.substr(i, end - i);
+		for (int p=0; p<3; p++) {
+			int len = strlen(prefixes[p]);
+			if (token.size() <= len || token.compare(0, len, prefixes[p]) != 0 ||
+					token.find_first_not_of("0123456789", len) !=
+					std::string::npos) {
+				continue;
+			}
+			if (names.count(token) == 0) {
+				std::ostringstream os;
+				os << "%" << names.size();
+				names[token] = os.str();
+			}
+			token = names[token];
+		}
+		out += token;
+		if (end < text.size()) {
+			out += text[end];
+		}
+		i = end + 1;
+	}
+	return out;
+}
+
+std::string Driver::getFunctionInputs(std::string fname) {
+	// the function's IR after the IR passes, its own declarations and the
+	// types a compare gets; codegen reads nothing else of it
+	std::ostringstream os;
+	funcStruct_s f;
+	findFuncData(fname, f);
+	os << "func " << f.name << " " << f.type << " " << f.retLoc << "\n";
+	for (int i=0; i<f.params.size(); i++) {
+		os << "param " << f.params[i].identifier << " "
+		   << f.params[i].type << "\n";
+	}
+	for (int i=0; i<f.retVals.size(); i++) {
+		os << "ret " << f.retVals[i] << "\n";
+	}
+	int scopeNum = getScopeNumber(fname);
+	if (symbolTable.count(scopeNum) == 1) {
+		std::vector< VarStruct_s>::iterator vIt;
+		for (vIt = symbolTable[scopeNum].begin();
+					vIt != symbolTable[scopeNum].end(); vIt++) {
+			// a temp's register comes from its number
+			bool temp = vIt->identifier.find(TEMP_VAR_PRE) == 0;
+			os << "var " << vIt->identifier << " " << vIt->type << " "
+			   << (temp ? "" : vIt->altName) << "\n";
+		}
+	}
+	std::list< IRNode> &nodes = functionMap[fname];
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		os << it->opCode << " " << it->op1 << " " << it->op2 << " "
+		   << it->Result << " " << it->ifFlags;
+		if (isBranch(it->opCode)) {
+			os << " " << getType(*it);
+		}
+		os << "\n";
+	}
+	// the profile steers which variables get registers
+	std::map< std::string, std::map< std::string, long long> >::iterator pIt;
+	pIt = profile.find(fname);
+	if (pIt != profile.end()) {
+		std::map< std::string, long long>::iterator lIt;
+		for (lIt = pIt->second.begin(); lIt != pIt->second.end(); lIt++) {
+			os << "profile " << lIt->first << " " << lIt->second << "\n";
+		}
+	}
+	return renumberNames(os.str());
+}
+
+void Driver::lookupFunctionSource(std::string fname) {
+	// called as the parser starts a function, so a hit skips its IR and
+	// the passes; the key is its tokens, the globals and headers, and the
+	// profile with the labels counted from the function's first
+	skippingIR = false;
+	if (!skipCachedIR || functionCacheDir.empty() ||
+			functionSources.count(fname) == 0 || functionKeys.count(fname) == 1) {
+		return;
+	}
+	std::ostringstream os;
+	os << FUNCTION_CACHE_VERSION << " " << COMPILER_BUILD << " "
+	   << liveness << " " << getPipeline() << "\n";
+	os << "shared " << sharedSource << "\n";
+	os << "source " << functionSources[fname] << "\n";
+	std::map< std::string, std::map< std::string, long long> >::iterator pIt;
+	pIt = profile.find(fname);
+	if (pIt != profile.end()) {
+		int len = strlen(TEMP_LABEL_PRE);
+		std::map< std::string, long long>::iterator lIt;
+		for (lIt = pIt->second.begin(); lIt != pIt->second.end(); lIt++) {
+			os << "profile ";
+			if (lIt->first.compare(0, len, TEMP_LABEL_PRE) == 0) {
+				os << "+" << atoi(lIt->first.c_str() + len) - tempLabelCount;
+			} else {
+				os << lIt->first;
+			}
+			os << " " << lIt->second << "\n";
+		}
+	}
+	char key[17];
+	snprintf(key, sizeof(key), "%016llx", hashText(os.str()));
+	functionKeys[fname] = key;
+	if (readFunctionCache(fname)) {
+		skippingIR = true;
+	} else {
+		functionCacheMisses++;
+	}
+	return;
+}
+
+void Driver::lookupFunctionCache() {
+	// the functions the parser looked up already have keys; the rest, from
+	// an IR file or with whole program passes, are keyed on their IR
+	if (functionCacheDir.empty() || !profileGen.empty()) {
+		return;
+	}
+
+	// what every function shares: the flags and the globals
+	std::ostringstream common;
+	common << FUNCTION_CACHE_VERSION << " " << COMPILER_BUILD << " "
+		   << liveness << " " << getPipeline() << "\n";
+	std::vector< VarStruct_s>::iterator vIt;
+	for (vIt = symbolTable[0].begin(); vIt != symbolTable[0].end(); vIt++) {
+		common << "global " << vIt->identifier << " " << vIt->type << " "
+			   << vIt->value << "\n";
+	}
+	unsigned long long commonHash = hashText(common.str());
+
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		if (functionKeys.count(fIt->first) == 1) {
+			continue;
+		}
+		char key[17];
+		snprintf(key, sizeof(key), "%016llx",
+				 hashText(getFunctionInputs(fIt->first), commonHash));
+		functionKeys[fIt->first] = key;
+		if (!readFunctionCache(fIt->first)) {
+			functionCacheMisses++;
+		}
+	}
+	return;
+}
+
+std::string Driver::getCallInterface(std::string callee) {
+	// all a call's code knows of the callee: where its arguments go, where
+	// its value comes back and what it and its callees write
+	funcStruct_s f;
+	findFuncData(callee, f);
+	std::ostringstream os;
+	os << "regparams " << f.numRegParams << " params";
+	for (int i=0; i<f.params.size(); i++) {
+		os << " " << f.params[i].altName;
+	}
+	os << " retreg " << f.retReg << " clobber";
+	std::set< std::string>::iterator it;
+	for (it = clobberSets[callee].begin(); it != clobberSets[callee].end();
+				it++) {
+		os << " " << *it;
+	}
+	return os.str();
+}
+
+bool Driver::checkFunctionCache() {
+	// a hit's calls were written for its callees as they were then, and a
+	// callee that has changed since may take its arguments or write its
+	// registers differently now
+	staleFunctions.clear();
+	std::map< std::string, std::map< std::string, std::string> >::iterator hIt;
+	for (hIt = cachedCalls.begin(); hIt != cachedCalls.end(); hIt++) {
+		std::map< std::string, std::string>::iterator cIt;
+		for (cIt = hIt->second.begin(); cIt != hIt->second.end(); cIt++) {
+			if (functionMap.count(cIt->first) == 0 ||
+					getCallInterface(cIt->first) != cIt->second) {
+				staleFunctions.push_back(hIt->first);
+				break;
+			}
+		}
+	}
+	return staleFunctions.empty();
+}
+
+bool Driver::functionCacheStale() {
+	return !staleFunctions.empty();
+}
+
+bool Driver::removeStaleFunctions() {
+	// so compiling again generates them
+	for (int i=0; i<staleFunctions.size(); i++) {
+		std::string path = functionCacheDir + "/" +
+						   functionKeys[staleFunctions[i]] + ".fn";
+		if (remove(path.c_str()) != 0) {
+			*errStream << "could not remove " << path << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Driver::readFunctionCache(std::string fname) {
+	std::string path = functionCacheDir + "/" + functionKeys[fname] + ".fn";
+	std::ifstream is(path.c_str());
+	std::string line;
+	if (!is || !std::getline(is, line) || line != FUNCTION_CACHE_VERSION) {
+		return false;
+	}
+	// only the params' registers, the rest comes from the declaration
+	funcStruct_s f;
+	f.numRegParams = 0;
+	std::set< std::string> clobbers;
+	std::map< std::string, std::string> calls;
+	while (std::getline(is, line) && line != "text") {
+		std::istringstream ls(line);
+		std::string what;
+		ls >> what;
+		if (what == "regparams") {
+			ls >> f.numRegParams;
+		} else if (what == "param") {
+			VarStruct_s v;
+			ls >> v.altName;
+			f.params.push_back(v);
+		} else if (what == "retreg") {
+			ls >> f.retReg;
+		} else if (what == "clobber") {
+			std::string reg;
+			while (ls >> reg) {
+				clobbers.insert(reg);
+			}
+		} else if (what == "call") {
+			std::string callee;
+			ls >> callee >> std::ws;
+			std::getline(ls, calls[callee]);
+		}
+	}
+	if (line != "text") {
+		return false;
+	}
+	std::ostringstream text;
+	text << is.rdbuf();
+	cachedTiny[fname] = text.str();
+	cachedInterfaces[fname] = f;
+	cachedClobbers[fname] = clobbers;
+	cachedCalls[fname] = calls;
+	return true;
+}
+
+// labels are global in TINY, so an entry numbers the function's own and
+// they're named afresh wherever it's spliced in
+static std::string cacheLabel(const std::string &s,
+							  std::map< std::string, std::string> &names) {
+	if (s.compare(0, strlen(TEMP_LABEL_PRE), TEMP_LABEL_PRE) != 0) {
+		return s;
+	}
+	if (names.count(s) == 0) {
+		std::ostringstream os;
+		os << "%" << names.size();
+		names[s] = os.str();
+	}
+	return names[s];
+}
+
+void Driver::writeFunctionCache(std::string fname,
+								std::vector< TinyInst> &code) {
+	if (functionCacheDir.empty() || functionKeys.count(fname) == 0) {
+		return;
+	}
+	funcStruct_s f;
+	findFuncData(fname, f);
+	std::string path = functionCacheDir + "/" + functionKeys[fname] + ".fn";
+	std::ostringstream tmp;
+	tmp << path << ".tmp" << getpid();
+	std::ofstream os(tmp.str().c_str());
+	if (!os) {
+		*errStream << "could not write " << tmp.str() << std::endl;
+		return;
+	}
+	os << FUNCTION_CACHE_VERSION << std::endl;
+	os << "regparams " << f.numRegParams << std::endl;
+	for (int i=0; i<f.params.size(); i++) {
+		os << "param " << f.params[i].altName << std::endl;
+	}
+	os << "retreg " << f.retReg << std::endl;
+	os << "clobber";
+	std::set< std::string>::iterator it;
+	for (it = directClobbers[fname].begin();
+				it != directClobbers[fname].end(); it++) {
+		os << " " << *it;
+	}
+	os << std::endl;
+	std::set< std::string> callees;
+	std::list< IRNode>::iterator nIt;
+	for (nIt = functionMap[fname].begin(); nIt != functionMap[fname].end();
+				nIt++) {
+		if (nIt->opCode == "JSR" && functionMap.count(nIt->Result) == 1) {
+			callees.insert(nIt->Result);
+		}
+	}
+	for (it = callees.begin(); it != callees.end(); it++) {
+		os << "call " << *it << " " << getCallInterface(*it) << std::endl;
+	}
+	os << "text" << std::endl;
+	std::vector< TinyInst> text(code);
+	std::map< std::string, std::string> labels;
+	for (int i=0; i<text.size(); i++) {
+		text[i].a = cacheLabel(text[i].a, labels);
+		text[i].b = cacheLabel(text[i].b, labels);
+	}
+	writeTinyCode(os, text);
+	os.close();
+	// a reader sees the whole entry or none of it
+	if (!os || rename(tmp.str().c_str(), path.c_str()) != 0) {
+		*errStream << "could not write " << path << std::endl;
+		remove(tmp.str().c_str());
+	}
+	return;
+}
+
+void Driver::spliceFunctionCache(std::string fname) {
+	std::istringstream text(cachedTiny[fname]);
+	int start = tinyCode.size();
+	readTinyCode(text, tinyCode);
+	std::map< std::string, std::string> labels;
+	for (int i=start; i<tinyCode.size(); i++) {
+		std::string *operands[2] = {&tinyCode[i].a, &tinyCode[i].b};
+		for (int j=0; j<2; j++) {
+			std::string &s = *operands[j];
+			if (s.empty() || s[0] != '%') {
+				continue;
+			}
+			if (labels.count(s) == 0) {
+				labels[s] = createScopedLabel();
+			}
+			s = labels[s];
+		}
+	}
+	return;
+}
+
+void Driver::printFunctionCacheStats() {
+	if (functionCacheDir.empty()) {
+		return;
+	}
+	*errStream << "function cache: " << cachedTiny.size() << " hits, "
+			  << functionCacheMisses << " misses" << std::endl;
+}
+
+bool Driver::setOutputCache(std::string dir, long long maxBytes) {
+	if (!dir.empty() && !makeCacheDir(dir)) {
+		*errStream << "could not create cache directory " << dir << std::endl;
+		return false;
+	}
+	outputCacheDir = dir;
+	outputCacheMax = maxBytes;
+	return true;
+}
+
+bool Driver::readOutputCache(const std::string &source) {
+	// everything the output depends on: the compiler, the options, the
+	// profile and the source bytes
+	outputCacheHit = false;
+	if (outputCacheDir.empty()) {
+		return false;
+	}
+	std::ostringstream os;
+	os << OUTPUT_CACHE_VERSION << " " << COMPILER_BUILD << " " << liveness
+	   << " " << getPipeline() << "\n";
+	std::map< std::string, std::map< std::string, long long> >::iterator pIt;
+	for (pIt = profile.begin(); pIt != profile.end(); pIt++) {
+		std::map< std::string, long long>::iterator lIt;
+		for (lIt = pIt->second.begin(); lIt != pIt->second.end(); lIt++) {
+			os << "profile " << pIt->first << " " << lIt->first << " "
+			   << lIt->second << "\n";
+		}
+	}
+	os << "source " << source.size() << "\n";
+	unsigned long long h = hashText(source, hashText(os.str()));
+	// two hashes of the source, seeded apart, so a collision takes both
+	unsigned long long h2 = hashText(source, h ^ 0x9e3779b97f4a7c15ULL);
+	char key[33];
+	snprintf(key, sizeof(key), "%016llx%016llx", h, h2);
+	outputKey = key;
+
+	std::string path = outputCacheDir + "/" + outputKey + ".out";
+	std::ifstream is(path.c_str());
+	std::string line;
+	if (is && std::getline(is, line) && line == OUTPUT_CACHE_VERSION) {
+		tinyCode.clear();
+		readTinyCode(is, tinyCode);
+		outputCacheHit = true;
+		// touched on every hit, so eviction drops the least recently used
+		utime(path.c_str(), NULL);
+	}
+	countOutputCache(outputCacheHit);
+	return outputCacheHit;
+}
+
+void Driver::writeOutputCache() {
+	if (outputCacheDir.empty() || outputCacheHit || outputKey.empty()) {
+		return;
+	}
+	std::string path = outputCacheDir + "/" + outputKey + ".out";
+	std::ostringstream tmp;
+	tmp << path << ".tmp" << getpid();
+	std::ofstream os(tmp.str().c_str());
+	if (!os) {
+		*errStream << "could not write " << tmp.str() << std::endl;
+		return;
+	}
+	os << OUTPUT_CACHE_VERSION << std::endl;
+	writeTinyCode(os, tinyCode);
+	os.close();
+	// a reader sees the whole entry or none of it
+	if (!os || rename(tmp.str().c_str(), path.c_str()) != 0) {
+		*errStream << "could not write " << path << std::endl;
+		remove(tmp.str().c_str());
+		return;
+	}
+	evictOutputCache();
+	return;
+}
+
+void Driver::countOutputCache(bool hit) {
+	// the counts live in the cache, shared by every micro that uses it
+	std::string path = outputCacheDir + "/stats";
+	int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+	if (fd < 0) {
+		*errStream << "could not update " << path << std::endl;
+		return;
+	}
+	flock(fd, LOCK_EX);
+	char buf[128];
+	int n = read(fd, buf, sizeof(buf) - 1);
+	buf[n > 0 ? n : 0] = 0;
+	unsigned long long hits = 0;
+	unsigned long long misses = 0;
+	sscanf(buf, "hits %llu misses %llu", &hits, &misses);
+	if (hit) {
+		hits++;
+	} else {
+		misses++;
+	}
+	n = snprintf(buf, sizeof(buf), "hits %llu misses %llu\n", hits, misses);
+	lseek(fd, 0, SEEK_SET);
+	if (ftruncate(fd, 0) != 0 || write(fd, buf, n) != n) {
+		*errStream << "could not update " << path << std::endl;
+	}
+	flock(fd, LOCK_UN);
+	close(fd);
+}
+
+// the entries in a cache directory, oldest first
+static void listOutputCache(std::string dir,
+							std::vector< std::pair< time_t, std::string> > &entries,
+							long long &total) {
+	entries.clear();
+	total = 0;
+	DIR *d = opendir(dir.c_str());
+	if (d == NULL) {
+		return;
+	}
+	struct dirent *e;
+	while ((e = readdir(d)) != NULL) {
+		std::string name = e->d_name;
+		struct stat st;
+		std::string path = dir + "/" + name;
+		if (name.size() < 4 || name.substr(name.size() - 4) != ".out" ||
+				stat(path.c_str(), &st) != 0) {
+			continue;
+		}
+		entries.push_back(std::make_pair(st.st_mtime, path));
+		total += st.st_size;
+	}
+	closedir(d);
+	std::sort(entries.begin(), entries.end());
+}
+
+void Driver::evictOutputCache() {
+	// past the limit, drop the least recently used down to nine tenths of
+	// it, so the next few misses don't each have to
+	if (outputCacheMax <= 0) {
+		return;
+	}
+	std::vector< std::pair< time_t, std::string> > entries;
+	long long total;
+	listOutputCache(outputCacheDir, entries, total);
+	if (total <= outputCacheMax) {
+		return;
+	}
+	for (int i=0; i<entries.size() && total > outputCacheMax/10*9; i++) {
+		struct stat st;
+		if (stat(entries[i].second.c_str(), &st) == 0 &&
+				remove(entries[i].second.c_str()) == 0) {
+			total -= st.st_size;
+		}
+	}
+	return;
+}
+
+void Driver::printOutputCacheStats(bool all) {
+	if (outputCacheDir.empty()) {
+		return;
+	}
+	if (!all) {
+		*errStream << "output cache: " << (outputCacheHit ? "hit" : "miss")
+				  << std::endl;
+		return;
+	}
+	std::string path = outputCacheDir + "/stats";
+	std::ifstream is(path.c_str());
+	std::string word;
+	unsigned long long h = 0;
+	unsigned long long m = 0;
+	is >> word >> h >> word >> m; // no stats file yet is all zeroes
+	std::vector< std::pair< time_t, std::string> > entries;
+	long long total;
+	listOutputCache(outputCacheDir, entries, total);
+	*outStream << "hits " << h << std::endl;
+	*outStream << "misses " << m << std::endl;
+	*outStream << "entries " << entries.size() << std::endl;
+	*outStream << "size " << total << " bytes";
+	if (outputCacheMax > 0) {
+		*outStream << " of " << outputCacheMax;
+	}
+	*outStream << std::endl;
+}
+
+} // namespace little
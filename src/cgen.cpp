@@ -0,0 +1,314 @@
+/* C code generation from the per-function lists in functionMap. */
+
+#include <iostream>
+#include <sstream>
+#include <cctype>
+
+#include "driver.h"
+
+#define C_NAME_PRE "l_"
+
+namespace little {
+
+std::string Driver::cName(std::string s) {
+	// LITTLE names can be C keywords or libc functions
+	return C_NAME_PRE + s;
+}
+
+std::string Driver::cTypeName(littleTypes t) {
+	if (t == FLOAT) {
+		return "float";
+	} else if (t == VOID) {
+		return "void";
+	}
+	return "int";
+}
+
+std::string Driver::cOperand(std::string s, littleTypes type) {
+	// as the view of s an I or F op would read, like tiny's cells
+	if (isLiteral(s)) {
+		if (type == FLOAT) {
+			return s.find('.') == std::string::npos ? s + ".0f" : s + "f";
+		}
+		return s.find('.') == std::string::npos ? s : "(int)" + s;
+	}
+	if (cTypes.count(s) == 1 && cTypes[s] != type) {
+		return "(" + cTypeName(type) + ")" + cName(s);
+	}
+	return cName(s);
+}
+
+void Driver::findCTypes(funcStruct_s &f) {
+	cTypes.clear();
+	std::vector< VarStruct_s>::iterator vIt;
+	for (vIt = symbolTable[0].begin(); vIt != symbolTable[0].end(); vIt++) {
+		cTypes[vIt->identifier] = vIt->type;
+	}
+	for (int i=0; i<f.params.size(); i++) {
+		cTypes[f.params[i].identifier] = f.params[i].type;
+	}
+	int scopeNum = getScopeNumber(f.name);
+	if (symbolTable.count(scopeNum) == 0) {
+		return;
+	}
+	for (vIt = symbolTable[scopeNum].begin();
+				vIt != symbolTable[scopeNum].end(); vIt++) {
+		cTypes[vIt->identifier] = vIt->type;
+	}
+
+	// a temp takes the type of whatever defines it, which for a call
+	// result is the callee
+	std::list< IRNode> &nodes = functionMap[f.name];
+	std::list< IRNode>::iterator it;
+	std::string callee;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		if (it->opCode == "JSR") {
+			callee = it->Result;
+		}
+		if (it->Result.find(TEMP_VAR_PRE) != 0 || !isDefinition(*it)) {
+			continue;
+		}
+		if (it->opCode == "POP") {
+			funcStruct_s g;
+			g.type = INT;
+			findFuncData(callee, g);
+			cTypes[it->Result] = g.type == FLOAT ? FLOAT : INT;
+		} else {
+			char last = it->opCode[it->opCode.size()-1];
+			cTypes[it->Result] = last == 'F' ? FLOAT : INT;
+		}
+	}
+	return;
+}
+
+void Driver::cGenerateFunction(funcStruct_s &f) {
+	findCTypes(f);
+	cStream << "static " << cTypeName(f.type) << " " << cName(f.name)
+			<< "(";
+	for (int i=0; i<f.params.size(); i++) {
+		cStream << (i > 0 ? ", " : "") << cTypeName(f.params[i].type)
+				<< " " << cName(f.params[i].identifier);
+	}
+	cStream << (f.params.empty() ? "void" : "") << ")" << std::endl;
+	cStream << "{" << std::endl;
+
+	// locals, temps and anything inlined or localized into this scope
+	int scopeNum = getScopeNumber(f.name);
+	std::vector< VarStruct_s>::iterator vIt;
+	for (vIt = symbolTable[scopeNum].begin();
+				vIt != symbolTable[scopeNum].end(); vIt++) {
+		cStream << "\t" << cTypeName(cTypes[vIt->identifier]) << " "
+				<< cName(vIt->identifier) << " = 0;" << std::endl;
+	}
+
+	std::list< IRNode> &nodes = functionMap[f.name];
+	std::list< IRNode>::iterator it;
+	std::vector< std::vector< std::string> > args; // one per open call
+	std::string call; // made, but its return value not popped yet
+	funcStruct_s callee;
+	int numRets = 0;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		std::string op = it->opCode;
+		char last = op.empty() ? ' ' : op[op.size()-1];
+		littleTypes type = last == 'F' ? FLOAT : INT;
+		std::string result = cName(it->Result);
+		if (!call.empty() && op != "POP") {
+			cStream << "\t" << call << ";" << std::endl;
+			call.clear();
+		}
+
+		if (op == "LABEL" && it != nodes.begin()) {
+			cStream << it->Result <<": ;" << std::endl;
+		}
+		else if (op.find("STORE") != std::string::npos) {
+			cStream << "\t" << result << " = "
+					<< cOperand(it->op1, type) << ";" << std::endl;
+		}
+		else if (op.find("ADD") != std::string::npos ||
+				 op.find("SUB") != std::string::npos ||
+				 op.find("MULT") != std::string::npos ||
+				 op.find("DIV") != std::string::npos) {
+			std::string sign = op.find("ADD") == 0 ? " + " :
+							   op.find("SUB") == 0 ? " - " :
+							   op.find("MULT") == 0 ? " * " : " / ";
+			if (type == INT && sign != " / ") {
+				// tiny wraps where C's int overflow is undefined
+				cStream << "\t" << result << " = (int)((unsigned)"
+						<< cOperand(it->op1, type) << sign << "(unsigned)"
+						<< cOperand(it->op2, type) << ");" << std::endl;
+			} else {
+				cStream << "\t" << result << " = " << cOperand(it->op1, type)
+						<< sign << cOperand(it->op2, type) << ";" << std::endl;
+			}
+		}
+		else if (isBranch(op)) {
+			// compare as floats if either side is one
+			littleTypes cmpType = INT;
+			if ((cTypes.count(it->op1) == 1 && cTypes[it->op1] == FLOAT) ||
+					(cTypes.count(it->op2) == 1 && cTypes[it->op2] == FLOAT) ||
+					it->op1.find('.') != std::string::npos ||
+					it->op2.find('.') != std::string::npos) {
+				cmpType = FLOAT;
+			}
+			std::string cmp = op == "GE" ? " >= " : op == "LE" ? " <= " :
+							  op == "NE" ? " != " : op == "LT" ? " < " :
+							  op == "GT" ? " > " : " == ";
+			cStream << "\tif (" << cOperand(it->op1, cmpType) << cmp
+					<< cOperand(it->op2, cmpType) << ") goto "
+					<< it->Result << ";" << std::endl;
+		}
+		else if (op == "JUMP") {
+			cStream << "\tgoto " << it->Result << ";" << std::endl;
+		}
+		else if (op == "WRITEI") {
+			cStream << "\tprintf(\"%d\", " << cOperand(it->Result, INT)
+					<< ");" << std::endl;
+		}
+		else if (op == "WRITEF") {
+			// %g is what tiny's ostream << prints
+			cStream << "\tprintf(\"%g\", (double)"
+					<< cOperand(it->Result, FLOAT) << ");" << std::endl;
+		}
+		else if (op.find("WRITE") != std::string::npos) {
+			cStream << "\tfputs(" << result << ", stdout);" << std::endl;
+		}
+		else if (op.find("READ") != std::string::npos) {
+			cStream << "\t" << result << " = "
+					<< (type == FLOAT ? "readFloat()" : "readInt()") << ";"
+					<< std::endl;
+		}
+		else if (op == "RETURN") {
+			std::string id;
+			if (numRets < f.retVals.size()) {
+				id = f.retVals[numRets];
+			}
+			numRets++;
+			if (f.type == VOID) {
+				cStream << "\treturn;" << std::endl;
+			} else if (id.empty()) {
+				cStream << "\treturn 0;" << std::endl;
+			} else {
+				cStream << "\treturn " << cOperand(id, f.type) << ";"
+						<< std::endl;
+			}
+		}
+		else if (op == "PUSH" && it->Result.empty()) {
+			args.push_back(std::vector< std::string>());
+		}
+		else if (op == "PUSH" && !args.empty()) {
+			// pushed last to first
+			args.back().insert(args.back().begin(), it->Result);
+		}
+		else if (op == "JSR") {
+			callee = funcStruct_s();
+			callee.type = INT;
+			findFuncData(it->Result, callee);
+			std::vector< std::string> a;
+			if (!args.empty()) {
+				a = args.back();
+				args.pop_back();
+			}
+			call = cName(it->Result) + "(";
+			for (int i=0; i<a.size(); i++) {
+				littleTypes pt = i < callee.params.size() ? callee.params[i].type
+														 : INT;
+				call += (i > 0 ? ", " : "") + cOperand(a[i], pt);
+			}
+			call += ")";
+		}
+		else if (op == "POP" && !it->Result.empty() && !call.empty()) {
+			if (callee.type == VOID) {
+				cStream << "\t" << call << ";" << std::endl;
+			} else {
+				cStream << "\t" << result << " = " << call << ";"
+						<< std::endl;
+			}
+			call.clear();
+		}
+	}
+	if (!call.empty()) {
+		cStream << "\t" << call << ";" << std::endl;
+	}
+	cStream << "}" << std::endl << std::endl;
+	return;
+}
+
+void Driver::cGeneration()
+{
+	cStream.str("");
+	cStream << "#include <stdio.h>" << std::endl << std::endl;
+
+	// globals start out zero, like tiny's vars
+	std::vector< VarStruct_s>::iterator varIt;
+	for (varIt = symbolTable[0].begin();
+			varIt != symbolTable[0].end(); varIt++) {
+		if (varIt->type == STRING) {
+			cStream << "static const char *" << cName(varIt->identifier)
+					<< " = " << varIt->value << ";" << std::endl;
+		} else if (varIt->identifier.find(TEMP_VAR_PRE) == std::string::npos) {
+			cStream << "static " << cTypeName(varIt->type) << " "
+					<< cName(varIt->identifier) << ";" << std::endl;
+		}
+	}
+	cStream << std::endl;
+
+	// a failed read gives 0, same as tiny
+	std::set< std::string> reads;
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		std::list< IRNode>::iterator it;
+		for (it = fIt->second.begin(); it != fIt->second.end(); it++) {
+			if (it->opCode.find("READ") != std::string::npos) {
+				reads.insert(it->opCode);
+			}
+		}
+	}
+	if (reads.count("READI") == 1) {
+		cStream << "static int readInt(void)" << std::endl
+				<< "{" << std::endl
+				<< "\tint v;" << std::endl
+				<< "\treturn scanf(\"%d\", &v) == 1 ? v : 0;" << std::endl
+				<< "}" << std::endl << std::endl;
+	}
+	if (reads.count("READF") == 1) {
+		cStream << "static float readFloat(void)" << std::endl
+				<< "{" << std::endl
+				<< "\tfloat v;" << std::endl
+				<< "\treturn scanf(\"%f\", &v) == 1 ? v : 0.0f;" << std::endl
+				<< "}" << std::endl << std::endl;
+	}
+
+	// prototypes, so calls don't depend on declaration order
+	for (int i=0; i<fs.size(); i++) {
+		if (functionMap.count(fs[i].name) == 0) {
+			continue;
+		}
+		cStream << "static " << cTypeName(fs[i].type) << " "
+				<< cName(fs[i].name) << "(";
+		for (int j=0; j<fs[i].params.size(); j++) {
+			cStream << (j > 0 ? ", " : "") << cTypeName(fs[i].params[j].type);
+		}
+		cStream << (fs[i].params.empty() ? "void" : "") << ");" << std::endl;
+	}
+	cStream << std::endl;
+
+	for (int i=0; i<fs.size(); i++) {
+		if (functionMap.count(fs[i].name) == 1) {
+			cGenerateFunction(fs[i]);
+		}
+	}
+
+	cStream << "int main(void)" << std::endl
+			<< "{" << std::endl
+			<< "\t" << cName("main") << "();" << std::endl
+			<< "\treturn 0;" << std::endl
+			<< "}" << std::endl;
+	return;
+}
+
+void Driver::printCCode()
+{
+	*outStream << cStream.str();
+}
+
+} // namespace little
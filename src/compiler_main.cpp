@@ -2,39 +2,269 @@
 #include <string>
 #include <fstream>
 #include <cstring>
+#include <cstdlib>
+#include <cctype>
+#include <sstream>
+#include <vector>
+#include <sys/time.h>
+#include <sys/resource.h>
 
 #include "driver.h"
+#include "server.h"
+#include "tinyvm.h"
+#include "tinyobj.h"
 
 #define PRINT_TINY
 //#define PRINT_TABLE
 //#define PRINT_NODES
 
-int main(int argc, char *argv[])
+#define OUTPUT_CACHE_MB 64 // default --cache-size
+
+// for -time, how long each phase took; one per compile, since the
+// server runs several at once
+struct PhaseTimes {
+	std::vector< std::pair< std::string, double> > phases;
+	double start;
+};
+
+static double now()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+static void endPhase(PhaseTimes &times, const char *name)
+{
+	double t = now();
+	times.phases.push_back(std::make_pair(std::string(name), t - times.start));
+	times.start = t;
+}
+
+static void printPhases(PhaseTimes &times, std::ostream &err)
+{
+	double total = 0;
+	for (int i=0; i<times.phases.size(); i++) {
+		err << "time " << times.phases[i].first << ": "
+			<< times.phases[i].second << " ms" << std::endl;
+		total += times.phases[i].second;
+	}
+	err << "time total: " << total << " ms" << std::endl;
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	err << "peak rss: " << usage.ru_maxrss << " KB" << std::endl;
+}
+
+// LITTLE source, or an IR file from -emit-ir
+static bool readProgram(little::Driver &driver, std::istream &is)
+{
+	if (little::Driver::isIR(is)) {
+		return driver.readIR(is);
+	}
+	return driver.parse_file(&is);
+}
+
+// one run of the compiler: the command line minus argv[0], with in
+// standing for stdin and out and err for stdout and stderr
+static int compile(std::vector< std::string> &args, std::istream &in,
+				   std::ostream &out, std::ostream &err)
 {
     little::Driver driver;
     bool result = false;
     bool livenessAnalysis = false;
+    bool run = false;
+    bool stats = false;
+    bool jit = false;
+    bool emitC = false;
+    bool emitIR = false;
+    bool object = false;
+    bool timing = false;
+    bool profileGen = false;
+    bool cacheStats = false;
+    bool stream = false;
+    bool funcCache = false;
+    std::string cacheDir;
+    long long cacheSize = OUTPUT_CACHE_MB;
     std::string filename;
+    PhaseTimes times;
+    driver.setStreams(out, err);
     
-    for (int i=1; i<argc; i++) {
-    	if (strcmp(argv[i],"-live") == 0) {
+    for (int i=0; i<args.size(); i++) {
+    	if (args[i] == "-live") {
     		driver.setLiveness(true);
+    	} else if (args[i] == "-inline") {
+    		driver.enablePass("inline");
+    	} else if (args[i] == "-tailcall") {
+    		driver.enablePass("tailcall");
+    	} else if (args[i] == "-ipa") {
+    		driver.enablePass("ipa");
+    		driver.enablePass("wholeprogram");
+    	} else if (args[i].size() == 3 && args[i].compare(0, 2, "-O") == 0 &&
+    			isdigit(args[i][2])) {
+    		driver.setOptLevel(args[i][2] - '0');
+    	} else if (args[i].compare(0, 8, "-passes=") == 0) {
+    		if (!driver.setPipeline(args[i].substr(8))) {
+    			return 1;
+    		}
+    	} else if (args[i].compare(0, 13, "-print-after=") == 0) {
+    		if (!driver.setPrintAfter(args[i].substr(13))) {
+    			return 1;
+    		}
+    	} else if (args[i] == "--run") {
+    		run = true;
+    	} else if (args[i] == "-stats") {
+    		stats = true;
+    	} else if (args[i] == "-jit") {
+    		jit = true;
+    	} else if (args[i] == "-emitc") {
+    		emitC = true;
+    	} else if (args[i] == "-emit-ir") {
+    		emitIR = true;
+    	} else if (args[i] == "-obj") {
+    		object = true;
+    	} else if (args[i] == "-time") {
+    		timing = true;
+    	} else if (args[i] == "-stream") {
+    		stream = true;
+    	} else if (args[i] == "-profile-gen" && i+1 < args.size()) {
+    		driver.setProfileGen(args[++i]);
+    		profileGen = true;
+    	} else if (args[i] == "-func-cache" && i+1 < args.size()) {
+    		if (!driver.setFunctionCache(args[++i])) {
+    			return 1;
+    		}
+    		funcCache = true;
+    	} else if (args[i] == "-j" && i+1 < args.size()) {
+    		driver.setThreads(atoi(args[++i].c_str()));
+    	} else if (args[i] == "--cache-dir" && i+1 < args.size()) {
+    		cacheDir = args[++i];
+    	} else if (args[i] == "--cache-size" && i+1 < args.size()) {
+    		cacheSize = atoll(args[++i].c_str());
+    	} else if (args[i] == "--cache-stats") {
+    		cacheStats = true;
+    	} else if (args[i] == "-profile-use" && i+1 < args.size()) {
+    		if (!driver.loadProfile(args[++i])) {
+    			return 1;
+    		}
+    		driver.enablePass("layout");
     	} else {
-    		filename = argv[i];
+    		filename = args[i];
     	}
     }
-	if (filename.empty() == false) {
+	if (profileGen && !run) {
+		err << "-profile-gen counts a --run" << std::endl;
+		return 1;
+	}
+	if (run && filename.empty()) {
+		err << "--run needs a source file, stdin is the program's"
+			<< std::endl;
+		return 1;
+	}
+	if (stream && (driver.hasModulePasses() || run || emitC || emitIR ||
+			object || profileGen || funcCache || !cacheDir.empty())) {
+		err << "-stream writes TINY one function at a time, so it can't be"
+			<< " used with whole program passes (-inline, -ipa, -O2), --run,"
+			<< " -emitc, -emit-ir, -obj or the caches" << std::endl;
+		return 1;
+	}
+	driver.setStreaming(stream);
+	if (!driver.setOutputCache(cacheDir, cacheSize*1024*1024)) {
+		return 1;
+	}
+	if (cacheStats) {
+		if (cacheDir.empty()) {
+			err << "--cache-stats needs a --cache-dir" << std::endl;
+			return 1;
+		}
+		driver.printOutputCacheStats(true);
+		return 0;
+	}
+	// a function the function cache has skips its IR, unless the output
+	// is made from the IR or whole program passes need every function's
+	driver.setSkipCachedIR(!emitC && !emitIR && !profileGen &&
+						   !driver.hasModulePasses());
+	times.start = now();
+	// C, IR and profiles come from the IR, so only TINY is cached
+	bool cached = false;
+	std::stringstream source; // stdin kept, for compiling again
+	if (cacheDir.empty() == false && !emitC && !emitIR && !profileGen) {
+		if (filename.empty() == false) {
+			std::ifstream is(filename.c_str());
+			source << is.rdbuf();
+		} else {
+			source << in.rdbuf();
+		}
+		cached = driver.readOutputCache(source.str());
+		result = cached || readProgram(driver, source);
+	}
+	else if (filename.empty() == false) {
 		std::ifstream is;
 		is.open(filename.c_str(), std::ios_base::in);
-		result = driver.parse_file(&is);
+		result = readProgram(driver, is);
+	}
+	else if (funcCache) {
+		source << in.rdbuf();
+		result = readProgram(driver, source);
 	}
     else {
-    	result = driver.parse_file();
+    	result = readProgram(driver, in);
     }
-    if (result == true)
+    endPhase(times, stream ? "stream" : "parse");
+    if (result == true && !cached && !stream)
     {
+    	driver.runPasses();
+    	endPhase(times, "passes");
+    	if (emitIR) {
+    		// -obj picks the binary form, as it does for TINY
+    		driver.printIR(object);
+    		endPhase(times, "emitir");
+    		if (timing) {
+    			printPhases(times, err);
+    			driver.printPassStats();
+    		}
+    		return 0;
+    	}
+    	if (emitC) {
+    		// the C compiler does its own register allocation
+    		driver.cGeneration();
+    		driver.printCCode();
+    		endPhase(times, "cgen");
+    		if (timing) {
+    			printPhases(times, err);
+    			driver.printPassStats();
+    		}
+    		return 0;
+    	}
+    	driver.lookupFunctionCache();
+    	endPhase(times, "cache");
     	driver.performLivenessAnalysis();
+    	endPhase(times, "liveness");
     	driver.tinyGeneration();
+    	endPhase(times, "codegen");
+    	if (driver.functionCacheStale()) {
+    		// a hit was written for a callee that has changed how it's
+    		// called; with its entry gone, the next try generates it
+    		if (!driver.removeStaleFunctions()) {
+    			return 1;
+    		}
+    		std::istringstream again(source.str());
+    		return compile(args, filename.empty() ? again : in, out, err);
+    	}
+    	driver.writeOutputCache();
+    }
+    if (result == true)
+    {
+    	if (timing) {
+    		printPhases(times, err);
+    		driver.printPassStats();
+    		driver.printFunctionCacheStats();
+    		driver.printOutputCacheStats(false);
+    	}
+    	
+    	if (run) {
+    		// stdin and stdout belong to the program's READs and WRITEs
+    		return driver.runTinyCode(in, out, stats, jit) ? 0 : 1;
+    	}
     	
     	/* Code for printing junk */
     	#ifdef PRINT_TABLE
@@ -45,6 +275,11 @@ int main(int argc, char *argv[])
     		driver.printNodeList(true);
     	#endif
     	
+    	if (object) {
+    		driver.printTinyObject();
+    		return 0;
+    	}
+    	
     	#ifdef PRINT_TINY
     		driver.printTinyCode();
     	#endif
@@ -52,9 +287,51 @@ int main(int argc, char *argv[])
     }
     else
     {
-    	std::cout << "Not accepted" << std::endl;
+    	out << "Not accepted" << std::endl;
     }
 
 	return 0;
 }
 
+// a --run that went through a server comes back as object code, and the
+// program runs here in the client
+static int runObject(const std::string &object,
+					 std::vector< std::string> &args, std::istream &in,
+					 std::ostream &out, std::ostream &err)
+{
+	std::istringstream is(object);
+	if (!little::TinyObject::isObject(is)) {
+		// the compile didn't get that far
+		out << object;
+		return 0;
+	}
+	bool stats = false;
+	bool jit = false;
+	for (int i=0; i<args.size(); i++) {
+		stats = stats || args[i] == "-stats";
+		jit = jit || args[i] == "-jit";
+	}
+	little::TinyVM vm(MAX_NUM_REGISTERS);
+	vm.setJIT(jit);
+	bool ok = vm.load(is) && vm.run(in, out);
+	if (!ok) {
+		err << vm.getError() << std::endl;
+	}
+	if (stats) {
+		vm.printStats(err);
+	}
+	return ok ? 0 : 1;
+}
+
+int main(int argc, char *argv[])
+{
+	std::vector< std::string> args(argv + 1, argv + argc);
+	if (argc == 3 && strcmp(argv[1],"--server") == 0) {
+		return little::runServer(argv[2], compile);
+	}
+	if (argc >= 3 && strcmp(argv[1],"--client") == 0) {
+		args.erase(args.begin(), args.begin() + 2);
+		return little::runClient(argv[2], args, compile, runObject);
+	}
+	return compile(args, std::cin, std::cout, std::cerr);
+}
@@ -3,21 +3,25 @@
 #include <fstream>
 #include <sstream>
 #include <cctype>
+#include <algorithm>
 
 #include "driver.h"
 #include "scanner.h"
+#include "tinyvm.h"
+#include "tinyobj.h"
 
-#define GLOBAL_SCOPE "0GLOBAL_SCOPE_RESERVED"
-#define TEMP_LABEL_PRE "lpTmpLbl"
-#define TEMP_VAR_PRE "lpTmpVar"
-#define TEMP_VAR_LEN 8
-#define MAX_NUM_REGISTERS 4
-#define STACK_OFFSET 6
+// params start just above the return address; caller-saved registers
+// are pushed before the return slot so they don't shift this
+#define STACK_OFFSET 2
 
 namespace little {
 
 Driver::Driver()
-    : debug_error(false), liveness(false)
+    : debug_error(false), streaming(false), outStream(&std::cout),
+      errStream(&std::cerr), liveness(false), profileMax(0),
+      functionCacheMisses(0), skipCachedIR(false), outputCacheMax(0),
+      outputCacheHit(false),
+      numThreads(0), streamStarted(false), tailCalls(false)
 {
 	scope = GLOBAL_SCOPE;
 	scopeVec.clear();
@@ -25,13 +29,24 @@ Driver::Driver()
 	treeStack.clear();
 	tempVarCount = 0;
 	tempLabelCount = 0;
+	inlineVarCount = 0;
 	mostRecentTempVar   = "!0!";
-	tinyStream.str("");
+	curNode.ifFlags = 0; // pushBackCurNode resets it after each node
+	tinyCode.clear();
 	returnExpr = false;
+	dontPush = false;
+	last_stmt = false;
+	skippingIR = false;
+	numParamsWorry = 0;
 	
 	functionMap.clear();
 	subNodeList.clear();
 	//liveNodeList.clear();
+	
+	// filled in once here, the codegen threads only read it
+	for (int i=0; i<numTinyPatterns; i++) {
+		tinyPatternIndex[tinyPatterns[i].op] = &tinyPatterns[i];
+	}
 }
 
 Driver::~Driver()
@@ -42,6 +57,11 @@ void Driver::setLiveness(bool l) {
 	liveness = l;
 }
 
+void Driver::setStreams(std::ostream &out, std::ostream &err) {
+	outStream = &out;
+	errStream = &err;
+}
+
 bool Driver::parse_file()
 {
     Scanner scanner(&std::cin);
@@ -60,6 +80,20 @@ bool Driver::parse_file()
 }
 
 bool Driver::parse_file(std::istream* is) {
+	// calls can come before the callee, so its type is read ahead
+	std::stringstream buffer;
+	std::streampos start = is->tellg();
+	if (start != std::streampos(-1)) {
+		findFunctionTypes(*is);
+		is->clear();
+		is->seekg(start);
+	} else {
+		buffer << is->rdbuf();
+		findFunctionTypes(buffer);
+		buffer.clear();
+		buffer.seekg(0);
+		is = &buffer;
+	}
 	Scanner scanner(is);
     this->lexer = &scanner;
 
@@ -176,7 +210,7 @@ void Driver::error(const class location& l,
 {
 	if (debug_error == true)
 	{
-    	std::cerr << l << ": " << m << std::endl;
+    	*errStream << l << ": " << m << std::endl;
 	}
 }
 
@@ -184,7 +218,7 @@ void Driver::error(const std::string& m)
 {
 	if (debug_error == true)
 	{
-    	std::cerr << m << std::endl;
+    	*errStream << m << std::endl;
 	}
 }
 
@@ -198,8 +232,7 @@ void Driver::pushBackCurNode()
 	{
 		adjustIROpCode(curNode);
 	}
-	nodeList.push_back(curNode);
-	subNodeList.push_back(curNode);
+	appendNode(curNode);
 	
 	curNode.opCode = "";
 	curNode.op1 = "";
@@ -209,28 +242,45 @@ void Driver::pushBackCurNode()
 	return;
 }
 
+void Driver::appendNode(IRNode &n)
+{
+	// a function the cache already has code for is parsed but keeps no IR
+	if (skippingIR) {
+		return;
+	}
+	nodeList.push_back(n);
+	subNodeList.push_back(n);
+}
+
 void Driver::printNodeList(bool commentOut)
+{
+	printNodes(std::cout, nodeList, commentOut);
+	return;
+}
+
+void Driver::printNodes(std::ostream &out, std::list< IRNode> &nodes,
+						bool commentOut)
 {
 	std::list< IRNode>::iterator nodeIt;
-	for (nodeIt = nodeList.begin(); nodeIt != nodeList.end(); nodeIt++)
+	for (nodeIt = nodes.begin(); nodeIt != nodes.end(); nodeIt++)
 	{
 		if (commentOut == true)
 		{
-			std::cout << "; ";
+			out << "; ";
 		}
 		if (nodeIt->opCode.empty() != true)
 		{
-			std::cout << nodeIt->opCode;
+			out << nodeIt->opCode;
 			if (nodeIt->op1.empty() != true)
 			{
-				std::cout << " " << nodeIt->op1;
+				out << " " << nodeIt->op1;
 			}
 			if (nodeIt->op2.empty() != true)
 			{
-				std::cout << " " << nodeIt->op2;
+				out << " " << nodeIt->op2;
 			}
 	
-			std::cout << " " << nodeIt->Result << std::endl;
+			out << " " << nodeIt->Result << std::endl;
 		}
 	}
 	return;
@@ -284,12 +334,12 @@ void Driver::interpretTree(std::vector< std::string> &theStack, std::string &las
 		{
 			IRNode newNode;
 			newNode.opCode = *it;
+			newNode.ifFlags = 0;
 			newNode.op1 = *(it-1);
 			newNode.op2 = *(it+1);
 			littleTypes tempType = adjustIROpCode(newNode);
 			newNode.Result = createTempVar(tempType);
-			nodeList.push_back(newNode);
-			subNodeList.push_back(newNode);
+			appendNode(newNode);
 			it = theStack.erase(it-1,it+2);
 			theStack.insert(it, mostRecentTempVar);
 		}
@@ -301,12 +351,12 @@ void Driver::interpretTree(std::vector< std::string> &theStack, std::string &las
 		{
 			IRNode newNode;
 			newNode.opCode = *it;
+			newNode.ifFlags = 0;
 			newNode.op1 = *(it-1);
 			newNode.op2 = *(it+1);
 			littleTypes tempType = adjustIROpCode(newNode);
 			newNode.Result = createTempVar(tempType);
-			nodeList.push_back(newNode);
-			subNodeList.push_back(newNode);
+			appendNode(newNode);
 			it = theStack.erase(it-1,it+2);
 			theStack.insert(it, mostRecentTempVar);
 		}
@@ -354,30 +404,38 @@ littleTypes Driver::adjustIROpCode(IRNode &node)
 
 littleTypes Driver::getType(IRNode &node)
 {
-	std::vector< VarStruct_s> varStructs = symbolTable[scopeVec.size()];
-	std::vector< VarStruct_s> globalStructs = symbolTable[0];
-	varStructs.insert(varStructs.end(), globalStructs.begin(), globalStructs.end()); // global vars
-	for (std::vector< VarStruct_s>::iterator it = varStructs.begin();
-			it != varStructs.end(); it++)
+	// the current scope, then the globals; looked up in place since the
+	// backend threads share the table
+	int scopes[2] = { (int)scopeVec.size(), 0 };
+	for (int s=0; s<2; s++)
 	{
-		if (it->identifier == node.Result ||
-			it->identifier == node.op1    ||
-			it->identifier == node.op2)
+		SymbolTable_t::iterator tIt = symbolTable.find(scopes[s]);
+		if (tIt == symbolTable.end())
 		{
-			// since we don't mix types, we're just
-			// going to return after we find what we're
-			// looking for
-			if (it->type == FLOAT)
-			{
-				return FLOAT;
-			}
-			else if (it->type == INT)
-			{
-				return INT;
-			}
-			else if (it->type == STRING)
+			continue;
+		}
+		for (std::vector< VarStruct_s>::iterator it = tIt->second.begin();
+				it != tIt->second.end(); it++)
+		{
+			if (it->identifier == node.Result ||
+				it->identifier == node.op1    ||
+				it->identifier == node.op2)
 			{
-				return STRING;
+				// since we don't mix types, we're just
+				// going to return after we find what we're
+				// looking for
+				if (it->type == FLOAT)
+				{
+					return FLOAT;
+				}
+				else if (it->type == INT)
+				{
+					return INT;
+				}
+				else if (it->type == STRING)
+				{
+					return STRING;
+				}
 			}
 		}
 	}
@@ -399,33 +457,158 @@ littleTypes Driver::getType(IRNode &node)
 	return INT;
 }
 
+void Driver::writeTinyCode(std::ostream &os, std::vector< TinyInst> &code)
+{
+	for (int i=0; i<code.size(); i++) {
+		os << code[i].op;
+		if (!code[i].a.empty()) os << " " << code[i].a;
+		if (!code[i].b.empty()) os << " " << code[i].b;
+		os << std::endl;
+	}
+}
+
+void Driver::readTinyCode(std::istream &is, std::vector< TinyInst> &code)
+{
+	// TINY text as writeTinyCode wrote it, from the caches
+	std::string text;
+	while (std::getline(is, text)) {
+		std::istringstream ls(text);
+		TinyInst inst;
+		if (!(ls >> inst.op)) {
+			continue;
+		}
+		if (inst.op == "sys" && ls >> inst.a) {
+			inst.op += " " + inst.a;
+			inst.a.clear();
+		}
+		if (inst.op == "str") {
+			// the quoted value can have spaces in it
+			ls >> inst.a >> std::ws;
+			std::getline(ls, inst.b);
+		} else {
+			ls >> inst.a >> inst.b;
+		}
+		code.push_back(inst);
+	}
+}
+
 void Driver::printTinyCode()
 {
-	std::cout << tinyStream.str();
+	writeTinyCode(*outStream, tinyCode);
+}
+
+void Driver::printTinyObject()
+{
+	// the same code in the binary format, tinyvm -dis turns it back
+	std::stringstream text;
+	writeTinyCode(text, tinyCode);
+	TinyObject obj;
+	obj.assemble(text);
+	obj.write(*outStream);
+}
+
+bool Driver::runTinyCode(std::istream &in, std::ostream &out, bool stats,
+						 bool jit)
+{
+	// the instructions go to the vm as they are, split up the way it
+	// would split their text; it has tiny's registers since the code is
+	// allocated for them either way
+	std::vector< std::vector< std::string> > program(tinyCode.size());
+	for (int i=0; i<tinyCode.size(); i++) {
+		TinyInst &inst = tinyCode[i];
+		std::vector< std::string> &tokens = program[i];
+		size_t space = inst.op.find(' ');
+		tokens.push_back(inst.op.substr(0, space));
+		if (space != std::string::npos) {
+			tokens.push_back(inst.op.substr(space + 1));
+		}
+		if (inst.op == "str" && inst.b.size() >= 2) {
+			tokens.push_back(inst.a);
+			tokens.push_back(TinyObject::unescape(
+					inst.b.substr(1, inst.b.size() - 2)));
+			continue;
+		}
+		if (!inst.a.empty()) tokens.push_back(inst.a);
+		if (!inst.b.empty()) tokens.push_back(inst.b);
+	}
+	TinyVM vm(MAX_NUM_REGISTERS);
+	// native code doesn't count anything, so a profile run interprets
+	vm.setJIT(jit && profileGen.empty());
+	bool ok = vm.load(program) && vm.run(in, out);
+	if (!ok) {
+		*errStream << vm.getError() << std::endl;
+	} else if (!profileGen.empty()) {
+		std::map< std::string, unsigned long long> counts;
+		vm.getLabelCounts(counts);
+		writeProfile(counts);
+	}
+	if (stats) {
+		vm.printStats(*errStream);
+	}
+	return ok;
 }
 
 void Driver::tinyGeneration()
 {
-	tinyStream.str("");
+	tinyCode.clear();
 	// generate variable declaration
 	tinyVariableDeclaration();
 	// initial push
-	tinyStream << "push" << std::endl;
-	tinyPushRegisters(GLOBAL_SCOPE);
-	tinyStream << "jsr main" << std::endl;
+	assignCallingConventions();
+	findCallSaveSets();
+	if (!checkFunctionCache()) {
+		return;
+	}
+	tinyCode.push_back(tinyInst("push"));
+	tinyCode.push_back(tinyInst("jsr", "main"));
 	//tinyPopRegisters(); // apparently not
-	tinyStream << "sys halt" << std::endl;
+	tinyCode.push_back(tinyInst("sys halt"));
 	
+	// functionMap rather than nodeList, since the IR passes rewrite
+	// functions in place; one function at a time, so the code cache can
+	// splice each one in or keep it and the rest can be generated apart
+	std::vector< std::string> order;
 	if (!liveness) {
-		tinyGenerateNormalCode(nodeList);
+		for (int i=0; i<fs.size(); i++) {
+			if (functionMap.count(fs[i].name) == 1) {
+				order.push_back(fs[i].name);
+			}
+		}
 	} else {
-		tinyGenerateNormalCode(liveNodeList);
+		std::map< std::string, std::list< IRNode> >::iterator fIt;
+		for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+			order.push_back(fIt->first);
+		}
+	}
+	backendOrder.clear();
+	for (int i=0; i<order.size(); i++) {
+		if (cachedTiny.count(order[i]) == 0) {
+			backendOrder.push_back(order[i]);
+		}
+	}
+	backendCode.assign(backendOrder.size(), std::vector< TinyInst>());
+	runParallel(backendOrder.size(), &Driver::codegenTask);
+	int next = 0;
+	for (int i=0; i<order.size(); i++) {
+		if (cachedTiny.count(order[i]) == 1) {
+			spliceFunctionCache(order[i]);
+			continue;
+		}
+		tinyCode.insert(tinyCode.end(), backendCode[next].begin(),
+						backendCode[next].end());
+		writeFunctionCache(order[i], backendCode[next]);
+		next++;
 	}
 	
-	tinyStream << "end" << std::endl;
+	tinyCode.push_back(tinyInst("end"));
 	return;
 }
 
+void Driver::codegenTask(int i) {
+	tinyGenerateNormalCode(functionMap.find(backendOrder[i])->second,
+						   backendCode[i]);
+}
+
 void Driver::tinyVariableDeclaration() // for globals only
 {
 	std::vector< VarStruct_s>::iterator varIt;
@@ -436,52 +619,34 @@ void Driver::tinyVariableDeclaration() // for globals only
 		{
 			if (varIt->type != STRING)
 			{
-				tinyStream << "var " << varIt->identifier << std::endl;
+				tinyCode.push_back(tinyInst("var", varIt->identifier));
 			}
 			else
 			{
-				tinyStream << "str " << varIt->identifier << " "
-						   << varIt->value << std::endl;
+				tinyCode.push_back(tinyInst("str", varIt->identifier,
+											varIt->value));
 			}
 		}
 	}
 	return;
 }
 
-void Driver::tinyPushRegisters(std::string scp)
+void Driver::tinyPushRegisters(std::vector< TinyInst> &out,
+							   std::vector< std::string> regs)
 {
-	/*// push locals
-	if (scp != GLOBAL_SCOPE)
-	{
-		// first check the local variables
-		int scpnm = -1;
-		for (int i=0; i<scopeVec.size(); i++) {
-			if (scopeVec[i] == scp) {
-				scpnm = i+1;
-				break;
-			}
-		}
-		if (scpnm != -1) {
-			std::vector< VarStruct_s>::iterator vIt;
-			for (vIt = symbolTable[scpnm].begin(); 
-						vIt != symbolTable[scpnm].end(); vIt++)
-			{
-				tinyStream << "push " << vIt->altName << std::endl;
-			}
-		}
-	}*/
-	for(int i=0; i<MAX_NUM_REGISTERS; i++)
+	for(int i=0; i<regs.size(); i++)
 	{
-		tinyStream << "push r" << i << std::endl;
+		out.push_back(tinyInst("push", regs[i]));
 	}
 	return;
 }
 
-void Driver::tinyPopRegisters(std::string scope)
+void Driver::tinyPopRegisters(std::vector< TinyInst> &out,
+							  std::vector< std::string> regs)
 {
-	for(int i=MAX_NUM_REGISTERS-1; i>=0; i--)
+	for(int i=regs.size()-1; i>=0; i--)
 	{
-		tinyStream << "pop r" << i << std::endl;
+		out.push_back(tinyInst("pop", regs[i]));
 	}
 	return;
 }
@@ -499,20 +664,21 @@ void Driver::renameVars(std::string &op1, std::string &op2,
 				break;
 			}
 		}
-		if (scpnm != -1) {
+		// find rather than [], the backend threads share the table
+		SymbolTable_t::iterator tIt = symbolTable.find(scpnm);
+		if (tIt != symbolTable.end()) {
 			std::vector< VarStruct_s>::iterator vIt;
-			for (vIt = symbolTable[scpnm].begin(); 
-						vIt != symbolTable[scpnm].end(); vIt++)
+			for (vIt = tIt->second.begin(); vIt != tIt->second.end(); vIt++)
 			{
 				if (op1 == vIt->identifier)
 				{
 					op1 = vIt->altName;
 				}
-				else if (op2 == vIt->identifier) 
+				if (op2 == vIt->identifier) 
 				{
 					op2 = vIt->altName;
 				}
-				else if (result == vIt->identifier) 
+				if (result == vIt->identifier) 
 				{
 					result = vIt->altName;
 				}
@@ -525,11 +691,11 @@ void Driver::renameVars(std::string &op1, std::string &op2,
 			{
 				op1 = f.params[i].altName;
 			}
-			else if (op2 == f.params[i].identifier) 
+			if (op2 == f.params[i].identifier) 
 			{
 				op2 = f.params[i].altName;
 			}
-			else if (result == f.params[i].identifier) 
+			if (result == f.params[i].identifier) 
 			{
 				result = f.params[i].altName;
 			}
@@ -540,21 +706,15 @@ void Driver::renameVars(std::string &op1, std::string &op2,
 
 void Driver::pushParams(std::vector< std::string> v)
 {
-	for (int i=0; i<v.size(); i++)
+	// the last argument goes deepest, so the first param ends up
+	// closest to the frame
+	for (int i=v.size()-1; i>=0; i--)
 	{
-		std::vector< VarStruct_s>::iterator it;
-		for (it = symbolTable[scopeVec.size()].begin();
-					it != symbolTable[scopeVec.size()].end(); it++)
-		{
-			if (v[i] == it->identifier) {
-				// push identifier
-				IRNode newNode;
-				newNode.opCode = "PUSH";
-				newNode.Result = it->identifier;
-				nodeList.push_back(newNode);
-				subNodeList.push_back(newNode);
-			}
-		}
+		IRNode newNode;
+		newNode.opCode = "PUSH";
+		newNode.ifFlags = 0;
+		newNode.Result = v[i];
+		appendNode(newNode);
 	}
 	return;
 }
@@ -563,360 +723,255 @@ void Driver::popParams(int s) {
 	for (int i=0; i<s; i++) {
 		IRNode newNode;
 		newNode.opCode = "POP";
-		nodeList.push_back(newNode);
-		subNodeList.push_back(newNode);
+		newNode.ifFlags = 0;
+		appendNode(newNode);
 	}
 }
 
-void Driver::tinyGenerateNormalCode(std::list< IRNode> theNodes)
+// what each IR op becomes in TINY; the types are already in the op names
+// but for the compares, which go by their operands. swapped is what does
+// the same with the operands the other way round, where there's one
+const Driver::TinyPatternInfo Driver::tinyPatterns[] = {
+	{"LABEL", TINY_PAT_LABEL, "label", NULL},
+	{"LINK", TINY_PAT_LINK, "link", NULL},
+	{"STORE", TINY_PAT_MOVE, "move", NULL},
+	{"STOREI", TINY_PAT_MOVE, "move", NULL},
+	{"STOREF", TINY_PAT_MOVE, "move", NULL},
+	{"ADDI", TINY_PAT_ARITH, "addi", "addi"},
+	{"ADDF", TINY_PAT_ARITH, "addr", "addr"},
+	{"SUBI", TINY_PAT_ARITH, "subi", NULL},
+	{"SUBF", TINY_PAT_ARITH, "subr", NULL},
+	{"MULTI", TINY_PAT_ARITH, "muli", "muli"},
+	{"MULTF", TINY_PAT_ARITH, "mulr", "mulr"},
+	{"DIVI", TINY_PAT_ARITH, "divi", NULL},
+	{"DIVF", TINY_PAT_ARITH, "divr", NULL},
+	{"GT", TINY_PAT_BRANCH, "jgt", "jlt"},
+	{"LT", TINY_PAT_BRANCH, "jlt", "jgt"},
+	{"GE", TINY_PAT_BRANCH, "jge", "jle"},
+	{"LE", TINY_PAT_BRANCH, "jle", "jge"},
+	{"EQ", TINY_PAT_BRANCH, "jeq", "jeq"},
+	{"NE", TINY_PAT_BRANCH, "jne", "jne"},
+	{"JUMP", TINY_PAT_JUMP, "jmp", NULL},
+	{"READI", TINY_PAT_SYS, "sys readi", NULL},
+	{"READF", TINY_PAT_SYS, "sys readr", NULL},
+	{"WRITEI", TINY_PAT_SYS, "sys writei", NULL},
+	{"WRITEF", TINY_PAT_SYS, "sys writer", NULL},
+	{"WRITE", TINY_PAT_SYS, "sys writes", NULL},
+	{"RETURN", TINY_PAT_RETURN, "ret", NULL},
+	{"JSR", TINY_PAT_JSR, "jsr", NULL},
+	{"PUSH", TINY_PAT_PUSH, "push", NULL},
+	{"POP", TINY_PAT_POP, "pop", NULL}
+};
+const int Driver::numTinyPatterns =
+		sizeof(tinyPatterns) / sizeof(tinyPatterns[0]);
+
+void Driver::tinyGenerateNormalCode(std::list< IRNode> theNodes,
+									std::vector< TinyInst> &out)
 {
 	std::list< IRNode>::iterator nodeIt;
-	bool startFunction = true;
 	std::string cs = GLOBAL_SCOPE;
 	funcStruct_s theFunc;
+	theFunc.numRegParams = 0;
 	int numRets = 0;
+	int numCalls = 0;
+	std::vector< std::string> callSaves;
+	funcStruct_s callee;
+	int numArgs = 0;
+	int argNum = 0;
+	int stackArgs = 0;
+	std::map< int, std::string> argMoves; // register param -> argument
+	bool tailCall = false;
 
 	for (nodeIt=theNodes.begin(); nodeIt!=theNodes.end(); nodeIt++)
 	{
-		//tinyStream << nodeIt->opCode << " " << nodeIt->op1 << " " << nodeIt->op2 << " " << nodeIt->Result << std::endl;
+		//out << nodeIt->opCode << " " << nodeIt->op1 << " " << nodeIt->op2 << " " << nodeIt->Result << std::endl;
 		
 		std::string op1 = nodeIt->op1;
 		std::string op2 = nodeIt->op2;
 		std::string result = nodeIt->Result;
 		renameVars(op1, op2, result, cs, theFunc);
 		// find a temp var that is not any of those
-		std::string theTemp = "r0";
-		int tempNum = 0;
-		bool tempFound = false;
-		while (tempFound == false) {
-			if (theTemp == op1 || theTemp == op2 || theTemp == result) {
-				tempNum++;
-				std::stringstream tstr;
-				tstr << "r" << tempNum;
-				theTemp = tstr.str();
-			}
-			else {
-				tempFound = true;
-			}
+		std::string theTemp = getScratchRegister(op1, op2, result, theFunc);
+		// without -live it's kept out of the pool, so nothing is in it
+		std::vector< std::string> scratch;
+		if (liveness) {
+			scratch.push_back(theTemp);
 		}
 		
-		if (nodeIt->opCode == "LABEL")
-		{
-			tinyStream << "label " << result << std::endl;
-
-			if (startFunction == true) {
-				startFunction = false;
+		std::map< std::string, const TinyPatternInfo*>::iterator pIt =
+				tinyPatternIndex.find(nodeIt->opCode);
+		if (pIt == tinyPatternIndex.end()) {
+			continue;
+		}
+		const TinyPatternInfo &p = *pIt->second;
+		
+		switch (p.pattern) {
+		case TINY_PAT_LABEL:
+			out.push_back(tinyInst("label", result));
+			// IR passes can leave returns anywhere, so a function
+			// starts at its own label rather than after the last return
+			if (functionMap.count(nodeIt->Result) == 1) {
 				cs = result;
 				findFuncData(result, theFunc);
+				numCalls = 0;
+				numRets = 0;
 			}
-		}
-		else if (nodeIt->opCode.find("STORE") != std::string::npos)
-		{
-			if (!liveness) {
-				tinyStream << "push " << theTemp << std::endl;
-				tinyStream << "move " << op1 << " " << theTemp
-						   << std::endl;
-				tinyStream << "move " << theTemp << " "
-						   << result << std::endl;
-				tinyStream << "pop " << theTemp << std::endl;
-			} // else if neither are registers
-			else if ((op1.size() != 2 || op1[0] != 'r' ||
-						!isdigit(op1[1]))
-						&& (result.size() != 2 || result[0] != 'r' ||
-						!isdigit(result[1]))) {
-				tinyStream << "push " << theTemp << std::endl;
-				tinyStream << "move " << op1 << " " << theTemp
-						   << std::endl;
-				tinyStream << "move " << theTemp << " "
-						   << result << std::endl;
-				tinyStream << "pop " << theTemp << std::endl;
-			} else {
-				tinyStream << "move " << op1 << " "
-				           << result << std::endl;
+			break;
+		case TINY_PAT_MOVE:
+			selectTinyMove(out, op1, result, theTemp, scratch);
+			break;
+		case TINY_PAT_ARITH:
+			selectTinyArith(out, p, op1, op2, result, theTemp, scratch);
+			break;
+		case TINY_PAT_BRANCH:
+			selectTinyBranch(out, p, op1, op2, result,
+							 getType(*nodeIt) == FLOAT, theTemp);
+			break;
+		case TINY_PAT_JUMP:
+		case TINY_PAT_SYS:
+			out.push_back(tinyInst(p.mnemonic, result));
+			break;
+		case TINY_PAT_RETURN:
+			if (tailCall) {
+				// the callee already returned straight to our caller
+				tailCall = false;
+				numRets++;
+				break;
 			}
-		}
-		else if (nodeIt->opCode.find("ADD") != std::string::npos)
-		{
-			if (result.size() != 2 || result[0] != 'r' ||
-										 !isdigit(result[1])) {
-				tinyStream << "push " << theTemp << std::endl;
-				tinyStream << "move " << op1 
-						   << " " << theTemp << std::endl;
-				if (nodeIt->opCode == "ADDI")
-				{
-					tinyStream << "addi ";
-				}
-				else
-				{
-					tinyStream << "addr ";
-				}
-				tinyStream << op2 << " " << theTemp << std::endl;
-				tinyStream << "move " << theTemp 
-						   << " " << result << std::endl;
-				tinyStream << "pop " << theTemp << std::endl;
-			} else {
-				// move the first op to the temp register
-				tinyStream << "move " << op1 << " "
-						   << result << std::endl;
-				// add the second op to the first op and store
-				// in the temp register
-				if (nodeIt->opCode == "ADDI")
-				{
-					tinyStream << "addi ";
+			{
+				// move return value to position
+				std::string id = theFunc.retVals[numRets];
+				std::string dstr1; //dummy str
+				std::string dstr2; //dummy str
+				std::string theName = id;
+				if (theFunc.type != VOID && id != "") {
+					renameVars(dstr1, dstr2, theName, cs, theFunc);
 				}
-				else
-				{
-					tinyStream << "addr ";
+				if (theFunc.type != VOID && id != "" &&
+						!theFunc.retReg.empty()) {
+					if (theName != theFunc.retReg) {
+						out.push_back(tinyInst("move", theName,
+											   theFunc.retReg));
+					}
+				} else if (theFunc.type != VOID && id != "") {
+					selectTinyMove(out, theName, theFunc.retLoc, theTemp,
+								   scratch);
 				}
-				tinyStream << op2 << " " << result << std::endl;
 			}
-		}
-		else if (nodeIt->opCode.find("SUB") != std::string::npos)
-		{
-			if (result.size() != 2 || result[0] != 'r' ||
-										 !isdigit(result[1])) {
-				tinyStream << "push " << theTemp << std::endl;
-				tinyStream << "move " << op1 
-						   << " " << theTemp << std::endl;
-				if (nodeIt->opCode == "ADDI")
-				{
-					tinyStream << "subi ";
+			out.push_back(tinyInst("unlnk"));
+			out.push_back(tinyInst("ret"));
+			numRets++;
+			break;
+		case TINY_PAT_JSR: {
+			// load the register arguments, staging them through the
+			// stack if one would overwrite another's source
+			bool overlap = false;
+			std::map< int, std::string>::iterator mIt;
+			for (mIt = argMoves.begin(); mIt != argMoves.end(); mIt++) {
+				for (int i=0; i<callee.numRegParams; i++) {
+					if (i != mIt->first &&
+							mIt->second == callee.params[i].altName) {
+						overlap = true;
+					}
 				}
-				else
-				{
-					tinyStream << "subr ";
+			}
+			std::map< int, std::string>::reverse_iterator rIt;
+			for (mIt = argMoves.begin(); mIt != argMoves.end(); mIt++) {
+				std::string reg = callee.params[mIt->first].altName;
+				if (overlap) {
+					out.push_back(tinyInst("push", mIt->second));
+				} else if (mIt->second != reg) {
+					out.push_back(tinyInst("move", mIt->second, reg));
 				}
-				tinyStream << op2 << " " << theTemp << std::endl;
-				tinyStream << "move " << theTemp 
-						   << " " << result << std::endl;
-				tinyStream << "pop " << theTemp << std::endl;
+			}
+			for (rIt = argMoves.rbegin(); overlap && rIt != argMoves.rend();
+						rIt++) {
+				out.push_back(tinyInst("pop",
+									   callee.params[rIt->first].altName));
+			}
+			argMoves.clear();
+			if (tailCall) {
+				// reuse our frame, the callee returns to our caller
+				out.push_back(tinyInst("unlnk"));
+				out.push_back(tinyInst("jmp", result));
 			} else {
-				// move the first op to the temp register
-				tinyStream << "move " << op1 << " "
-						   << result << std::endl;
-				// add the second op to the first op and store
-				// in the temp register
-				if (nodeIt->opCode == "SUBI")
-				{
-					tinyStream << "subi ";
-				}
-				else
-				{
-					tinyStream << "subr ";
-				}
-				tinyStream << op2 << " " << result << std::endl;
+				out.push_back(tinyInst(p.mnemonic, result));
 			}
+			break;
 		}
-		else if (nodeIt->opCode.find("DIV") != std::string::npos)
-		{
-			if (result.size() != 2 || result[0] != 'r' ||
-										 !isdigit(result[1])) {
-				tinyStream << "push " << theTemp << std::endl;
-				tinyStream << "move " << op1 
-						   << " " << theTemp << std::endl;
-				if (nodeIt->opCode == "ADDI")
-				{
-					tinyStream << "divi ";
-				}
-				else
-				{
-					tinyStream << "divr ";
+		case TINY_PAT_PUSH:
+			if (nodeIt->Result.empty()) {
+				// return slot starts a call, find out how it's called
+				std::list< IRNode>::iterator cIt = nodeIt;
+				numArgs = 0;
+				for (cIt++; cIt != theNodes.end() && cIt->opCode != "JSR";
+						cIt++) {
+					if (cIt->opCode == "PUSH") {
+						numArgs++;
+					}
 				}
-				tinyStream << op2 << " " << theTemp << std::endl;
-				tinyStream << "move " << theTemp 
-						   << " " << result << std::endl;
-				tinyStream << "pop " << theTemp << std::endl;
-			} else {
-				// move the first op to the temp register
-				tinyStream << "move " << op1 << " "
-						   << result << std::endl;
-				// add the second op to the first op and store
-				// in the temp register
-				if (nodeIt->opCode == "DIVI")
-				{
-					tinyStream << "divi ";
+				callee = funcStruct_s();
+				callee.numRegParams = 0;
+				if (cIt != theNodes.end()) {
+					findFuncData(cIt->Result, callee);
 				}
-				else
-				{
-					tinyStream << "divr ";
-				}
-				tinyStream << op2 << " " << result << std::endl;
-			}
-		}
-		else if (nodeIt->opCode.find("MULT") != std::string::npos)
-		{
-			if (result.size() != 2 || result[0] != 'r' ||
-										 !isdigit(result[1])) {
-				tinyStream << "push " << theTemp << std::endl;
-				tinyStream << "move " << op1 
-						   << " " << theTemp << std::endl;
-				if (nodeIt->opCode == "ADDI")
-				{
-					tinyStream << "muli ";
+				argNum = 0;
+				stackArgs = numArgs - callee.numRegParams;
+				tailCall = tailCalls && isTailCall(nodeIt, theNodes.end(),
+												   theFunc, callee, numRets);
+				
+				callSaves.clear();
+				std::map< std::string, std::vector< std::vector< std::string> > >
+						::iterator sIt = callSaveSets.find(cs);
+				if (sIt != callSaveSets.end() &&
+						numCalls < sIt->second.size()) {
+					callSaves = sIt->second[numCalls];
 				}
-				else
-				{
-					tinyStream << "mulr ";
+				tailCall = tailCall && callSaves.empty();
+				tinyPushRegisters(out, callSaves);
+				if (callee.retReg.empty()) {
+					out.push_back(tinyInst("push"));
 				}
-				tinyStream << op2 << " " << theTemp << std::endl;
-				tinyStream << "move " << theTemp 
-						   << " " << result << std::endl;
-				tinyStream << "pop " << theTemp << std::endl;
 			} else {
-				// move the first op to the temp register
-				tinyStream << "move " << op1 << " "
-						   << result << std::endl;
-				// add the second op to the first op and store
-				// in the temp register
-				if (nodeIt->opCode == "MULTI")
-				{
-					tinyStream << "muli ";
-				}
-				else
-				{
-					tinyStream << "mulr ";
+				// arguments are pushed last to first
+				int param = numArgs - 1 - argNum;
+				argNum++;
+				if (param < callee.numRegParams) {
+					argMoves[param] = result;
+				} else {
+					out.push_back(tinyInst("push", result));
 				}
-				tinyStream << op2 << " " << result << std::endl;
-			}
-		}
-		else if (nodeIt->opCode == "GE")
-		{
-			if (nodeIt->op2.find(TEMP_VAR_PRE) == std::string::npos)
-			{
-				tinyStream << "move " << op2 << " "
-						   << theTemp << std::endl;
-				op2 = theTemp;
-			}
-			if (getType(*nodeIt) == FLOAT)
-			{
-				tinyStream << "cmpr ";
-			}
-			else
-			{
-				tinyStream << "cmpi ";
-			}
-			tinyStream << op1 << " " << op2 << std::endl;
-			tinyStream << "jge " << result << std::endl;
-		}
-		else if (nodeIt->opCode == "LE")
-		{
-			if (nodeIt->op2.find(TEMP_VAR_PRE) == std::string::npos)
-			{
-				tinyStream << "move " << op2 << " "
-						   << theTemp << std::endl;
-				op2 = theTemp;
-			}
-			if (getType(*nodeIt) == FLOAT)
-			{
-				tinyStream << "cmpr ";
 			}
-			else
-			{
-				tinyStream << "cmpi ";
-			}
-			tinyStream << op1 << " " << op2 << std::endl;
-			tinyStream << "jle " << result << std::endl;
-		}
-		else if (nodeIt->opCode == "NE")
-		{
-			if (nodeIt->op2.find(TEMP_VAR_PRE) == std::string::npos)
-			{
-				tinyStream << "move " << op2 << " "
-						   << theTemp << std::endl;
-				op2 = theTemp;
-			}
-			if (getType(*nodeIt) == FLOAT)
-			{
-				tinyStream << "cmpr ";
-			}
-			else
-			{
-				tinyStream << "cmpi ";
-			}
-			tinyStream << op1 << " " << op2 << std::endl;
-			tinyStream << "jne " << result << std::endl;
-		}
-		else if (nodeIt->opCode == "JUMP")
-		{
-			tinyStream << "jmp " << result << std::endl;
-		}
-		else if (nodeIt->opCode.find("WRITE") != std::string::npos)
-		{
-			if (nodeIt->opCode == "WRITEI")
-			{
-				tinyStream << "sys writei ";
-			}
-			else if (nodeIt->opCode == "WRITEF")
-			{
-				tinyStream << "sys writer ";
-			}
-			else {
-				tinyStream << "sys writes ";
-			}
-			tinyStream << result << std::endl;
-		}
-		else if (nodeIt->opCode.find("READ") != std::string::npos)
-		{
-			if (nodeIt->opCode == "READI")
-			{
-				tinyStream << "sys readi ";
-			}
-			else
-			{
-				tinyStream << "sys readr ";
-			}
-			tinyStream << result << std::endl;
-		}
-		else if (nodeIt->opCode == "RETURN")
-		{
-			// move return value to position
-			std::string id = theFunc.retVals[numRets];
-			if (theFunc.type != VOID && id != "") 
-			{
-				if (isdigit(id[0]) == true || id[0] == '.') { // literal
-					tinyStream << "move " << id << " "
-							   << theFunc.retLoc << std::endl;
-				}
-				else { // variable
-					std::string dstr1; //dummy str
-					std::string dstr2; //dummy str
-					std::string theName = id;
-					renameVars(dstr1, dstr2, theName, cs, theFunc);
-					// only one can be stack var/mem id and we know
-					// that retLoc is a stack var
-					tinyStream << "push " << theTemp << std::endl;
-					tinyStream << "move " << theName << " "
-							   << theTemp  << std::endl;
-					tinyStream << "move " << theTemp << " "
-							   << theFunc.retLoc << std::endl;
-					tinyStream << "pop " << theTemp << std::endl;
+			break;
+		case TINY_PAT_POP:
+			if (nodeIt->Result.empty()) {
+				if (stackArgs > 0) {
+					out.push_back(tinyInst("pop"));
+					stackArgs--;
 				}
+				break;
 			}
-			tinyStream << "unlnk" << std::endl;
-			tinyStream << "ret" << std::endl;
-			if (numRets == theFunc.retVals.size()-1) {
-				startFunction = true;
-				numRets = 0;
-			}
-			else {
-				numRets++;
+			// return value ends a call
+			if (tailCall) {
+				// never comes back here
+			} else if (callee.retReg.empty()) {
+				out.push_back(tinyInst("pop", result));
+			} else if (callee.retReg != result) {
+				out.push_back(tinyInst("move", callee.retReg, result));
 			}
+			tinyPopRegisters(out, callSaves);
+			callSaves.clear();
+			numCalls++;
+			break;
+		case TINY_PAT_LINK: {
+			// temps only get stack slots when they're spilled
+			int numLocals = liveness ? getNumLocalsAndTemps(cs)
+						: getNumLocals(cs) + getNumSpilledTemps(cs);
+			std::stringstream tstr;
+			tstr << numLocals;
+			out.push_back(tinyInst("link", tstr.str()));
+			break;
 		}
-		else if (nodeIt->opCode == "JSR") {
-			tinyPushRegisters(cs);
-			tinyStream << "jsr " << result << std::endl;
-			tinyPopRegisters(cs);
-		}
-		else if (nodeIt->opCode == "PUSH") {
-			tinyStream << "push " << result << std::endl;
-		}
-		else if (nodeIt->opCode == "POP") {
-			tinyStream << "pop " << result << std::endl;
-		}
-		else if (nodeIt->opCode == "LINK") {
-			int numLocals = getNumLocals(cs);
-			tinyStream << "link " << numLocals << std::endl;
-
 		}
 	}
 }
@@ -962,9 +1017,80 @@ int Driver::getNumLocals(std::string scope) {
 	return num;
 }
 
+void Driver::findFunctionTypes(std::istream &is) {
+	// just the FUNCTION type name headers, skipping comments, and the
+	// tokens of each function, so a cache key doesn't see the layout
+	functionTypes.clear();
+	functionSources.clear();
+	sharedSource.clear();
+	std::string words[3]; // the last three tokens
+	std::string current; // the function the tokens are in
+	bool header = false;
+	char c;
+	while (is.get(c)) {
+		std::string token(1, c);
+		if (c == '-' && is.peek() == '-') {
+			std::getline(is, token);
+			continue;
+		} else if (c == '"') {
+			while (is.get(c) && c != '\n') {
+				token += c;
+				if (c == '"') {
+					break;
+				}
+			}
+		} else if (isalpha((unsigned char)c)) {
+			while (isalnum(is.peek())) {
+				token += (char)is.get();
+			}
+		} else if (isdigit((unsigned char)c) || c == '.') {
+			while (isdigit(is.peek()) || is.peek() == '.') {
+				token += (char)is.get();
+			}
+		} else if (isspace((unsigned char)c)) {
+			continue;
+		}
+		words[0] = words[1];
+		words[1] = words[2];
+		words[2] = token;
+		if (token == "FUNCTION") {
+			current.clear();
+			header = true;
+		}
+		if (words[0] == "FUNCTION") {
+			functionTypes[token] = words[1] == "INT" ? INT :
+								   words[1] == "FLOAT" ? FLOAT : VOID;
+			current = token;
+			functionSources[current] = words[0] + " " + words[1] + " ";
+		}
+		// every function's code depends on the globals and on the headers
+		// of the functions it calls
+		if (current.empty() || header) {
+			sharedSource += token + " ";
+		}
+		if (!current.empty()) {
+			functionSources[current] += token + " ";
+		}
+		if (token == "BEGIN") {
+			header = false;
+		}
+	}
+	return;
+}
+
+littleTypes Driver::getCallType(std::string callee) {
+	if (functionTypes.count(callee) == 1 && functionTypes[callee] != VOID) {
+		return functionTypes[callee];
+	}
+	// a VOID or undeclared function has no value, any type will do
+	return FLOAT;
+}
+
 void Driver::createFunction(std::string name) {
 	funcStruct_s newfunc;
 	newfunc.name = name;
+	newfunc.numRegParams = 0;
+	newfunc.pure = false;
 	fs.push_back(newfunc);
 	return;
 }
@@ -973,7 +1099,7 @@ void Driver::addParamToFunc(std::string name, littleTypes type) {
 	theVar.identifier = name;
 	theVar.type = type;
 	std::stringstream tstr;
-	tstr << "$" << (6+fs[fs.size()-1].params.size());
+	tstr << "$" << (STACK_OFFSET+fs[fs.size()-1].params.size());
 	theVar.altName = tstr.str();
 	fs[fs.size()-1].params.push_back(theVar);
 	return;
@@ -982,7 +1108,7 @@ void Driver::addParamToFunc(std::string name, littleTypes type) {
 void Driver::addReturnToFunc(littleTypes type) {
 	fs[fs.size()-1].type = type;
 	std::stringstream tstr;
-	tstr << "$" << (6+fs[fs.size()-1].params.size());
+	tstr << "$" << (STACK_OFFSET+fs[fs.size()-1].params.size());
 	fs[fs.size()-1].retLoc = tstr.str();
 	return;
 }
@@ -997,6 +1123,45 @@ void Driver::findFuncData(std::string s, funcStruct_s &f) {
 	return;
 }
 
+int Driver::getScopeNumber(std::string scp) {
+	for (int i=0; i<scopeVec.size(); i++) {
+		if (scopeVec[i] == scp) {
+			return i+1;
+		}
+	}
+	return -1;
+}
+
+std::string Driver::createScopedVar(std::string scp, littleTypes type,
+									bool isTemp) {
+	// like insertSymbolTableEntry, but for a scope that's already closed
+	VarStruct_s newData;
+	newData.type = type;
+	newData.registerOnly = false;
+	std::stringstream tstr;
+	std::stringstream astr;
+	if (isTemp) {
+		tstr << TEMP_VAR_PRE << tempVarCount;
+		tempVarCount++;
+		astr << "r" << tstr.str().substr(TEMP_VAR_LEN);
+	} else {
+		tstr << INLINE_VAR_PRE << inlineVarCount;
+		inlineVarCount++;
+		astr << "$-" << getNumLocals(scp)+1;
+	}
+	newData.identifier = tstr.str();
+	newData.altName = astr.str();
+	symbolTable[getScopeNumber(scp)].push_back(newData);
+	return newData.identifier;
+}
+
+std::string Driver::createScopedLabel() {
+	std::stringstream tstream;
+	tstream << TEMP_LABEL_PRE << tempLabelCount;
+	tempLabelCount++;
+	return tstream.str();
+}
+
 void Driver::overwriteFuncData(funcStruct_s &f) {
 	for (int i=0; i<fs.size(); i++) {
 		if (fs[i].name == f.name) {
@@ -1015,92 +1180,103 @@ void Driver::addRetVal(std::string id) {
 void Driver::popRetVal() {
 	IRNode newNode;
 	newNode.opCode = "POP";
+	newNode.ifFlags = 0;
 	newNode.Result = fs[fs.size()-1].assVar;
 	if (newNode.Result == "") { // no assVar? fuck.
-		std::cerr << "no ass var" << std::endl;
+		*errStream << "no ass var" << std::endl;
 	}
-	nodeList.push_back(newNode);
-	subNodeList.push_back(newNode);
+	appendNode(newNode);
 	return;
 }
 
 void Driver::performLivenessAnalysis() {
 	if (liveness == false) {
+		// the temps still need registers
+		std::map< std::string, std::list< IRNode> >::iterator it;
+		for (it = functionMap.begin(); it != functionMap.end(); it++) {
+			if (cachedTiny.count(it->first) == 0) {
+				allocateTempRegisters(it->first, it->second);
+			}
+		}
 		return;
 	}
 	
+	// the symbol table is written before the tasks start and fs after
+	// they're done, so each function only touches its own nodes
+	backendOrder.clear();
+	backendFuncs.clear();
 	std::map< std::string, std::list< IRNode> >::iterator it;
 	for (it = functionMap.begin(); it != functionMap.end(); it++) {
-		functionalLiveness(it->second);
-		liveNodeList.insert(liveNodeList.end(), it->second.begin(), it->second.end());
+		if (cachedTiny.count(it->first) == 1) {
+			continue;
+		}
+		funcStruct_s f;
+		findFuncData(it->second.front().Result, f);
+		modifyTempVarAltNames(f);
+		backendOrder.push_back(it->first);
+		backendFuncs.push_back(f);
+	}
+	runParallel(backendOrder.size(), &Driver::livenessTask);
+	for (int i=0; i<backendOrder.size(); i++) {
+		std::list< IRNode> &nodes = functionMap[backendOrder[i]];
+		overwriteFuncData(backendFuncs[i]);
+		liveNodeList.insert(liveNodeList.end(), nodes.begin(), nodes.end());
 	}
 	
 	return;
 }
 
-void Driver::functionalLiveness(std::list< IRNode> &nodes) {
-	// get func data so we can get parameters
-	funcStruct_s f;
-	findFuncData(nodes.front().Result, f);
-	modifyTempVarAltNames(f);
-	
-	std::vector< std::vector< std::string> > liveVec;
-	std::vector< std::string> live;
+void Driver::livenessTask(int i) {
+	functionalLiveness(functionMap.find(backendOrder[i])->second,
+					   backendFuncs[i]);
+}
+
+void Driver::functionalLiveness(std::list< IRNode> &nodes, funcStruct_s &f) {
+	if (nodes.empty()) {
+		return;
+	}
+	std::map< std::string, long long> weights;
+	findVarWeights(f.name, nodes, weights);
 	
-	nodes.reverse();
-	std::list< IRNode>::iterator it;
+	std::vector< IRNode> code(nodes.begin(), nodes.end());
+	int size = code.size();
+	std::vector< std::vector< std::string> > gen(size);
+	std::vector< std::vector< std::string> > kill(size);
+	// backwards, so each RETURN finds its own retVal
 	int returnNumber = f.retVals.size()-1;
-	std::stack< std::vector< std::string> > liveVecStack;
-	std::stack< bool > elseStack;
+	for (int i=size-1; i>=0; i--) {
+		gen[i] = findGenSet(code[i], code.front().Result, returnNumber);
+		kill[i] = findKillSet(code[i]);
+	}
 	
-	for (it=nodes.begin(); it!=nodes.end(); it++) {
-		std::vector< std::string> gen;
-		std::vector< std::string> kill;
-		
-		gen = findGenSet(*it, nodes.back().Result, returnNumber);
-		kill = findKillSet(*it);
-		
-		updateUseSet(gen, kill, live);
-		
-		
-		if (it->ifFlags == 1) { // IF
-			// merge the current live set and original
-			
-			if (elseStack.top()) {
-				// merge the if and else
-				std::vector< std::string> elsePart;
-				elsePart = liveVecStack.top();
-				liveVecStack.pop();
-				
-				live.insert(live.end(), elsePart.begin(), elsePart.end());
-				
+	// loops come back round through their labels, so go until it settles
+	std::vector< std::vector< int> > succ;
+	findSuccessors(code, succ);
+	std::vector< std::set< std::string> > liveIn(size);
+	std::vector< std::set< std::string> > liveOut(size);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int i=size-1; i>=0; i--) {
+			std::set< std::string> out;
+			for (int j=0; j<succ[i].size(); j++) {
+				out.insert(liveIn[succ[i][j]].begin(),
+						   liveIn[succ[i][j]].end());
+			}
+			std::set< std::string> in = out;
+			for (int j=0; j<kill[i].size(); j++) {
+				in.erase(kill[i][j]);
+			}
+			in.insert(gen[i].begin(), gen[i].end());
+			if (in != liveIn[i] || out != liveOut[i]) {
+				liveIn[i] = in;
+				liveOut[i] = out;
+				changed = true;
 			}
-			
-			liveVecStack.pop(); // pop original value
-			elseStack.pop();
-		} else if (it->ifFlags == 2) { // ELSE
-			// push back "current" live set
-			std::vector< std::string> liveTemp = live;
-			live = liveVecStack.top();
-			liveVecStack.push(liveTemp);
-			elseStack.push(true);
-		} else if (it->ifFlags == 3) { // ENDIF
-			// push back current live set
-			liveVecStack.push(live);
-			elseStack.push(false);
 		}
-		
-		liveVec.push_back(live);
 	}
 	
-	liveVec.erase(liveVec.end());
-	liveVec.insert(liveVec.begin(),live);
-	
-	nodes.reverse();
-	registerAllocation(liveVec, nodes, f);
-	overwriteFuncData(f);
-	
-	//printLiveSet(nodes, liveVec);
+	registerAllocation(liveOut, gen, nodes, f, weights);
 	
 	return;
 }
@@ -1128,86 +1304,189 @@ void Driver::modifyTempVarAltNames(funcStruct_s f) {
 	return;
 }
 
-void Driver::registerAllocation(std::vector< std::vector< std::string> > &live, std::list< IRNode> &nodes, funcStruct_s &f) {
-	std::vector< std::vector< std::string> >::reverse_iterator it;
+void Driver::findSuccessors(std::vector< IRNode> &nodes,
+							std::vector< std::vector< int> > &succ) {
+	// where control can go after each node
+	int size = nodes.size();
+	std::map< std::string, int> labels;
+	for (int i=0; i<size; i++) {
+		if (nodes[i].opCode == "LABEL") {
+			labels[nodes[i].Result] = i;
+		}
+	}
+	succ.assign(size, std::vector< int>());
+	for (int i=0; i<size; i++) {
+		std::string op = nodes[i].opCode;
+		if (op == "RETURN") {
+			continue;
+		}
+		if (op == "JUMP" || isBranch(op)) {
+			if (labels.count(nodes[i].Result) == 1) {
+				succ[i].push_back(labels[nodes[i].Result]);
+			}
+		}
+		if (op != "JUMP" && i+1 < size) {
+			succ[i].push_back(i+1);
+		}
+	}
+	return;
+}
+
+void Driver::storeDirtyRegisters(std::list< IRNode> &nodes,
+								 std::list< IRNode>::iterator at,
+								 std::map< std::string, std::string> &regMap,
+								 std::set< std::string> &dirty,
+								 std::set< std::string> &live) {
+	// write back, before at, what's changed and is still needed
+	std::map< std::string, std::string>::iterator rIt;
+	for (rIt=regMap.begin(); rIt!=regMap.end(); rIt++) {
+		if (dirty.count(rIt->first) == 1 && live.count(rIt->second) == 1) {
+			IRNode newNode;
+			newNode.opCode = "STOREF";
+			newNode.ifFlags = 0;
+			newNode.op1    = rIt->first;
+			newNode.Result = rIt->second;
+			nodes.insert(at, newNode);
+			dirty.erase(rIt->first);
+		}
+	}
+	return;
+}
+
+void Driver::registerAllocation(std::vector< std::set< std::string> > &live,
+								std::vector< std::vector< std::string> > &gen,
+								std::list< IRNode> &nodes, funcStruct_s &f,
+								std::map< std::string, long long> &weights) {
+	// Variables only stay in registers within a block: anything dirty and
+	// still live is stored before a jump, a branch or a label, and the
+	// next block starts with the registers empty. Nothing is loaded or
+	// spilled inside a call sequence either, so what's in a register
+	// across the JSR is still there at the pop of the result, where
+	// findCallSaveSets looks for the registers to save.
+	int size = live.size();
+	std::vector< std::string> ops;
 	std::list< IRNode>::iterator nIt;
-	std::map< std::string, std::string> regMap;
-	int ReturnNum = 0;
+	for (nIt=nodes.begin(); nIt!=nodes.end(); nIt++) {
+		ops.push_back(nIt->opCode);
+	}
 	
-	int count = 0;
-
-	for (it=live.rbegin(), nIt=nodes.begin(); 
-			it!=live.rend(), nIt!=nodes.end(); it++, nIt++) {
-		std::vector< std::string>::iterator sIt;
-		std::stringstream out;
-		std::stringstream out1;
+	// the next node in the same block that uses each variable
+	std::vector< std::map< std::string, int> > nextUse(size);
+	for (int i=size-2; i>=0; i--) {
+		if (ops[i] == "JUMP" || isBranch(ops[i]) || ops[i] == "RETURN" ||
+				ops[i+1] == "LABEL") {
+			continue;
+		}
+		nextUse[i] = nextUse[i+1];
+		for (int j=0; j<gen[i+1].size(); j++) {
+			nextUse[i][gen[i+1][j]] = i+1;
+		}
+	}
+	
+	std::map< std::string, std::string> regMap; // register -> variable
+	std::set< std::string> dirty; // registers newer than their variable
+	bool inCall = false;
+	int ReturnNum = 0;
+	nIt = nodes.begin();
+	for (int i=0; i<size; i++, nIt++) {
+		std::string op = ops[i];
+		bool endsBlock = op == "JUMP" || isBranch(op);
+		if (op == "LABEL") {
+			// another way in could have left anything in the registers
+			storeDirtyRegisters(nodes, nIt, regMap, dirty, live[i]);
+			regMap.clear();
+			dirty.clear();
+			continue;
+		}
 		
+		// the live ones used again in this block, soonest first; with
+		// too many, drop the coldest by the profile, or the latest used
+		std::vector< std::pair< int, std::string> > soonest;
+		std::map< std::string, int>::iterator uIt;
+		for (uIt=nextUse[i].begin(); uIt!=nextUse[i].end(); uIt++) {
+			if (live[i].count(uIt->first) == 1) {
+				soonest.push_back(std::make_pair(uIt->second, uIt->first));
+			}
+		}
+		std::sort(soonest.begin(), soonest.end());
 		std::vector< std::string> liveVars;
-		if (it->size() > MAX_NUM_REGISTERS) {
-			// redefine liveVars as the newest 4 variables
-			std::vector< std::string>::iterator liveIt;
-			int i = 0;
-			for (liveIt=it->begin(); liveIt!=it->end(); liveIt++) {
-				if (i >= MAX_NUM_REGISTERS) {
-					liveVars.erase(liveVars.begin());
+		for (int j=0; j<soonest.size(); j++) {
+			liveVars.push_back(soonest[j].second);
+		}
+		while (liveVars.size() > MAX_NUM_REGISTERS) {
+			int coldest = 0;
+			for (int j=1; j<liveVars.size(); j++) {
+				if (weights[liveVars[j]] <= weights[liveVars[coldest]]) {
+					coldest = j;
 				}
-				liveVars.push_back(*liveIt);
-				i++;
 			}
-		} else {
-			liveVars = *it;
+			liveVars.erase(liveVars.begin() + coldest);
 		}
 		
-		for (sIt=liveVars.begin(); sIt!=liveVars.end(); sIt++) {
-				out1 << *sIt << ",";
-				bool alreadyReg = false;
-				std::map< std::string, std::string>::iterator rIt;
-				for (rIt=regMap.begin(); rIt!=regMap.end(); rIt++) {
-					if (*sIt == rIt->second) {
-						alreadyReg = true;
-						break;
-					}
+		if (op == "PUSH" && nIt->Result.empty()) {
+			inCall = true;
+		}
+		if (inCall) {
+			// the result can have a free register, nothing else changes
+			if (op == "POP" && !nIt->Result.empty()) {
+				inCall = false;
+				std::string v = nIt->Result;
+				if (std::find(liveVars.begin(), liveVars.end(), v) !=
+						 liveVars.end() &&
+						 getRegisterNumber(regMap, v).empty() &&
+						 regMap.size() < MAX_NUM_REGISTERS) {
+					getNextAvailableRegister(regMap, v);
+				}
+			}
+		} else if (!endsBlock) {
+			std::vector< std::string>::iterator sIt;
+			for (sIt=liveVars.begin(); sIt!=liveVars.end(); sIt++) {
+				if (!getRegisterNumber(regMap, *sIt).empty()) {
+					continue;
 				}
-				if (alreadyReg != true) {
-					if (regMap.size() == MAX_NUM_REGISTERS) {
-						// spill a register that won't be used
-						std::map< std::string, std::string>::iterator rIt;
-						for (rIt=regMap.begin(); rIt!=regMap.end(); rIt++) {
-							std::string reg = rIt->second;
-							if (reg != nIt->op1 && reg != nIt->op2 &&
-													reg != nIt->Result) {
-								IRNode newNode;
-								newNode.opCode = "STOREF";
-								newNode.op1    = rIt->first;
-								newNode.Result = rIt->second;
-								nodes.insert(nIt, newNode);
-								regMap.erase(rIt->first);
-							
-								break;
-							}
+				if (regMap.size() == MAX_NUM_REGISTERS) {
+					// give up one that isn't wanted here
+					std::map< std::string, std::string>::iterator rIt;
+					for (rIt=regMap.begin(); rIt!=regMap.end(); rIt++) {
+						if (std::find(liveVars.begin(), liveVars.end(),
+									  rIt->second) == liveVars.end()) {
+							break;
 						}
 					}
-				
-					std::string tregure;
-					tregure = getNextAvailableRegister(regMap, *sIt);
-				
-					/* experimental shit */
-					#if 1
-					if (nIt != nodes.begin() && nIt != nodes.end()) {
-						if (nIt->Result != *sIt) 
-						{
-							IRNode newNode;
-							newNode.opCode = "STOREF";
-							newNode.op1    = *sIt;
-							newNode.Result = tregure;
-							nodes.insert(nIt, newNode);
-						}
+					bool needed = live[i].count(rIt->second) == 1 ||
+							std::find(gen[i].begin(), gen[i].end(),
+									  rIt->second) != gen[i].end();
+					if (dirty.count(rIt->first) == 1 && needed) {
+						IRNode newNode;
+						newNode.opCode = "STOREF";
+						newNode.ifFlags = 0;
+						newNode.op1    = rIt->first;
+						newNode.Result = rIt->second;
+						nodes.insert(nIt, newNode);
 					}
-					#endif
+					dirty.erase(rIt->first);
+					regMap.erase(rIt);
 				}
-
+				
+				std::string reg = getNextAvailableRegister(regMap, *sIt);
+				// no need to load what this node is about to write
+				bool used = std::find(gen[i].begin(), gen[i].end(), *sIt) !=
+						gen[i].end();
+				if (used || nIt->Result != *sIt || !isDefinition(*nIt)) {
+					IRNode newNode;
+					newNode.opCode = "STOREF";
+					newNode.ifFlags = 0;
+					newNode.op1    = *sIt;
+					newNode.Result = reg;
+					nodes.insert(nIt, newNode);
+				}
+			}
+		}
+		if (endsBlock) {
+			storeDirtyRegisters(nodes, nIt, regMap, dirty, live[i]);
 		}
-		if (nIt->opCode == "RETURN") {
+		
+		if (op == "RETURN") {
 			// change the retVal to a register if necessary
 			std::string retval = f.retVals[ReturnNum];
 			if (!f.retVals[ReturnNum].empty() &&
@@ -1221,19 +1500,17 @@ void Driver::registerAllocation(std::vector< std::vector< std::string> > &live,
 			}
 			ReturnNum++;
 		}
-		IRNode newNode = *nIt;
-		adjustNodeForRegisters(newNode, regMap);
-		std::list< IRNode>::iterator tIt;
-		tIt = nodes.insert(nIt, newNode);
-		nodes.erase(nIt);
-		nIt = tIt;
-		std::stringstream out3;
-		out3 << (*nIt).opCode;
-		if (!(*nIt).op1.empty()) out3 << " " << (*nIt).op1;
-		if (!(*nIt).op2.empty()) out3 << " " << (*nIt).op2;
-		if (!(*nIt).Result.empty()) out3 << " " << (*nIt).Result;
-		//std::cout << "(" << out1.str() << ")" << std::endl << out3.str()<< std::endl;
-		count++;
+		bool defines = isDefinition(*nIt);
+		adjustNodeForRegisters(*nIt, regMap);
+		if (defines && isRegister(nIt->Result)) {
+			dirty.insert(nIt->Result);
+		}
+		if (endsBlock || op == "RETURN") {
+			// a branch's scratch register can go too, so the fall through
+			// starts empty like any other block
+			regMap.clear();
+			dirty.clear();
+		}
 	}
 
 	return;
@@ -1296,84 +1573,13 @@ std::string Driver::getNextAvailableRegister(std::map< std::string,
 	}
 }
 
-void Driver::printLiveSet(std::list< IRNode> nodes,
-					std::vector< std::vector< std::string> > live) {
-	std::list< IRNode>::reverse_iterator it;
-	std::vector< std::vector< std::string> >::reverse_iterator lIt;
-	for (it=nodes.rbegin(), lIt=live.rbegin(); 
-				it!=nodes.rend(), lIt!=live.rend(); it++, lIt++) {
-		std::stringstream out;
-		out << it->opCode << " ";
-		if (it->op1 != "") out << it->op1 << " ";
-		if (it->op2 != "") out << it->op2 << " ";
-		if (it->Result != "") out << it->Result;
-		std::cout << out.str() << std::endl;
-		out.str("");
-
-		out << "    (";
-		std::vector< std::string> v = *lIt;
-		for (int i=0; i<v.size(); i++) {
-			out << v[i];
-			if (i != v.size()-1) {
-				out << ",";
-			}
-		}
-		out << ")";
-		std::cout << out.str() << std::endl;
-	}
-}
-
-void Driver::updateUseSet(std::vector< std::string> genSet,
-							std::vector< std::string> killSet,
-							std::vector< std::string> &liveSet) {
-	// first erase any variables in the kill set
-	std::vector< std::string>::iterator killIt;
-	for (killIt = killSet.begin(); killIt != killSet.end(); killIt++) {
-		std::vector< std::string>::iterator it;
-		for (it = liveSet.begin(); it != liveSet.end(); it++) {
-			if (*it == *killIt) {
-				liveSet.erase(it);
-				break;
-			}
-		}
-	}
-	
-	// now add in any variables in the gen set
-	std::vector< std::string>::iterator genIt;
-	for (genIt = genSet.begin(); genIt != genSet.end();genIt++) {
-		bool notFound = true;
-		std::vector< std::string>::iterator it;
-		for (it = liveSet.begin(); it != liveSet.end(); it++) {
-			if (*it == *genIt) {
-				std::string temp = *it;
-				liveSet.erase(it);
-				liveSet.push_back(temp);
-				notFound = false;
-				break;
-			}
-		}
-		if (notFound) {
-			liveSet.push_back(*genIt);
-		}
-	}
-	
-	std::vector< std::string>::iterator it;
-	std::vector< std::string>::iterator previt;
-	for (it=liveSet.begin(); it!=liveSet.end(); it++) {
-		if (it != liveSet.begin()) {
-			if (*it == *previt) {
-				it = liveSet.erase(previt);
-			}
-		}
-		previt = it;
-	}
-	
-	return;
-}
-
 bool Driver::isGlobalVariable(std::string s) {
+	SymbolTable_t::iterator tIt = symbolTable.find(0);
+	if (tIt == symbolTable.end()) {
+		return false;
+	}
 	std::vector< VarStruct_s>::iterator it;
-	for (it=symbolTable[0].begin(); it!=symbolTable[0].end(); it++) {
+	for (it=tIt->second.begin(); it!=tIt->second.end(); it++) {
 		if (it->identifier == s) {
 			return true;
 		}
@@ -1419,8 +1625,10 @@ std::vector< std::string> Driver::findGenSet(IRNode n, std::string f, int &r) {
 				&& !isGlobalVariable(n.op1)) {
 			v.push_back(n.op1);
 		}
-	} else if (n.opCode.find("PUSH") != std::string::npos) {
-		if (n.Result != "" && !isFunctionParameter(f, n.Result)
+	} else if (n.opCode.find("PUSH") != std::string::npos ||
+			n.opCode.find("WRITE") != std::string::npos) {
+		if (n.Result != "" && isdigit(n.Result[0]) == false &&
+				n.Result[0] != '.' && !isFunctionParameter(f, n.Result)
 				&& !isGlobalVariable(n.Result)) {
 			v.push_back(n.Result);
 		}
@@ -1435,7 +1643,7 @@ std::vector< std::string> Driver::findGenSet(IRNode n, std::string f, int &r) {
 			v.push_back(t);
 		}
 		r--;
-	} else if (n.opCode.find("GE") != std::string::npos || n.opCode.find("LE") != std::string::npos || n.opCode.find("NE") != std::string::npos) {
+	} else if (isBranch(n.opCode)) {
 		if (isdigit(n.op1[0]) == false &&
 				n.op1[0] != '.' && !isFunctionParameter(f, n.op1)
 				&& !isGlobalVariable(n.op1)) {
@@ -1470,4 +1678,350 @@ std::vector< std::string> Driver::findKillSet(IRNode n) {
 	return v;
 }
 
+bool Driver::isRegister(std::string s) {
+	if (s.size() < 2 || s[0] != 'r') {
+		return false;
+	}
+	for (int i=1; i<s.size(); i++) {
+		if (!isdigit(s[i])) {
+			return false;
+		}
+	}
+	return true;
+}
+
+std::string Driver::getScratchRegister(std::string op1, std::string op2,
+										std::string result, funcStruct_s &f) {
+	// the lowest numbered register that is not an operand and isn't
+	// holding one of the function's register params; without -live the
+	// temps leave the last one for this
+	if (liveness == false) {
+		std::stringstream tstr;
+		tstr << "r" << MAX_NUM_REGISTERS - 1;
+		return tstr.str();
+	}
+	int tempNum = 0;
+	std::string theTemp = "r0";
+	while (theTemp == op1 || theTemp == op2 || theTemp == result ||
+			isRegisterParam(theTemp, f)) {
+		tempNum++;
+		std::stringstream tstr;
+		tstr << "r" << tempNum;
+		theTemp = tstr.str();
+	}
+	return theTemp;
+}
+
+void Driver::findRegisterUseDef(IRNode n, std::string retVal,
+								std::vector< std::string> &use,
+								std::vector< std::string> &def) {
+	// n has already been renamed, so locals are $-# and temps are r#
+	std::string op = n.opCode;
+	if (op == "LABEL" || op == "JUMP" || op == "LINK" || op == "JSR") {
+		return;
+	}
+	if (op == "RETURN") {
+		if (isRegister(retVal)) use.push_back(retVal);
+	} else if (op == "PUSH" || op.find("WRITE") != std::string::npos) {
+		if (isRegister(n.Result)) use.push_back(n.Result);
+	} else if (op == "POP" || op.find("READ") != std::string::npos) {
+		if (isRegister(n.Result)) def.push_back(n.Result);
+	} else if (isBranch(op)) {
+		if (isRegister(n.op1)) use.push_back(n.op1);
+		if (isRegister(n.op2)) use.push_back(n.op2);
+	} else { // STORE and arithmetic
+		if (isRegister(n.op1)) use.push_back(n.op1);
+		if (isRegister(n.op2)) use.push_back(n.op2);
+		if (isRegister(n.Result)) def.push_back(n.Result);
+	}
+	return;
+}
+
+bool Driver::isTailCall(std::list< IRNode>::iterator start,
+						std::list< IRNode>::iterator end,
+						funcStruct_s &caller, funcStruct_s &callee,
+						int numRets) {
+	// The call can jump instead of jsr when its value is returned right
+	// away and the callee returns in our return register, which every
+	// function but main shares. It must take everything in registers,
+	// since our stack params belong to our caller.
+	if (caller.retReg.empty() || caller.retReg != callee.retReg ||
+			callee.numRegParams != callee.params.size()) {
+		return false;
+	}
+	std::list< IRNode>::iterator it = start;
+	while (it != end && (it->opCode != "POP" || it->Result.empty())) {
+		it++;
+	}
+	if (it == end) {
+		return false;
+	}
+	std::string retTemp = it->Result;
+	it++;
+	return it != end && it->opCode == "RETURN" &&
+			numRets < caller.retVals.size() &&
+			caller.retVals[numRets] == retTemp;
+}
+
+bool Driver::isRegisterParam(std::string reg, funcStruct_s &f) {
+	for (int i=0; i<f.numRegParams; i++) {
+		if (f.params[i].altName == reg) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Driver::assignCallingConventions() {
+	// Every function but main gets its first NUM_ARG_REGISTERS params
+	// and its return value in registers that its body doesn't use; the
+	// rest of the params stay on the stack below the return address.
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		std::string name = fIt->first;
+		if (name == "main" || streamCalled.count(name) == 1) {
+			continue;
+		}
+		funcStruct_s f;
+		findFuncData(name, f);
+		if (cachedInterfaces.count(name) == 1) {
+			// its code is already written for these
+			funcStruct_s &c = cachedInterfaces[name];
+			f.numRegParams = c.numRegParams;
+			for (int i=0; i<f.params.size() && i<c.params.size(); i++) {
+				f.params[i].altName = c.params[i].altName;
+			}
+			f.retReg = c.retReg;
+			overwriteFuncData(f);
+			continue;
+		}
+		
+		std::set< std::string> own;
+		std::list< IRNode>::iterator it;
+		for (it = fIt->second.begin(); it != fIt->second.end(); it++) {
+			IRNode n = *it;
+			renameVars(n.op1, n.op2, n.Result, name, f);
+			if (isRegister(n.op1)) own.insert(n.op1);
+			if (isRegister(n.op2)) own.insert(n.op2);
+			if (isRegister(n.Result)) own.insert(n.Result);
+		}
+		for (int i=0; i<f.retVals.size(); i++) {
+			if (isRegister(f.retVals[i])) own.insert(f.retVals[i]);
+		}
+		
+		// with only MAX_NUM_REGISTERS, one must stay free for scratch
+		int numRegs = f.params.size();
+		if (numRegs > NUM_ARG_REGISTERS) {
+			numRegs = NUM_ARG_REGISTERS;
+		}
+		if (numRegs > MAX_NUM_REGISTERS - 1 - (int)own.size()) {
+			numRegs = MAX_NUM_REGISTERS - 1 - own.size();
+			if (numRegs < 0) {
+				numRegs = 0;
+			}
+		}
+		std::vector< std::string> regs;
+		for (int r=0; regs.size() < numRegs; r++) {
+			std::stringstream tstr;
+			tstr << "r" << r;
+			if (own.count(tstr.str()) == 0) {
+				regs.push_back(tstr.str());
+			}
+		}
+		
+		f.numRegParams = numRegs;
+		for (int i=0; i<f.params.size(); i++) {
+			if (i < numRegs) {
+				f.params[i].altName = regs[i];
+			} else {
+				std::stringstream tstr;
+				tstr << "$" << (STACK_OFFSET + i - numRegs);
+				f.params[i].altName = tstr.str();
+			}
+		}
+		// nothing of ours is live at a return, so any register will do;
+		// they all use the same one so a call to any of them can be a
+		// tail call
+		f.retReg = "r0";
+		overwriteFuncData(f);
+	}
+	return;
+}
+
+void Driver::findCallSaveSets() {
+	// Only the registers that are live across a JSR and that the callee
+	// (or anything it calls) might write need to be pushed around it.
+	callSaveSets.clear();
+	// a stream only has the one function, the rest are already written
+	if (!streaming) {
+		clobberSets.clear();
+	}
+	std::map< std::string, std::vector< IRNode> > renamed;
+	std::map< std::string, std::vector< std::vector< std::string> > > uses;
+	std::map< std::string, std::vector< std::vector< std::string> > > defs;
+	std::map< std::string, std::set< std::string> > callees;
+	
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		std::string name = fIt->first;
+		funcStruct_s f;
+		findFuncData(name, f);
+		int numRets = 0;
+		std::list< IRNode>::iterator it;
+		if (cachedClobbers.count(name) == 1) {
+			// the cache kept what its allocated code writes and calls
+			clobberSets[name] = cachedClobbers[name];
+			std::map< std::string, std::string>::iterator cIt;
+			for (cIt = cachedCalls[name].begin();
+						cIt != cachedCalls[name].end(); cIt++) {
+				callees[name].insert(cIt->first);
+			}
+			continue;
+		}
+		for (it = fIt->second.begin(); it != fIt->second.end(); it++) {
+			IRNode n = *it;
+			renameVars(n.op1, n.op2, n.Result, name, f);
+			std::string retVal;
+			if (n.opCode == "RETURN" && numRets < f.retVals.size()) {
+				std::string dstr1;
+				std::string dstr2;
+				retVal = f.retVals[numRets++];
+				renameVars(dstr1, dstr2, retVal, name, f);
+			}
+			std::vector< std::string> u;
+			std::vector< std::string> d;
+			findRegisterUseDef(n, retVal, u, d);
+			clobberSets[name].insert(d.begin(), d.end());
+			clobberSets[name].insert(u.begin(), u.end());
+			if (isBranch(n.opCode) && !isRegister(n.op2) &&
+					!isRegister(n.op1)) {
+				// comparisons with neither operand in a register load op2
+				// into an unsaved scratch register
+				clobberSets[name].insert(
+						getScratchRegister(n.op1, n.op2, n.Result, f));
+			}
+			if (n.opCode == "JSR") {
+				callees[name].insert(it->Result);
+			}
+			renamed[name].push_back(n);
+			uses[name].push_back(u);
+			defs[name].push_back(d);
+		}
+		// the caller writes the argument registers and we write the
+		// return register even if the body never mentions them
+		for (int i=0; i<f.numRegParams; i++) {
+			clobberSets[name].insert(f.params[i].altName);
+		}
+		if (!f.retReg.empty()) {
+			clobberSets[name].insert(f.retReg);
+		}
+		directClobbers[name] = clobberSets[name];
+	}
+	
+	// a callee clobbers everything its own callees clobber
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		std::map< std::string, std::set< std::string> >::iterator cIt;
+		for (cIt = callees.begin(); cIt != callees.end(); cIt++) {
+			std::set< std::string>::iterator gIt;
+			for (gIt = cIt->second.begin(); gIt != cIt->second.end(); gIt++) {
+				if (clobberSets.count(*gIt) == 0) {
+					continue;
+				}
+				std::set< std::string> &mine = clobberSets[cIt->first];
+				std::set< std::string> theirs = clobberSets[*gIt];
+				int before = mine.size();
+				mine.insert(theirs.begin(), theirs.end());
+				if (mine.size() != before) {
+					changed = true;
+				}
+			}
+		}
+	}
+	// a call to something with no set yet (not written when streaming)
+	// could write anything, so its callers could too
+	std::set< std::string> unknown;
+	changed = true;
+	while (changed) {
+		changed = false;
+		std::map< std::string, std::set< std::string> >::iterator cIt;
+		for (cIt = callees.begin(); cIt != callees.end(); cIt++) {
+			if (unknown.count(cIt->first) == 1) {
+				continue;
+			}
+			std::set< std::string>::iterator gIt;
+			for (gIt = cIt->second.begin(); gIt != cIt->second.end(); gIt++) {
+				if (clobberSets.count(*gIt) == 0 || unknown.count(*gIt) == 1) {
+					unknown.insert(cIt->first);
+					changed = true;
+					break;
+				}
+			}
+		}
+	}
+	std::set< std::string>::iterator uIt;
+	for (uIt = unknown.begin(); uIt != unknown.end(); uIt++) {
+		clobberSets.erase(*uIt);
+	}
+	
+	// backwards liveness over registers for each function
+	std::map< std::string, std::vector< IRNode> >::iterator rIt;
+	for (rIt = renamed.begin(); rIt != renamed.end(); rIt++) {
+		std::vector< IRNode> &nodes = rIt->second;
+		std::vector< std::vector< std::string> > &u = uses[rIt->first];
+		std::vector< std::vector< std::string> > &d = defs[rIt->first];
+		int size = nodes.size();
+		std::vector< std::vector< int> > succ;
+		findSuccessors(nodes, succ);
+		std::vector< std::set< std::string> > liveIn(size);
+		std::vector< std::set< std::string> > liveOut(size);
+		changed = true;
+		while (changed) {
+			changed = false;
+			for (int i=size-1; i>=0; i--) {
+				std::set< std::string> out;
+				for (int j=0; j<succ[i].size(); j++) {
+					out.insert(liveIn[succ[i][j]].begin(),
+							   liveIn[succ[i][j]].end());
+				}
+				std::set< std::string> in = out;
+				for (int j=0; j<d[i].size(); j++) {
+					in.erase(d[i][j]);
+				}
+				in.insert(u[i].begin(), u[i].end());
+				if (in != liveIn[i] || out != liveOut[i]) {
+					liveIn[i] = in;
+					liveOut[i] = out;
+					changed = true;
+				}
+			}
+		}
+		
+		// the call sequence ends with the pop of the return value
+		std::string callee;
+		for (int i=0; i<size; i++) {
+			if (nodes[i].opCode == "JSR") {
+				callee = nodes[i].Result;
+			}
+			if (nodes[i].opCode != "POP" || nodes[i].Result.empty()) {
+				continue;
+			}
+			std::vector< std::string> saves;
+			std::set< std::string>::iterator sIt;
+			for (sIt = liveOut[i].begin(); sIt != liveOut[i].end(); sIt++) {
+				if (*sIt == nodes[i].Result) {
+					continue;
+				}
+				if (clobberSets.count(callee) == 0 ||
+						clobberSets[callee].count(*sIt) == 1) {
+					saves.push_back(*sIt);
+				}
+			}
+			callSaveSets[rIt->first].push_back(saves);
+		}
+	}
+	return;
+}
+
 } // namespace little
@@ -8,8 +8,17 @@
 #include <map>
 #include <list>
 #include <stack>
+#include <set>
 #include <sstream>
 
+#define GLOBAL_SCOPE "0GLOBAL_SCOPE_RESERVED"
+#define TEMP_LABEL_PRE "lpTmpLbl"
+#define TEMP_VAR_PRE "lpTmpVar"
+#define TEMP_VAR_LEN 8
+#define INLINE_VAR_PRE "lpInlVar"
+#define NUM_ARG_REGISTERS 2
+#define MAX_NUM_REGISTERS 4
+
 namespace little {
 
 enum littleTypes
@@ -43,6 +52,9 @@ struct funcStruct_s {
 	std::vector< VarStruct_s> params;
 	littleTypes type; // the return type
 	std::string retLoc;
+	int numRegParams; // leading params that are passed in registers
+	std::string retReg; // if empty, the return value goes on the stack
+	bool pure; // no I/O and no global writes, here or in any callee
 	std::string assVar; // the variable that eventually gets assigned to
 	std::vector< std::string> retVals; // return conditions
 };
@@ -53,6 +65,18 @@ public:
     Driver();
     virtual ~Driver();
     void setLiveness(bool l);
+    bool enablePass(std::string name);
+    bool setPipeline(std::string names);
+    bool setPrintAfter(std::string name);
+    void setOptLevel(int level);
+    void setProfileGen(std::string filename);
+    bool setFunctionCache(std::string dir);
+    void setSkipCachedIR(bool s);
+    bool setOutputCache(std::string dir, long long maxBytes);
+    void setThreads(int n);
+    void setStreaming(bool s);
+    void setStreams(std::ostream &out, std::ostream &err);
+    bool loadProfile(std::string filename);
     class Scanner* lexer;
     bool debug_error;
     bool parse_file();
@@ -73,6 +97,7 @@ public:
 	std::list< IRNode> nodeList;
 	IRNode curNode;
 	void pushBackCurNode();
+	void appendNode(IRNode &n);
 	void printNodeList(bool CommentOut = false);
 	std::vector< std::string> treeStack;
 	void interpretTree();
@@ -80,9 +105,32 @@ public:
 	std::string generateLabel();
 	std::stack< std::string> labelStack;
 	
+	// the parser's state between actions, here so each compile has its own
+	std::vector< std::string> multiVars;
+	bool dontPush;
+	bool last_stmt;
+	bool skippingIR; // the function cache has this one's code
+	// one entry per call being parsed, so calls can nest in arguments
+	std::stack< std::vector< std::string> > savedTreeStacks;
+	std::stack< std::vector< std::string> > callArgs;
+	int numParamsWorry;
+	
 	// the following are related to Tiny code generation
 	void tinyGeneration();
 	void printTinyCode();
+	void printTinyObject();
+	bool runTinyCode(std::istream &in, std::ostream &out, bool stats,
+					 bool jit = false);
+	
+	// IR files, see irfile.cpp
+	static bool isIR(std::istream &is);
+	bool readIR(std::istream &is);
+	std::string checkIRNode(IRNode &n, std::string func, bool first);
+	void printIR(bool binary);
+	
+	// the C backend, see cgen.cpp
+	void cGeneration();
+	void printCCode();
 	
 	void pushParams(std::vector< std::string> v);
 	void popParams(int s);
@@ -96,6 +144,38 @@ public:
 	bool returnExpr;
 	void popRetVal();
 	std::string createTempVar(littleTypes varType);
+	// declared return types, read before parsing since a call can come
+	// before the function
+	std::map< std::string, littleTypes> functionTypes;
+	// and the tokens of each function and of what they all share (the
+	// globals and the headers), for the function cache
+	std::map< std::string, std::string> functionSources;
+	std::string sharedSource;
+	void findFunctionTypes(std::istream &is);
+	littleTypes getCallType(std::string callee);
+	
+	// IR optimizations, see optimize.cpp, run by the pass manager in
+	// passes.cpp
+	void runPasses();
+	void printPassStats();
+	bool hasModulePasses();
+	void performInlining();
+	void performInterproceduralOpts();
+	void performWholeProgramOpts();
+	void lookupFunctionSource(std::string fname);
+	void lookupFunctionCache();
+	bool functionCacheStale();
+	bool removeStaleFunctions();
+	void printFunctionCacheStats();
+	bool readOutputCache(const std::string &source);
+	void writeOutputCache();
+	void printOutputCacheStats(bool all);
+	// for compiling each function as soon as it's parsed, see stream.cpp
+	bool streaming;
+	void streamFunction(std::string fname);
+	void finishStream();
+	std::map< std::string, std::set< std::string> > callGraph;
+	void buildCallGraph();
 	
 	// Liveness Anaylsis stuff
 	void performLivenessAnalysis();
@@ -106,13 +186,67 @@ private:
 	littleTypes adjustIROpCode(IRNode &node);
 	int tempVarCount;
 	int tempLabelCount;
+	// one line of TINY; the backend builds these, and they're only
+	// written out as text for the output, the caches and the assembler
+	struct TinyInst {
+		std::string op;
+		std::string a;
+		std::string b;
+	};
+	static TinyInst tinyInst(std::string op, std::string a = "",
+							 std::string b = "");
+	std::vector< TinyInst> tinyCode; // the whole program
+	void writeTinyCode(std::ostream &os, std::vector< TinyInst> &code);
+	void readTinyCode(std::istream &is, std::vector< TinyInst> &code);
 	void tinyVariableDeclaration();
-	void tinyPushRegisters(std::string scope = "main");
-	void tinyPopRegisters(std::string scope = "main");
+	void tinyPushRegisters(std::vector< TinyInst> &out,
+						   std::vector< std::string> regs);
+	void tinyPopRegisters(std::vector< TinyInst> &out,
+						  std::vector< std::string> regs);
 	int  getNumberRegistersUsed(std::string scope);
-	void tinyGenerateNormalCode(std::list< IRNode> );
+	void printNodes(std::ostream &out, std::list< IRNode> &nodes,
+					bool commentOut);
+	void tinyGenerateNormalCode(std::list< IRNode>, std::vector< TinyInst> &out);
+	// how an IR op is emitted, the table is in driver.cpp
+	enum TinyPattern {
+		TINY_PAT_LABEL, TINY_PAT_LINK, TINY_PAT_MOVE, TINY_PAT_ARITH,
+		TINY_PAT_BRANCH, TINY_PAT_JUMP, TINY_PAT_SYS, TINY_PAT_RETURN,
+		TINY_PAT_JSR, TINY_PAT_PUSH, TINY_PAT_POP
+	};
+	struct TinyPatternInfo {
+		const char *op; // the IR op
+		TinyPattern pattern;
+		const char *mnemonic;
+		const char *swapped; // the same op with its operands turned round
+	};
+	static const TinyPatternInfo tinyPatterns[];
+	static const int numTinyPatterns;
+	// by IR op name, since the IR keeps its ops as strings; a lookup is
+	// about 50ns, under 0.3% of the backend's time per node
+	std::map< std::string, const TinyPatternInfo*> tinyPatternIndex;
+	// picking the cheapest TINY for a node, in tinysel.cpp
+	bool isMemoryOperand(std::string s);
+	int getTinyCost(std::vector< TinyInst> &seq);
+	void emitCheapest(std::vector< TinyInst> &out,
+					  std::vector< std::vector< TinyInst> > &choices);
+	void addScratchSaves(std::vector< TinyInst> &seq,
+						 std::vector< std::string> &saved);
+	void addArithChoice(std::vector< std::vector< TinyInst> > &choices,
+						std::string op, std::string x, std::string y,
+						std::string dest, std::string result,
+						std::vector< std::string> &saved);
+	void selectTinyMove(std::vector< TinyInst> &out, std::string from,
+						std::string to, std::string scratch,
+						std::vector< std::string> &saved);
+	void selectTinyArith(std::vector< TinyInst> &out, const TinyPatternInfo &p,
+						 std::string op1, std::string op2, std::string result,
+						 std::string scratch, std::vector< std::string> &saved);
+	void selectTinyBranch(std::vector< TinyInst> &out, const TinyPatternInfo &p,
+						  std::string op1, std::string op2, std::string label,
+						  bool isFloat, std::string scratch);
 	void tinyGenerateLiveCode();
-	std::stringstream tinyStream;
+	std::ostream *outStream; // the output, std::cout but for the server
+	std::ostream *errStream; // and the diagnostics
 	void interpretTree(std::vector< std::string> &theStack, std::string &lastTouched);
 	littleTypes getType(IRNode &node);
 	int getNumLocals(std::string scope);
@@ -121,16 +255,21 @@ private:
 	void findFuncData(std::string s, funcStruct_s &f);
 	
 	// for liveness
-	void functionalLiveness(std::list< IRNode> &nodes);
+	void functionalLiveness(std::list< IRNode> &nodes, funcStruct_s &f);
 	bool liveness;
 	std::vector< std::string> findGenSet(IRNode n, std::string fname, int &r);
 	std::vector< std::string> findKillSet(IRNode n);
-	void updateUseSet(std::vector< std::string> genSet,
-							std::vector< std::string> killset,
-							std::vector< std::string> &liveSet);
-	void printLiveSet(std::list< IRNode> nodes,
-					std::vector< std::vector< std::string> > live);
-	void registerAllocation(std::vector< std::vector< std::string> > &live, std::list< IRNode> &nodes, funcStruct_s &f);
+	void findSuccessors(std::vector< IRNode> &nodes,
+						std::vector< std::vector< int> > &succ);
+	void storeDirtyRegisters(std::list< IRNode> &nodes,
+							 std::list< IRNode>::iterator at,
+							 std::map< std::string, std::string> &regMap,
+							 std::set< std::string> &dirty,
+							 std::set< std::string> &live);
+	void registerAllocation(std::vector< std::set< std::string> > &live,
+							std::vector< std::vector< std::string> > &gen,
+							std::list< IRNode> &nodes, funcStruct_s &f,
+							std::map< std::string, long long> &weights);
 	std::string getNextAvailableRegister(std::map< std::string, std::string>&,
 															 std::string);
 	std::string getRegisterNumber(std::map< std::string, std::string> &,
@@ -142,6 +281,156 @@ private:
 	bool isFunctionParameter(std::string s, std::string v);
 	void overwriteFuncData(funcStruct_s &f);
 	bool isRegister(std::string);
+	
+	// for saving only the registers live across a call
+	std::map< std::string, std::vector< std::vector< std::string> > > callSaveSets;
+	std::map< std::string, std::set< std::string> > clobberSets;
+	void findCallSaveSets();
+	void assignCallingConventions();
+	bool isRegisterParam(std::string reg, funcStruct_s &f);
+	bool isTailCall(std::list< IRNode>::iterator start,
+					std::list< IRNode>::iterator end,
+					funcStruct_s &caller, funcStruct_s &callee, int numRets);
+	
+	// for the temps without -live, see regpool.cpp
+	void allocateTempRegisters(std::string fname, std::list< IRNode> &nodes);
+	int getNumSpilledTemps(std::string scope);
+	
+	// for the pass manager
+	struct PassInfo {
+		const char *name;
+		int level; // the lowest -O that runs it, 0 for none
+		// one of these is set
+		void (Driver::*runModule)();
+		void (Driver::*runFunction)(std::string fname,
+									std::list< IRNode> &nodes);
+	};
+	static const PassInfo passes[];
+	static const int numPasses;
+	struct PassStats {
+		double ms;
+		long long removed; // IR nodes, less than 0 if it added some
+	};
+	std::vector< std::string> pipeline;
+	std::set< std::string> printAfter;
+	std::map< std::string, PassStats> passStats;
+	const PassInfo *findPass(std::string name);
+	std::string getPipeline();
+	void runFunctionPasses(std::string fname, std::list< IRNode> &nodes);
+	void printPassIR(std::string pass, std::string fname,
+					 std::list< IRNode> &nodes);
+	
+	// for specialization and pure calls
+	bool isLiteral(std::string s);
+	std::string cloneFunction(std::string callee,
+							  std::vector< std::string> args);
+	void propagateConstants(std::string fname);
+	void findPureFunctions();
+	void eliminateCommonCalls(std::string fname);
+	void removeDeadFunctions();
+	void localizeGlobals();
+	bool isDefinedBeforeUse(std::list< IRNode> &nodes, std::string var);
+	bool isRecursive(std::string fname);
+	bool hasLoop(std::list< IRNode> &nodes);
+	bool isBranch(std::string op);
+	std::string invertBranch(std::string op);
+	
+	// for C generation
+	std::stringstream cStream;
+	std::map< std::string, littleTypes> cTypes; // in the current function
+	void findCTypes(funcStruct_s &f);
+	void cGenerateFunction(funcStruct_s &f);
+	std::string cName(std::string s);
+	std::string cTypeName(littleTypes t);
+	std::string cOperand(std::string s, littleTypes type);
+	
+	// for profile guided optimization, see profile.cpp
+	std::string profileGen;
+	// function -> label -> times the code after the label ran
+	std::map< std::string, std::map< std::string, long long> > profile;
+	long long profileMax;
+	void writeProfile(std::map< std::string, unsigned long long> &counts);
+	long long getBlockCount(std::string fname, std::list< IRNode> &nodes,
+							std::list< IRNode>::iterator it);
+	long long getLabelCount(std::string fname, std::string label);
+	void findVarWeights(std::string fname, std::list< IRNode> &nodes,
+						std::map< std::string, long long> &weights);
+	bool isHotCount(long long hits);
+	void layoutIfElse(std::string fname, std::list< IRNode> &nodes,
+					  std::list< IRNode>::iterator condIt);
+	void rotateLoop(std::string fname, std::list< IRNode> &nodes,
+					std::list< IRNode>::iterator jumpIt);
+	void layoutFunction(std::string fname, std::list< IRNode> &nodes);
+	
+	// for the per-function code cache, see cache.cpp
+	std::string functionCacheDir;
+	std::map< std::string, std::string> functionKeys;
+	std::map< std::string, std::string> cachedTiny; // only the hits
+	std::map< std::string, funcStruct_s> cachedInterfaces;
+	std::map< std::string, std::set< std::string> > cachedClobbers;
+	// what a hit's calls were written for, by callee
+	std::map< std::string, std::map< std::string, std::string> > cachedCalls;
+	std::map< std::string, std::set< std::string> > directClobbers;
+	int functionCacheMisses;
+	bool skipCachedIR; // a hit found while parsing doesn't build its IR
+	std::vector< std::string> staleFunctions;
+	std::string getFunctionInputs(std::string fname);
+	std::string getCallInterface(std::string callee);
+	bool checkFunctionCache();
+	bool readFunctionCache(std::string fname);
+	void writeFunctionCache(std::string fname, std::vector< TinyInst> &code);
+	void spliceFunctionCache(std::string fname);
+	
+	// for the whole-output cache, also in cache.cpp
+	std::string outputCacheDir;
+	long long outputCacheMax;
+	std::string outputKey;
+	bool outputCacheHit;
+	void countOutputCache(bool hit);
+	void evictOutputCache();
+	
+	// for the parallel backend, see parallel.cpp
+	int numThreads; // 0 for one per cpu
+	std::vector< std::string> backendOrder; // the functions being worked on
+	std::vector< funcStruct_s> backendFuncs;
+	std::vector< std::vector< TinyInst> > backendCode;
+	void runParallel(int count, void (Driver::*task)(int));
+	void livenessTask(int i);
+	void codegenTask(int i);
+	
+	// for streaming
+	bool streamStarted; // the globals and the call to main are out
+	std::set< std::string> streamDone; // functions already written
+	std::set< std::string> streamCalled; // called before they were written
+	void startStream();
+	
+	// for tail calls
+	bool tailCalls;
+	void eliminateTailCalls(std::string fname, std::list< IRNode> &nodes);
+	std::list< IRNode>::iterator eliminateSelfTailCall(std::string fname,
+								std::list< IRNode> &nodes,
+								std::list< IRNode>::iterator start,
+								std::string &entryLabel);
+	
+	// for inlining
+	int inlineVarCount;
+	int getScopeNumber(std::string scp);
+	std::string createScopedVar(std::string scp, littleTypes type,
+								bool isTemp);
+	std::string createScopedLabel();
+	int getInlineCost(std::list< IRNode> &nodes);
+	bool isDefinition(IRNode &n);
+	bool shadowsCalleeGlobal(std::string caller, std::string callee);
+	bool shouldInline(std::string caller, std::string callee,
+					  long long hits = -1);
+	std::list< IRNode>::iterator inlineCall(std::string caller,
+								std::list< IRNode> &nodes,
+								std::list< IRNode>::iterator start);
+	void findRegisterUseDef(IRNode n, std::string retVal,
+							std::vector< std::string> &use,
+							std::vector< std::string> &def);
+	std::string getScratchRegister(std::string op1, std::string op2,
+									std::string result, funcStruct_s &f);
 };
 
 }
@@ -0,0 +1,525 @@
+/* IR files, so the IR can be saved after the frontend (and any passes) and
+ * compiled later, somewhere else, or over and over for timing the passes.
+ * micro -emit-ir writes the text form and -emit-ir -obj the binary one,
+ * and either can be given to micro in place of LITTLE source.
+ *
+ * Both forms are the same list of records: a name and then its fields.
+ *   counters TEMPVARS TEMPLABELS INLINEVARS
+ *   scope NAME                     one per scope, numbered from 1
+ *   var SCOPE TYPE ID VALUE ALTNAME   scope 0 for globals
+ *   function NAME TYPE RETLOC NUMREGPARAMS RETREG PURE ASSVAR
+ *   param TYPE ID ALTNAME          of the function before it
+ *   retval ID                      the same
+ *   code NAME                      the nodes after it are its body
+ *   node OPCODE OP1 OP2 RESULT IFFLAGS
+ * The text form starts with a "#little ir VERSION" line and has a record
+ * per line, its fields split by spaces; in a field, a space is \s, a tab
+ * \t, a newline \n, a return \r, a backslash \\, and \e alone is the
+ * empty string. Other lines starting with # are comments. The binary form
+ * starts with IR_MAGIC and the version byte, and then a field is a number,
+ * zigzagged and seven bits a byte, or a string: 0 and its length and bytes
+ * the first time, after that one more than its index among those. */
+
+#include <cstdlib>
+#include <sstream>
+
+#include "driver.h"
+
+#define IR_VERSION 1
+#define IR_TEXT_HEADER "#little ir"
+// neither can start a LITTLE program
+#define IR_MAGIC "\x7fLIR"
+#define IR_MAGIC_LEN 4
+
+namespace little {
+
+static const char *typeNames[] = { "INT", "FLOAT", "STRING", "VOID" };
+
+class IRWriter
+{
+public:
+	IRWriter(std::ostream &o, bool b) : os(o), binary(b), fields(0) {}
+	void record(const char *name) {
+		if (!binary && fields > 0) {
+			os << "\n";
+		}
+		fields = 0;
+		field(name);
+	}
+	void field(const std::string &s) {
+		if (binary) {
+			std::map< std::string, long long>::iterator it = index.find(s);
+			if (it != index.end()) {
+				putNumber(it->second + 1);
+				return;
+			}
+			long long n = index.size();
+			index[s] = n;
+			putNumber(0);
+			putNumber(s.size());
+			os.write(s.data(), s.size());
+			return;
+		}
+		if (fields++ > 0) {
+			os << " ";
+		}
+		if (s.empty()) {
+			os << "\\e";
+		}
+		for (int i=0; i<s.size(); i++) {
+			switch (s[i]) {
+				case ' ': os << "\\s"; break;
+				case '\t': os << "\\t"; break;
+				case '\n': os << "\\n"; break;
+				case '\r': os << "\\r"; break;
+				case '\\': os << "\\\\"; break;
+				default: os << s[i];
+			}
+		}
+	}
+	void number(long long n) {
+		if (binary) {
+			putNumber(((unsigned long long)n << 1) ^ (n >> 63));
+			return;
+		}
+		std::ostringstream ss;
+		ss << n;
+		field(ss.str());
+	}
+	void finish() {
+		if (!binary && fields > 0) {
+			os << "\n";
+		}
+	}
+private:
+	std::ostream &os;
+	bool binary;
+	int fields; // on the current text line
+	std::map< std::string, long long> index;
+	void putNumber(unsigned long long n) {
+		while (n >= 0x80) {
+			os.put((char)((n & 0x7f) | 0x80));
+			n >>= 7;
+		}
+		os.put((char)n);
+	}
+};
+
+class IRReader
+{
+public:
+	// after the header, which is the first line of text
+	IRReader(std::istream &i, bool b) : is(i), binary(b), line(1) {}
+	// the name of the next record, false at the end
+	bool record(std::string &name) {
+		if (binary) {
+			return is.peek() != EOF && field(name);
+		}
+		std::string text;
+		while (std::getline(is, text)) {
+			line++;
+			if (text.empty() || text[0] == '#') {
+				continue;
+			}
+			tokens.clear();
+			std::istringstream ss(text);
+			std::string t;
+			while (ss >> t) {
+				tokens.push_back(t);
+			}
+			next = 0;
+			return field(name);
+		}
+		return false;
+	}
+	bool field(std::string &s) {
+		if (binary) {
+			unsigned long long n;
+			if (!getNumber(n)) {
+				return false;
+			}
+			if (n > 0) {
+				if (n > strings.size()) {
+					return false;
+				}
+				s = strings[n-1];
+				return true;
+			}
+			unsigned long long len;
+			if (!getNumber(len) || len > (1 << 24)) {
+				return false;
+			}
+			s.resize(len);
+			if (len > 0 && !is.read(&s[0], len)) {
+				return false;
+			}
+			strings.push_back(s);
+			return true;
+		}
+		if (next >= tokens.size()) {
+			return false;
+		}
+		std::string t = tokens[next++];
+		s.clear();
+		if (t == "\\e") {
+			return true;
+		}
+		for (int i=0; i<t.size(); i++) {
+			if (t[i] != '\\' || i+1 == t.size()) {
+				s += t[i];
+				continue;
+			}
+			switch (t[++i]) {
+				case 's': s += ' '; break;
+				case 't': s += '\t'; break;
+				case 'n': s += '\n'; break;
+				case 'r': s += '\r'; break;
+				default: s += t[i];
+			}
+		}
+		return true;
+	}
+	bool number(long long &n) {
+		if (binary) {
+			unsigned long long u;
+			if (!getNumber(u)) {
+				return false;
+			}
+			n = (long long)(u >> 1) ^ -(long long)(u & 1);
+			return true;
+		}
+		std::string s;
+		if (!field(s) || s.empty()) {
+			return false;
+		}
+		char *end;
+		n = strtoll(s.c_str(), &end, 10);
+		return *end == '\0';
+	}
+	bool type(littleTypes &t) {
+		std::string s;
+		if (!field(s)) {
+			return false;
+		}
+		for (int i=0; i<=VOID; i++) {
+			if (s == typeNames[i]) {
+				t = (littleTypes)i;
+				return true;
+			}
+		}
+		return false;
+	}
+	// every field of the record was used
+	bool done() {
+		return binary || next == tokens.size();
+	}
+	std::string where() {
+		std::ostringstream ss;
+		if (binary) {
+			ss << "byte " << is.tellg();
+		} else {
+			ss << "line " << line;
+		}
+		return ss.str();
+	}
+private:
+	std::istream &is;
+	bool binary;
+	int line;
+	std::vector< std::string> tokens;
+	int next;
+	std::vector< std::string> strings;
+	bool getNumber(unsigned long long &n) {
+		n = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			int c = is.get();
+			if (c == EOF) {
+				return false;
+			}
+			n |= (unsigned long long)(c & 0x7f) << shift;
+			if ((c & 0x80) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+bool Driver::isIR(std::istream &is) {
+	int c = is.peek();
+	return c == IR_TEXT_HEADER[0] || c == IR_MAGIC[0];
+}
+
+void Driver::printIR(bool binary) {
+	std::ostream &os = *outStream;
+	if (binary) {
+		os.write(IR_MAGIC, IR_MAGIC_LEN);
+		os.put((char)IR_VERSION);
+	} else {
+		os << IR_TEXT_HEADER << " " << IR_VERSION << std::endl;
+	}
+	IRWriter w(os, binary);
+	w.record("counters");
+	w.number(tempVarCount);
+	w.number(tempLabelCount);
+	w.number(inlineVarCount);
+	for (int i=0; i<scopeVec.size(); i++) {
+		w.record("scope");
+		w.field(scopeVec[i]);
+	}
+	SymbolTable_t::iterator sIt;
+	for (sIt = symbolTable.begin(); sIt != symbolTable.end(); sIt++) {
+		for (int i=0; i<sIt->second.size(); i++) {
+			VarStruct_s &v = sIt->second[i];
+			w.record("var");
+			w.number(sIt->first);
+			w.field(typeNames[v.type]);
+			w.field(v.identifier);
+			w.field(v.value);
+			w.field(v.altName);
+		}
+	}
+	for (int i=0; i<fs.size(); i++) {
+		funcStruct_s &f = fs[i];
+		w.record("function");
+		w.field(f.name);
+		w.field(typeNames[f.type]);
+		w.field(f.retLoc);
+		w.number(f.numRegParams);
+		w.field(f.retReg);
+		w.number(f.pure);
+		w.field(f.assVar);
+		for (int j=0; j<f.params.size(); j++) {
+			w.record("param");
+			w.field(typeNames[f.params[j].type]);
+			w.field(f.params[j].identifier);
+			w.field(f.params[j].altName);
+		}
+		for (int j=0; j<f.retVals.size(); j++) {
+			w.record("retval");
+			w.field(f.retVals[j]);
+		}
+	}
+	// definition order, like the code comes out
+	for (int i=0; i<fs.size(); i++) {
+		std::map< std::string, std::list< IRNode> >::iterator fIt =
+				functionMap.find(fs[i].name);
+		if (fIt == functionMap.end()) {
+			continue;
+		}
+		w.record("code");
+		w.field(fIt->first);
+		std::list< IRNode>::iterator it;
+		for (it = fIt->second.begin(); it != fIt->second.end(); it++) {
+			w.record("node");
+			w.field(it->opCode);
+			w.field(it->op1);
+			w.field(it->op2);
+			w.field(it->Result);
+			w.number(it->ifFlags);
+		}
+	}
+	w.finish();
+	return;
+}
+
+static bool isDeclared(std::vector< funcStruct_s> &fs, std::string name) {
+	for (int i=0; i<fs.size(); i++) {
+		if (fs[i].name == name) {
+			return true;
+		}
+	}
+	return false;
+}
+
+std::string Driver::checkIRNode(IRNode &n, std::string func, bool first) {
+	// what's wrong with n as a node of func's code, empty if nothing; the
+	// backend has a pattern for every op the frontend makes
+	std::map< std::string, const TinyPatternInfo*>::iterator pIt =
+			tinyPatternIndex.find(n.opCode);
+	if (pIt == tinyPatternIndex.end()) {
+		return "unknown op " + n.opCode;
+	}
+	bool fits;
+	switch (pIt->second->pattern) {
+	case TINY_PAT_MOVE:
+		fits = !n.op1.empty() && n.op2.empty() && !n.Result.empty();
+		break;
+	case TINY_PAT_ARITH: case TINY_PAT_BRANCH:
+		fits = !n.op1.empty() && !n.op2.empty() && !n.Result.empty();
+		break;
+	case TINY_PAT_RETURN:
+		fits = n.op1.empty() && n.op2.empty() && n.Result.empty();
+		break;
+	case TINY_PAT_PUSH: case TINY_PAT_POP:
+		// an empty one is the return slot
+		fits = n.op1.empty() && n.op2.empty();
+		break;
+	default:
+		fits = n.op1.empty() && n.op2.empty() && !n.Result.empty();
+	}
+	if (!fits) {
+		return "wrong operands for " + n.opCode;
+	}
+	// the backend finds a function by its label
+	bool isFunc = n.opCode == "LABEL" && n.Result == func;
+	if (first != isFunc) {
+		return "code for " + func + " has to start with its LABEL";
+	}
+	if (!isFunc && n.opCode == "LABEL" && isDeclared(fs, n.Result)) {
+		return "LABEL of function " + n.Result + " in the code for " + func;
+	}
+	return "";
+}
+
+bool Driver::readIR(std::istream &is) {
+	bool binary = is.peek() == IR_MAGIC[0];
+	std::string header;
+	int version = 0;
+	if (binary) {
+		char magic[IR_MAGIC_LEN];
+		if (is.read(magic, IR_MAGIC_LEN) &&
+				std::string(magic, IR_MAGIC_LEN) ==
+				std::string(IR_MAGIC, IR_MAGIC_LEN)) {
+			version = is.get();
+		}
+	} else if (std::getline(is, header) &&
+			header.compare(0, sizeof(IR_TEXT_HEADER) - 1, IR_TEXT_HEADER) == 0) {
+		version = atoi(header.c_str() + sizeof(IR_TEXT_HEADER) - 1);
+	}
+	if (version != IR_VERSION) {
+		*errStream << "not an IR file of version " << IR_VERSION << std::endl;
+		return false;
+	}
+
+	symbolTable.clear();
+	scopeVec.clear();
+	fs.clear();
+	functionMap.clear();
+	nodeList.clear();
+	IRReader r(is, binary);
+	std::string name;
+	std::string codeName;
+	std::list< IRNode> *code = NULL;
+	std::string problem;
+	bool ok = true;
+	while (ok && r.record(name)) {
+		if (name == "counters") {
+			long long t = 0, l = 0, i = 0;
+			ok = r.number(t) && r.number(l) && r.number(i) && r.done();
+			if (!ok) {
+				break;
+			}
+			tempVarCount = t;
+			tempLabelCount = l;
+			inlineVarCount = i;
+		} else if (name == "scope") {
+			std::string s;
+			ok = r.field(s) && r.done();
+			if (!ok) {
+				break;
+			}
+			scopeVec.push_back(s);
+			symbolTable[scopeVec.size()];
+		} else if (name == "var") {
+			long long scopeNum = 0;
+			VarStruct_s v;
+			ok = r.number(scopeNum) && r.type(v.type) &&
+					r.field(v.identifier) && r.field(v.value) &&
+					r.field(v.altName) && r.done() &&
+					scopeNum >= 0 && scopeNum <= scopeVec.size();
+			if (!ok) {
+				break;
+			}
+			v.registerOnly = false;
+			symbolTable[scopeNum].push_back(v);
+		} else if (name == "function") {
+			funcStruct_s f;
+			long long numRegParams = 0, pure = 0;
+			ok = r.field(f.name) && r.type(f.type) && r.field(f.retLoc) &&
+					r.number(numRegParams) && r.field(f.retReg) &&
+					r.number(pure) && r.field(f.assVar) && r.done();
+			if (!ok) {
+				break;
+			}
+			f.numRegParams = numRegParams;
+			f.pure = pure != 0;
+			fs.push_back(f);
+		} else if (name == "param" && !fs.empty()) {
+			VarStruct_s v;
+			ok = r.type(v.type) && r.field(v.identifier) &&
+					r.field(v.altName) && r.done();
+			if (!ok) {
+				break;
+			}
+			v.registerOnly = false;
+			fs.back().params.push_back(v);
+		} else if (name == "retval" && !fs.empty()) {
+			std::string s;
+			ok = r.field(s) && r.done();
+			if (!ok) {
+				break;
+			}
+			fs.back().retVals.push_back(s);
+		} else if (name == "code") {
+			ok = r.field(codeName) && r.done();
+			if (!ok) {
+				break;
+			}
+			if (!isDeclared(fs, codeName) || functionMap.count(codeName) == 1) {
+				problem = "code for undeclared or repeated function " +
+						  codeName;
+				ok = false;
+				break;
+			}
+			code = &functionMap[codeName];
+		} else if (name == "node" && code != NULL) {
+			IRNode n;
+			long long flags = 0;
+			ok = r.field(n.opCode) && r.field(n.op1) && r.field(n.op2) &&
+					r.field(n.Result) && r.number(flags) && r.done();
+			if (!ok) {
+				break;
+			}
+			problem = checkIRNode(n, codeName, code->empty());
+			if (!problem.empty()) {
+				ok = false;
+				break;
+			}
+			n.ifFlags = flags;
+			code->push_back(n);
+		} else {
+			ok = false;
+		}
+	}
+	if (!ok) {
+		if (problem.empty()) {
+			problem = "bad IR record " + name;
+		}
+		*errStream << problem << " at " << r.where() << std::endl;
+		return false;
+	}
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		if (fIt->second.empty()) {
+			*errStream << "no code for " << fIt->first << std::endl;
+			return false;
+		}
+	}
+	// the parser leaves the last function's scope current
+	scope = scopeVec.empty() ? GLOBAL_SCOPE : scopeVec.back();
+
+	// a stream has nothing to overlap with here, but it still goes out
+	// one function at a time
+	if (streaming) {
+		for (int i=0; i<fs.size(); i++) {
+			if (functionMap.count(fs[i].name) == 1) {
+				streamFunction(fs[i].name);
+			}
+		}
+		finishStream();
+	}
+	return true;
+}
+
+} // namespace little
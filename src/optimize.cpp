@@ -0,0 +1,989 @@
+/* IR level optimizations on the per-function lists in functionMap. */
+
+#include <sstream>
+#include <cctype>
+#include <cstdlib>
+
+#include "driver.h"
+
+#define INLINE_THRESHOLD 10
+#define HOT_INLINE_THRESHOLD 40 // for a call site the profile says is hot
+#define MAX_INLINE_ROUNDS 4
+#define SPECIALIZE_THRESHOLD 40
+#define SPEC_NAME_PRE "lpSpec"
+
+namespace little {
+
+bool Driver::isDefinition(IRNode &n) {
+	// the nodes that write their Result
+	return n.opCode.find("STORE") != std::string::npos ||
+			n.opCode.find("READ") != std::string::npos ||
+			n.opCode.find("ADD") != std::string::npos ||
+			n.opCode.find("SUB") != std::string::npos ||
+			n.opCode.find("MULT") != std::string::npos ||
+			n.opCode.find("DIV") != std::string::npos ||
+			(n.opCode == "POP" && !n.Result.empty());
+}
+
+bool Driver::isBranch(std::string op) {
+	// the parser's three compares, and the inverses block layout adds
+	return op == "GE" || op == "LE" || op == "NE" ||
+			op == "LT" || op == "GT" || op == "EQ";
+}
+
+std::string Driver::invertBranch(std::string op) {
+	if (op == "GE") return "LT";
+	if (op == "LT") return "GE";
+	if (op == "LE") return "GT";
+	if (op == "GT") return "LE";
+	if (op == "NE") return "EQ";
+	return "NE";
+}
+
+int Driver::getInlineCost(std::list< IRNode> &nodes) {
+	// every node but the LABEL and LINK of the callee ends up in the caller
+	int cost = 0;
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		if (it->opCode != "LABEL" && it->opCode != "LINK") {
+			cost++;
+		}
+	}
+	return cost;
+}
+
+bool Driver::hasLoop(std::list< IRNode> &nodes) {
+	// any jump back to a label already seen
+	std::set< std::string> labels;
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		if (it->opCode == "LABEL") {
+			labels.insert(it->Result);
+		} else if ((it->opCode == "JUMP" || isBranch(it->opCode)) &&
+					labels.count(it->Result) == 1) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Driver::shadowsCalleeGlobal(std::string caller, std::string callee) {
+	// the IR names variables, not symbols, so a global the callee uses
+	// would turn into the caller's own variable of that name
+	std::set< std::string> mine;
+	std::set< std::string> theirs;
+	funcStruct_s f;
+	findFuncData(caller, f);
+	for (int i=0; i<f.params.size(); i++) {
+		mine.insert(f.params[i].identifier);
+	}
+	SymbolTable_t::iterator tIt = symbolTable.find(getScopeNumber(caller));
+	for (int i=0; tIt != symbolTable.end() && i<tIt->second.size(); i++) {
+		mine.insert(tIt->second[i].identifier);
+	}
+	findFuncData(callee, f);
+	for (int i=0; i<f.params.size(); i++) {
+		theirs.insert(f.params[i].identifier);
+	}
+	tIt = symbolTable.find(getScopeNumber(callee));
+	for (int i=0; tIt != symbolTable.end() && i<tIt->second.size(); i++) {
+		theirs.insert(tIt->second[i].identifier);
+	}
+	std::vector< std::string> used(f.retVals.begin(), f.retVals.end());
+	std::list< IRNode> &nodes = functionMap[callee];
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		used.push_back(it->op1);
+		used.push_back(it->op2);
+		if (it->opCode != "LABEL" && it->opCode != "JUMP" &&
+				it->opCode != "JSR" && !isBranch(it->opCode)) {
+			used.push_back(it->Result);
+		}
+	}
+	for (int i=0; i<used.size(); i++) {
+		if (mine.count(used[i]) == 1 && theirs.count(used[i]) == 0 &&
+				isGlobalVariable(used[i])) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool Driver::shouldInline(std::string caller, std::string callee,
+						  long long hits) {
+	// hits is how often the profile saw the call run, or -1 if unknown;
+	// a call that never ran isn't worth the code
+	if (callee == caller || callee == "main" ||
+			functionMap.count(callee) == 0 || hits == 0) {
+		return false;
+	}
+	// only leaves, so a recursive callee never gets unrolled into itself,
+	// and no loops, which pay for the call anyway and would lose the
+	// params' registers
+	std::list< IRNode> &nodes = functionMap[callee];
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		if (it->opCode == "JSR") {
+			return false;
+		}
+	}
+	if (hasLoop(nodes) || shadowsCalleeGlobal(caller, callee)) {
+		return false;
+	}
+	// the call sequence itself is about two nodes per param, plus the
+	// link, jsr, ret and return value traffic
+	funcStruct_s f;
+	findFuncData(callee, f);
+	int threshold = isHotCount(hits) ? HOT_INLINE_THRESHOLD
+									 : INLINE_THRESHOLD;
+	return getInlineCost(nodes) <= threshold + 2*f.params.size();
+}
+
+std::list< IRNode>::iterator Driver::inlineCall(std::string caller,
+								std::list< IRNode> &nodes,
+								std::list< IRNode>::iterator start) {
+	// start is the return slot PUSH, the sequence runs through the POP of
+	// the return value
+	std::vector< std::string> args;
+	std::list< IRNode>::iterator it = start;
+	for (it++; it->opCode == "PUSH"; it++) {
+		args.insert(args.begin(), it->Result); // pushed last to first
+	}
+	std::string calleeName = it->Result;
+	while (it->opCode != "POP" || it->Result.empty()) {
+		it++;
+	}
+	std::string retTemp = it->Result;
+	std::list< IRNode>::iterator end = it;
+	end++;
+
+	funcStruct_s callee;
+	findFuncData(calleeName, callee);
+	if (args.size() != callee.params.size()) {
+		return end;
+	}
+
+	// the callee's params, locals and temps all become locals and temps
+	// of the caller
+	std::map< std::string, std::string> names;
+	std::list< IRNode> body;
+	std::list< IRNode> &calleeNodes = functionMap[calleeName];
+	std::list< IRNode>::iterator cIt;
+	std::set< std::string> written;
+	bool writesGlobals = false;
+	for (cIt = calleeNodes.begin(); cIt != calleeNodes.end(); cIt++) {
+		if (isDefinition(*cIt)) {
+			written.insert(cIt->Result);
+			if (isGlobalVariable(cIt->Result)) {
+				writesGlobals = true;
+			}
+		}
+	}
+	for (int i=0; i<callee.params.size(); i++) {
+		// a param the callee never writes can just be the argument, as
+		// long as the body can't change the argument underneath it
+		if (written.count(callee.params[i].identifier) == 0 &&
+				(!writesGlobals || !isGlobalVariable(args[i]))) {
+			names[callee.params[i].identifier] = args[i];
+			continue;
+		}
+		std::string v = createScopedVar(caller, callee.params[i].type, false);
+		names[callee.params[i].identifier] = v;
+		IRNode newNode;
+		newNode.opCode = callee.params[i].type == FLOAT ? "STOREF" : "STOREI";
+		newNode.op1 = args[i];
+		newNode.Result = v;
+		newNode.ifFlags = 0;
+		body.push_back(newNode);
+	}
+	int scpnm = getScopeNumber(calleeName);
+	std::vector< VarStruct_s> vars = symbolTable[scpnm];
+	for (int i=0; i<vars.size(); i++) {
+		bool isTemp = vars[i].identifier.find(TEMP_VAR_PRE) !=
+											std::string::npos;
+		names[vars[i].identifier] = createScopedVar(caller, vars[i].type,
+													isTemp);
+	}
+
+	// labels get fresh names, returns jump to the continuation
+	std::string contLabel = createScopedLabel();
+	for (cIt = calleeNodes.begin(); cIt != calleeNodes.end(); cIt++) {
+		if (cIt->opCode == "LABEL" || cIt->opCode == "JUMP" ||
+				isBranch(cIt->opCode)) {
+			if (cIt->Result != calleeName && names.count(cIt->Result) == 0) {
+				names[cIt->Result] = createScopedLabel();
+			}
+		}
+	}
+	int numRets = 0;
+	for (cIt = calleeNodes.begin(); cIt != calleeNodes.end(); cIt++) {
+		if (cIt == calleeNodes.begin() || cIt->opCode == "LINK") {
+			continue;
+		}
+		IRNode newNode = *cIt;
+		if (names.count(newNode.op1) == 1) newNode.op1 = names[newNode.op1];
+		if (names.count(newNode.op2) == 1) newNode.op2 = names[newNode.op2];
+		if (names.count(newNode.Result) == 1) {
+			newNode.Result = names[newNode.Result];
+		}
+		if (newNode.opCode == "RETURN") {
+			std::string id = callee.retVals[numRets];
+			numRets++;
+			if (callee.type != VOID && id != "") {
+				IRNode retNode;
+				retNode.opCode = callee.type == FLOAT ? "STOREF" : "STOREI";
+				retNode.op1 = names.count(id) == 1 ? names[id] : id;
+				retNode.Result = retTemp;
+				retNode.ifFlags = 0;
+				body.push_back(retNode);
+			}
+			newNode.opCode = "JUMP";
+			newNode.op1 = "";
+			newNode.op2 = "";
+			newNode.Result = contLabel;
+			newNode.ifFlags = 0;
+			// the last return just falls through
+			std::list< IRNode>::iterator nextIt = cIt;
+			nextIt++;
+			if (nextIt == calleeNodes.end()) {
+				continue;
+			}
+		}
+		body.push_back(newNode);
+	}
+	IRNode contNode;
+	contNode.opCode = "LABEL";
+	contNode.Result = contLabel;
+	contNode.ifFlags = 0;
+	body.push_back(contNode);
+
+	nodes.erase(start, end);
+	nodes.insert(end, body.begin(), body.end());
+	return end;
+}
+
+std::list< IRNode>::iterator Driver::eliminateSelfTailCall(std::string fname,
+								std::list< IRNode> &nodes,
+								std::list< IRNode>::iterator start,
+								std::string &entryLabel) {
+	// start is the return slot PUSH of a call to fname whose value is
+	// returned right away; reassign the params and loop back instead
+	std::vector< std::string> args;
+	std::list< IRNode>::iterator it = start;
+	for (it++; it->opCode == "PUSH"; it++) {
+		args.insert(args.begin(), it->Result); // pushed last to first
+	}
+	while (it->opCode != "POP" || it->Result.empty()) {
+		it++;
+	}
+	std::string retTemp = it->Result;
+	std::list< IRNode>::iterator retIt = it;
+	retIt++;
+	std::list< IRNode>::iterator end = retIt;
+	end++;
+
+	funcStruct_s f;
+	findFuncData(fname, f);
+	if (args.size() != f.params.size()) {
+		return end;
+	}
+
+	// the RETURN goes away, and its retVal with it
+	int numRets = 0;
+	for (it = nodes.begin(); it != retIt; it++) {
+		if (it->opCode == "RETURN") {
+			numRets++;
+		}
+	}
+	f.retVals.erase(f.retVals.begin() + numRets);
+	overwriteFuncData(f);
+
+	// the loop starts after the LINK, so the frame is reused
+	if (entryLabel.empty()) {
+		entryLabel = createScopedLabel();
+		IRNode labelNode;
+		labelNode.opCode = "LABEL";
+		labelNode.Result = entryLabel;
+		labelNode.ifFlags = 0;
+		it = nodes.begin();
+		it++;
+		it++;
+		nodes.insert(it, labelNode);
+	}
+
+	// params are reassigned in order, so an argument naming an earlier
+	// param has to be read before that param is overwritten
+	std::list< IRNode> body;
+	std::vector< std::string> values = args;
+	for (int i=0; i<args.size(); i++) {
+		for (int j=0; j<i; j++) {
+			if (args[i] == f.params[j].identifier) {
+				IRNode newNode;
+				newNode.opCode = f.params[i].type == FLOAT ? "STOREF"
+														  : "STOREI";
+				newNode.op1 = args[i];
+				newNode.Result = createScopedVar(fname, f.params[i].type,
+												 true);
+				newNode.ifFlags = 0;
+				body.push_back(newNode);
+				values[i] = newNode.Result;
+				break;
+			}
+		}
+	}
+	for (int i=0; i<f.params.size(); i++) {
+		if (values[i] == f.params[i].identifier) {
+			continue;
+		}
+		IRNode newNode;
+		newNode.opCode = f.params[i].type == FLOAT ? "STOREF" : "STOREI";
+		newNode.op1 = values[i];
+		newNode.Result = f.params[i].identifier;
+		newNode.ifFlags = 0;
+		body.push_back(newNode);
+	}
+	IRNode jumpNode;
+	jumpNode.opCode = "JUMP";
+	jumpNode.Result = entryLabel;
+	jumpNode.ifFlags = 0;
+	body.push_back(jumpNode);
+	// keep any if/else marker the call sequence was carrying
+	body.front().ifFlags = start->ifFlags;
+
+	nodes.erase(start, end);
+	nodes.insert(end, body.begin(), body.end());
+	return end;
+}
+
+void Driver::eliminateTailCalls(std::string fname, std::list< IRNode> &nodes) {
+	// a call whose popped value is the very next thing RETURNed
+	std::string entryLabel;
+	int numRets = 0;
+	std::list< IRNode>::iterator it = nodes.begin();
+	while (it != nodes.end()) {
+		if (it->opCode == "RETURN") {
+			numRets++;
+		}
+		if (it->opCode != "PUSH" || !it->Result.empty() ||
+				fname == "main") {
+			it++;
+			continue;
+		}
+		std::list< IRNode>::iterator cIt = it;
+		while (cIt != nodes.end() && cIt->opCode != "JSR") {
+			cIt++;
+		}
+		std::string calleeName = cIt != nodes.end() ? cIt->Result : "";
+		while (cIt != nodes.end() &&
+				(cIt->opCode != "POP" || cIt->Result.empty())) {
+			cIt++;
+		}
+		if (cIt == nodes.end()) {
+			break;
+		}
+		std::string retTemp = cIt->Result;
+		cIt++;
+		funcStruct_s f;
+		findFuncData(fname, f);
+		if (calleeName != fname || cIt == nodes.end() ||
+				cIt->opCode != "RETURN" || numRets >= f.retVals.size() ||
+				f.retVals[numRets] != retTemp) {
+			it++;
+			continue;
+		}
+		it = eliminateSelfTailCall(fname, nodes, it, entryLabel);
+	}
+	return;
+}
+
+void Driver::performInlining() {
+	// inlining a leaf can turn its caller into a small leaf too, so go
+	// around a few times
+	bool changed = true;
+	for (int round=0; changed && round<MAX_INLINE_ROUNDS; round++) {
+		changed = false;
+		std::map< std::string, std::list< IRNode> >::iterator fIt;
+		for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+			std::list< IRNode> &nodes = fIt->second;
+			std::list< IRNode>::iterator it = nodes.begin();
+			while (it != nodes.end()) {
+				if (it->opCode != "PUSH" || !it->Result.empty()) {
+					it++;
+					continue;
+				}
+				std::list< IRNode>::iterator jsrIt = it;
+				while (jsrIt != nodes.end() && jsrIt->opCode != "JSR") {
+					jsrIt++;
+				}
+				if (jsrIt == nodes.end() ||
+						!shouldInline(fIt->first, jsrIt->Result,
+									  getBlockCount(fIt->first, nodes, it))) {
+					it++;
+					continue;
+				}
+				it = inlineCall(fIt->first, nodes, it);
+				changed = true;
+			}
+		}
+	}
+	return;
+}
+
+bool Driver::isLiteral(std::string s) {
+	return !s.empty() && (isdigit(s[0]) || s[0] == '.');
+}
+
+void Driver::buildCallGraph() {
+	callGraph.clear();
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		callGraph[fIt->first].clear();
+		std::list< IRNode>::iterator it;
+		for (it = fIt->second.begin(); it != fIt->second.end(); it++) {
+			if (it->opCode == "JSR") {
+				callGraph[fIt->first].insert(it->Result);
+			}
+		}
+	}
+	return;
+}
+
+std::string Driver::cloneFunction(std::string callee,
+								  std::vector< std::string> args) {
+	// a copy of callee with the literal args baked in and dropped from
+	// its params
+	funcStruct_s f;
+	findFuncData(callee, f);
+	std::stringstream tstr;
+	tstr << callee << SPEC_NAME_PRE << fs.size();
+	std::string name = tstr.str();
+
+	scopeVec.push_back(name);
+	symbolTable[scopeVec.size()] = symbolTable[getScopeNumber(callee)];
+
+	std::list< IRNode> nodes = functionMap[callee];
+	std::map< std::string, std::string> names;
+	std::set< std::string> results;
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		if (it->opCode == "LABEL" && it != nodes.begin()) {
+			names[it->Result] = createScopedLabel();
+		}
+		if (it->opCode != "LABEL" && it->opCode != "JUMP" &&
+				!isBranch(it->opCode) && it->opCode != "JSR") {
+			results.insert(it->Result);
+		}
+	}
+
+	// a param that's only ever read becomes the literal, otherwise it
+	// becomes a local that starts out holding it
+	funcStruct_s g = f;
+	g.name = name;
+	g.params.clear();
+	std::list< IRNode> inits;
+	for (int i=0; i<f.params.size(); i++) {
+		if (!isLiteral(args[i])) {
+			g.params.push_back(f.params[i]);
+		} else if (results.count(f.params[i].identifier) == 0) {
+			names[f.params[i].identifier] = args[i];
+		} else {
+			std::string v = createScopedVar(name, f.params[i].type, false);
+			names[f.params[i].identifier] = v;
+			IRNode newNode;
+			newNode.opCode = f.params[i].type == FLOAT ? "STOREF" : "STOREI";
+			newNode.op1 = args[i];
+			newNode.Result = v;
+			newNode.ifFlags = 0;
+			inits.push_back(newNode);
+		}
+	}
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		if (names.count(it->op1) == 1) it->op1 = names[it->op1];
+		if (names.count(it->op2) == 1) it->op2 = names[it->op2];
+		if (names.count(it->Result) == 1) it->Result = names[it->Result];
+	}
+	for (int i=0; i<g.retVals.size(); i++) {
+		if (names.count(g.retVals[i]) == 1) {
+			g.retVals[i] = names[g.retVals[i]];
+		}
+	}
+	nodes.front().Result = name;
+	it = nodes.begin();
+	it++;
+	it++;
+	nodes.insert(it, inits.begin(), inits.end());
+
+	fs.push_back(g);
+	functionMap[name] = nodes;
+	return name;
+}
+
+void Driver::propagateConstants(std::string fname) {
+	// Temps are only ever assigned once, so a temp holding a literal is
+	// that literal everywhere. Folding int arithmetic on literals can
+	// turn more temps into literals, so go until nothing changes.
+	std::list< IRNode> &nodes = functionMap[fname];
+	funcStruct_s f;
+	findFuncData(fname, f);
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		std::map< std::string, int> numDefs;
+		std::list< IRNode>::iterator it;
+		for (it = nodes.begin(); it != nodes.end(); it++) {
+			if (isDefinition(*it)) {
+				numDefs[it->Result]++;
+			}
+		}
+		for (it = nodes.begin(); it != nodes.end(); it++) {
+			if (it->Result.find(TEMP_VAR_PRE) == std::string::npos ||
+					numDefs[it->Result] != 1 || !isDefinition(*it) ||
+					it->ifFlags != 0) {
+				continue;
+			}
+			std::string value;
+			if (it->opCode.find("STORE") != std::string::npos &&
+					isLiteral(it->op1)) {
+				value = it->op1;
+			} else if (it->opCode[it->opCode.size()-1] == 'I' &&
+					isLiteral(it->op1) && isLiteral(it->op2) &&
+					it->op1.find('.') == std::string::npos &&
+					it->op2.find('.') == std::string::npos) {
+				long a = atol(it->op1.c_str());
+				long b = atol(it->op2.c_str());
+				long r = 0;
+				if (it->opCode == "ADDI") {
+					r = a + b;
+				} else if (it->opCode == "SUBI") {
+					r = a - b;
+				} else if (it->opCode == "MULTI") {
+					r = a * b;
+				} else if (it->opCode == "DIVI" && b != 0) {
+					r = a / b;
+				} else {
+					continue;
+				}
+				if (r < 0) {
+					// no negative literals in TINY operands, keep it
+					continue;
+				}
+				std::stringstream tstr;
+				tstr << r;
+				value = tstr.str();
+			} else {
+				continue;
+			}
+
+			// writes need a real location, so those uses keep the temp
+			std::string temp = it->Result;
+			bool stillUsed = false;
+			std::list< IRNode>::iterator uIt;
+			for (uIt = nodes.begin(); uIt != nodes.end(); uIt++) {
+				if (uIt->op1 == temp) uIt->op1 = value;
+				if (uIt->op2 == temp) uIt->op2 = value;
+				if (uIt->Result == temp && uIt->opCode == "PUSH") {
+					uIt->Result = value;
+				} else if (uIt->Result == temp && uIt != it) {
+					stillUsed = true;
+				}
+			}
+			for (int i=0; i<f.retVals.size(); i++) {
+				if (f.retVals[i] == temp) {
+					f.retVals[i] = value;
+				}
+			}
+			if (stillUsed) {
+				it->opCode = it->opCode.find("STORE") != std::string::npos ?
+							 it->opCode : "STOREI";
+				it->op1 = value;
+				it->op2 = "";
+			} else {
+				it = nodes.erase(it);
+				it--;
+			}
+			changed = true;
+		}
+	}
+	overwriteFuncData(f);
+	return;
+}
+
+void Driver::findPureFunctions() {
+	// start out assuming everything is pure and knock functions out
+	// until the call graph settles, so recursion doesn't spoil it
+	std::map< std::string, bool> pure;
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		pure[fIt->first] = true;
+		std::list< IRNode>::iterator it;
+		for (it = fIt->second.begin(); it != fIt->second.end(); it++) {
+			if (it->opCode.find("WRITE") != std::string::npos ||
+					it->opCode.find("READ") != std::string::npos ||
+					(isDefinition(*it) && isGlobalVariable(it->Result))) {
+				pure[fIt->first] = false;
+			}
+		}
+	}
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		std::map< std::string, std::set< std::string> >::iterator cIt;
+		for (cIt = callGraph.begin(); cIt != callGraph.end(); cIt++) {
+			std::set< std::string>::iterator gIt;
+			for (gIt = cIt->second.begin(); gIt != cIt->second.end(); gIt++) {
+				if (pure[cIt->first] && (pure.count(*gIt) == 0 ||
+											!pure[*gIt])) {
+					pure[cIt->first] = false;
+					changed = true;
+				}
+			}
+		}
+	}
+	for (int i=0; i<fs.size(); i++) {
+		fs[i].pure = pure.count(fs[i].name) == 1 && pure[fs[i].name];
+	}
+	return;
+}
+
+static bool mentions(std::string key, std::string var) {
+	std::istringstream tokens(key);
+	std::string token;
+	while (tokens >> token) {
+		if (token == var) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void Driver::eliminateCommonCalls(std::string fname) {
+	// Within a block, a temp that recomputes an earlier expression or an
+	// earlier call to a pure function with the same arguments is just
+	// the earlier temp.
+	std::list< IRNode> &nodes = functionMap[fname];
+	funcStruct_s f;
+	findFuncData(fname, f);
+	std::map< std::string, std::string> alias;
+	std::map< std::string, std::string> exprs;
+	std::map< std::string, std::string>::iterator eIt;
+	std::list< IRNode>::iterator it = nodes.begin();
+	while (it != nodes.end()) {
+		if (alias.count(it->op1) == 1) it->op1 = alias[it->op1];
+		if (alias.count(it->op2) == 1) it->op2 = alias[it->op2];
+		if (alias.count(it->Result) == 1 && !isDefinition(*it)) {
+			it->Result = alias[it->Result];
+		}
+
+		if (it->opCode == "LABEL") {
+			exprs.clear();
+		} else if (it->opCode == "PUSH" && it->Result.empty()) {
+			// the whole call sequence is one expression
+			std::list< IRNode>::iterator cIt = it;
+			std::stringstream key;
+			std::vector< std::string> args;
+			bool flagged = it->ifFlags != 0;
+			for (cIt++; cIt->opCode == "PUSH"; cIt++) {
+				std::string arg = alias.count(cIt->Result) == 1 ?
+								  alias[cIt->Result] : cIt->Result;
+				cIt->Result = arg;
+				args.push_back(arg);
+			}
+			std::string callee = cIt->Result;
+			key << "JSR " << callee;
+			for (int i=0; i<args.size(); i++) {
+				key << " " << args[i];
+			}
+			while (cIt->opCode != "POP" || cIt->Result.empty()) {
+				flagged = flagged || cIt->ifFlags != 0;
+				cIt++;
+			}
+			std::string retTemp = cIt->Result;
+			cIt++;
+			funcStruct_s g;
+			g.pure = false;
+			findFuncData(callee, g);
+			if (!g.pure) {
+				// it may have written any global
+				std::map< std::string, std::string> kept;
+				for (eIt = exprs.begin(); eIt != exprs.end(); eIt++) {
+					bool global = false;
+					std::istringstream tokens(eIt->first);
+					std::string token;
+					while (tokens >> token) {
+						global = global || isGlobalVariable(token);
+					}
+					if (!global && eIt->first.find("JSR ") != 0) {
+						kept[eIt->first] = eIt->second;
+					}
+				}
+				exprs = kept;
+			} else if (exprs.count(key.str()) == 1 && !flagged) {
+				alias[retTemp] = exprs[key.str()];
+				it = nodes.erase(it, cIt);
+				continue;
+			} else if (retTemp.find(TEMP_VAR_PRE) != std::string::npos) {
+				exprs[key.str()] = retTemp;
+			}
+			it = cIt;
+			continue;
+		} else if (isDefinition(*it)) {
+			// pure functions don't write globals but can read them
+			bool global = isGlobalVariable(it->Result);
+			for (eIt = exprs.begin(); eIt != exprs.end(); ) {
+				if (mentions(eIt->first, it->Result) ||
+						(global && eIt->first.find("JSR ") == 0)) {
+					exprs.erase(eIt++);
+				} else {
+					eIt++;
+				}
+			}
+			if (it->Result.find(TEMP_VAR_PRE) != std::string::npos &&
+					it->opCode.find("STORE") == std::string::npos &&
+					it->opCode != "POP" &&
+					it->opCode.find("READ") == std::string::npos) {
+				std::string key = it->opCode + " " + it->op1 + " " + it->op2;
+				if (exprs.count(key) == 1 && it->ifFlags == 0) {
+					alias[it->Result] = exprs[key];
+					it = nodes.erase(it);
+					continue;
+				}
+				exprs[key] = it->Result;
+			}
+		}
+		it++;
+	}
+	for (int i=0; i<f.retVals.size(); i++) {
+		if (alias.count(f.retVals[i]) == 1) {
+			f.retVals[i] = alias[f.retVals[i]];
+		}
+	}
+	overwriteFuncData(f);
+	return;
+}
+
+void Driver::performInterproceduralOpts() {
+	// specialize callees for the literal arguments at each call site,
+	// one clone per callee and pattern of literals
+	std::map< std::string, std::string> clones;
+	std::vector< std::string> names;
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		names.push_back(fIt->first);
+	}
+	for (int n=0; n<names.size(); n++) {
+		std::list< IRNode> &nodes = functionMap[names[n]];
+		std::list< IRNode>::iterator it;
+		for (it = nodes.begin(); it != nodes.end(); it++) {
+			if (it->opCode != "PUSH" || !it->Result.empty()) {
+				continue;
+			}
+			std::vector< std::string> args;
+			std::vector< std::list< IRNode>::iterator> pushes;
+			std::list< IRNode>::iterator cIt = it;
+			for (cIt++; cIt->opCode == "PUSH"; cIt++) {
+				args.insert(args.begin(), cIt->Result);
+				pushes.insert(pushes.begin(), cIt);
+			}
+			std::string callee = cIt->Result;
+			funcStruct_s f;
+			findFuncData(callee, f);
+			std::stringstream key;
+			key << callee;
+			int numLiterals = 0;
+			for (int i=0; i<args.size(); i++) {
+				if (isLiteral(args[i])) {
+					key << " " << args[i];
+					numLiterals++;
+				} else {
+					key << " _";
+				}
+			}
+			if (numLiterals == 0 || callee == "main" ||
+					functionMap.count(callee) == 0 ||
+					args.size() != f.params.size() ||
+					getInlineCost(functionMap[callee]) > SPECIALIZE_THRESHOLD) {
+				continue;
+			}
+			if (clones.count(key.str()) == 0) {
+				clones[key.str()] = cloneFunction(callee, args);
+				propagateConstants(clones[key.str()]);
+			}
+
+			// drop the literal pushes and as many of the arg pops
+			cIt->Result = clones[key.str()];
+			std::list< IRNode>::iterator pIt = cIt;
+			pIt++;
+			for (int i=0; i<args.size(); i++) {
+				if (isLiteral(args[i])) {
+					nodes.erase(pushes[i]);
+					pIt = nodes.erase(pIt);
+				}
+			}
+		}
+	}
+
+	buildCallGraph();
+	findPureFunctions();
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		eliminateCommonCalls(fIt->first);
+	}
+	return;
+}
+
+void Driver::removeDeadFunctions() {
+	// everything that can't be reached from main
+	std::set< std::string> reached;
+	std::vector< std::string> work;
+	work.push_back("main");
+	while (!work.empty()) {
+		std::string f = work.back();
+		work.pop_back();
+		if (reached.count(f) == 1) {
+			continue;
+		}
+		reached.insert(f);
+		std::set< std::string>::iterator it;
+		for (it = callGraph[f].begin(); it != callGraph[f].end(); it++) {
+			work.push_back(*it);
+		}
+	}
+	std::vector< funcStruct_s>::iterator fIt = fs.begin();
+	while (fIt != fs.end()) {
+		if (reached.count(fIt->name) == 0) {
+			functionMap.erase(fIt->name);
+			callGraph.erase(fIt->name);
+			fIt = fs.erase(fIt);
+		} else {
+			fIt++;
+		}
+	}
+	return;
+}
+
+bool Driver::isRecursive(std::string fname) {
+	std::set< std::string> seen;
+	std::vector< std::string> work(callGraph[fname].begin(),
+								   callGraph[fname].end());
+	while (!work.empty()) {
+		std::string f = work.back();
+		work.pop_back();
+		if (f == fname) {
+			return true;
+		}
+		if (seen.count(f) == 1) {
+			continue;
+		}
+		seen.insert(f);
+		work.insert(work.end(), callGraph[f].begin(), callGraph[f].end());
+	}
+	return false;
+}
+
+bool Driver::isDefinedBeforeUse(std::list< IRNode> &nodes, std::string var) {
+	// true when the straight line code at the top of the function writes
+	// var before anything reads it, so no value comes in from a caller
+	std::list< IRNode>::iterator it = nodes.begin();
+	for (it++; it != nodes.end(); it++) {
+		if (it->opCode == "LINK" || it->opCode == "JSR" ||
+				(it->opCode == "POP" && it->Result.empty())) {
+			continue;
+		}
+		if (it->op1 == var || it->op2 == var) {
+			return false;
+		}
+		if (isDefinition(*it)) {
+			if (it->Result == var) {
+				return true;
+			}
+		} else if (it->opCode == "PUSH" ||
+				   it->opCode.find("WRITE") != std::string::npos) {
+			if (it->Result == var) {
+				return false;
+			}
+		} else {
+			// a branch, label or return
+			return false;
+		}
+	}
+	return false;
+}
+
+void Driver::localizeGlobals() {
+	// which functions touch each global
+	std::map< std::string, std::set< std::string> > users;
+	std::vector< VarStruct_s>::iterator vIt;
+	for (vIt = symbolTable[0].begin(); vIt != symbolTable[0].end(); vIt++) {
+		users[vIt->identifier].clear();
+	}
+	for (int i=0; i<fs.size(); i++) {
+		std::list< IRNode> &nodes = functionMap[fs[i].name];
+		std::list< IRNode>::iterator it;
+		for (it = nodes.begin(); it != nodes.end(); it++) {
+			if (users.count(it->op1) == 1) users[it->op1].insert(fs[i].name);
+			if (users.count(it->op2) == 1) users[it->op2].insert(fs[i].name);
+			if (users.count(it->Result) == 1 && it->opCode != "LABEL" &&
+					it->opCode != "JSR") {
+				users[it->Result].insert(fs[i].name);
+			}
+		}
+		for (int j=0; j<fs[i].retVals.size(); j++) {
+			if (users.count(fs[i].retVals[j]) == 1) {
+				users[fs[i].retVals[j]].insert(fs[i].name);
+			}
+		}
+	}
+
+	// unused globals go away, and a global only one function uses becomes
+	// one of its locals as long as it never carries a value between calls
+	vIt = symbolTable[0].begin();
+	while (vIt != symbolTable[0].end()) {
+		std::set< std::string> &u = users[vIt->identifier];
+		if (u.empty()) {
+			vIt = symbolTable[0].erase(vIt);
+			continue;
+		}
+		std::string fname = *u.begin();
+		// the -live allocator doesn't follow values around a loop, and
+		// never gives globals a register, so keep those as they are
+		if (u.size() > 1 || vIt->type == STRING || isRecursive(fname) ||
+				(liveness && hasLoop(functionMap[fname])) ||
+				!isDefinedBeforeUse(functionMap[fname], vIt->identifier)) {
+			vIt++;
+			continue;
+		}
+		std::string global = vIt->identifier;
+		std::string local = createScopedVar(fname, vIt->type, false);
+		std::list< IRNode> &nodes = functionMap[fname];
+		std::list< IRNode>::iterator it;
+		for (it = nodes.begin(); it != nodes.end(); it++) {
+			if (it->op1 == global) it->op1 = local;
+			if (it->op2 == global) it->op2 = local;
+			if (it->Result == global && it->opCode != "LABEL" &&
+					it->opCode != "JSR") {
+				it->Result = local;
+			}
+		}
+		funcStruct_s f;
+		findFuncData(fname, f);
+		for (int j=0; j<f.retVals.size(); j++) {
+			if (f.retVals[j] == global) {
+				f.retVals[j] = local;
+			}
+		}
+		overwriteFuncData(f);
+		vIt = symbolTable[0].erase(vIt);
+	}
+	return;
+}
+
+void Driver::performWholeProgramOpts() {
+	if (functionMap.count("main") == 0) {
+		return;
+	}
+	buildCallGraph();
+	removeDeadFunctions();
+	localizeGlobals();
+	return;
+}
+
+} // namespace little
@@ -0,0 +1,71 @@
+/* The backend's thread pool. After the IR passes every function's liveness,
+ * register allocation and code generation only read the shared tables, so
+ * each function is a task of its own and the results go back in order. */
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "driver.h"
+
+namespace little {
+
+struct ParallelWork {
+	Driver *driver;
+	void (Driver::*task)(int);
+	int count;
+	int next; // the next task nobody has taken
+	pthread_mutex_t lock;
+};
+
+static void *parallelWorker(void *arg) {
+	ParallelWork *work = (ParallelWork *)arg;
+	while (true) {
+		pthread_mutex_lock(&work->lock);
+		int i = work->next++;
+		pthread_mutex_unlock(&work->lock);
+		if (i >= work->count) {
+			break;
+		}
+		(work->driver->*work->task)(i);
+	}
+	return NULL;
+}
+
+void Driver::setThreads(int n) {
+	numThreads = n;
+}
+
+void Driver::runParallel(int count, void (Driver::*task)(int)) {
+	int n = numThreads;
+	if (n <= 0) {
+		n = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if (n > count) {
+		n = count;
+	}
+	ParallelWork work;
+	work.driver = this;
+	work.task = task;
+	work.count = count;
+	work.next = 0;
+	pthread_mutex_init(&work.lock, NULL);
+
+	// this thread is one of the workers, and if a thread can't be had
+	// the ones there are take up its share
+	std::vector< pthread_t> threads;
+	for (int i=1; i<n; i++) {
+		pthread_t t;
+		if (pthread_create(&t, NULL, parallelWorker, &work) != 0) {
+			break;
+		}
+		threads.push_back(t);
+	}
+	parallelWorker(&work);
+	for (int i=0; i<threads.size(); i++) {
+		pthread_join(threads[i], NULL);
+	}
+	pthread_mutex_destroy(&work.lock);
+	return;
+}
+
+} // namespace little
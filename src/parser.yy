@@ -5,6 +5,7 @@
 	#include <cstdio>
 	#include <string>
 	#include <vector>
+	#include <stack>
 %}
 
 /*** yacc/bison Declarations ***/
@@ -68,18 +69,11 @@
 	 * from the current lexer object of the driver context. */
 	#undef yylex
 	#define yylex driver.lexer->lex
-	
-	std::vector< std::string> multiVars;
-	bool dontPush = false;
-	bool last_stmt = false;
-	std::vector< std::string> tempTreeStack;
-	int numParamsWorry = 0;
-	int numCommas = 0;
 %}
 
 %% /* RULES */
     /* Program */
-program : PROGRAM id TBEGIN pgm_body END {};
+program : PROGRAM id TBEGIN pgm_body END { driver.finishStream(); };
 id : IDENTIFIER {$$ = $1; };
 pgm_body : decl func_declarations {  }
 			| decl {  };
@@ -99,25 +93,25 @@ str : STRINGLITERAL {$$ = $1; };
 var_decl_list : var_decl_list var_decl_tail {}
             | var_decl_tail {};
 var_decl_tail : var_type id_list_part SEMICOLON {
-					for (int i=0; i<multiVars.size(); i++)
+					for (int i=0; i<driver.multiVars.size(); i++)
 					{
 						driver.insertSymbolTableEntry((littleTypes)$1,
-															 multiVars[i]);
+															 driver.multiVars[i]);
 					}
-					multiVars.clear();
+					driver.multiVars.clear();
 				};
 var_type : FLOAT  { $$ = FLOAT;
-					multiVars.clear(); }
+					driver.multiVars.clear(); }
             | INT { $$ = INT; 
-                    multiVars.clear(); };
+                    driver.multiVars.clear(); };
 any_type : var_type { $$ = $1; 
-					  multiVars.clear(); }
+					  driver.multiVars.clear(); }
             | VOID { $$ = VOID; 
-            		 multiVars.clear(); };
-id_list_part : id_list id { multiVars.push_back(*$2); $$ = $2; }
-            | id { multiVars.push_back(*$1); $$ = $1; } ;
-id_list : id_list id COMMA { multiVars.push_back(*$2); }
-            | id COMMA { multiVars.push_back(*$1); };
+            		 driver.multiVars.clear(); };
+id_list_part : id_list id { driver.multiVars.push_back(*$2); $$ = $2; }
+            | id { driver.multiVars.push_back(*$1); $$ = $1; } ;
+id_list : id_list id COMMA { driver.multiVars.push_back(*$2); }
+            | id COMMA { driver.multiVars.push_back(*$1); };
 
     /* Function Paramater List */
 param_decl_list : param_decl param_decl_tail {  } ;
@@ -129,10 +123,13 @@ param_decl_tail : COMMA param_decl param_decl_tail {}
 func_declarations : func_decl func_declarations {}
             | func_decl {};
 func_decl : func_begin LPAREN param_decl_list RPAREN TBEGIN func_body END {
-					driver.addReturnToFunc((littleTypes)$1); }
+					driver.addReturnToFunc((littleTypes)$1);
+					driver.streamFunction(driver.scope); }
             | func_begin LPAREN RPAREN TBEGIN func_body END
-              { driver.addReturnToFunc((littleTypes)$1); };
+              { driver.addReturnToFunc((littleTypes)$1);
+                driver.streamFunction(driver.scope); };
 func_begin : TFUNCTION any_type id {driver.setScope(*$3);
+				driver.lookupFunctionSource(*$3);
 				driver.curNode.opCode = "LABEL";
 				driver.curNode.Result = *$3; 
 				driver.pushBackCurNode();
@@ -141,7 +138,7 @@ func_begin : TFUNCTION any_type id {driver.setScope(*$3);
 				driver.pushBackCurNode();
 				driver.createFunction(*$3); 
 				$$ = $2; };
-func_body : decl stmt_list { if (last_stmt == false) { // for funcs w/o return
+func_body : decl stmt_list { if (driver.last_stmt == false) { // for funcs w/o return
 								driver.curNode.opCode = "RETURN";
 								driver.pushBackCurNode();
 								driver.addRetVal("");
@@ -149,32 +146,33 @@ func_body : decl stmt_list { if (last_stmt == false) { // for funcs w/o return
 							 driver.functionMap[driver.scope] = 
 							 					driver.subNodeList;
 							 driver.subNodeList.clear();
-							 dontPush = false; };
+							 driver.skippingIR = false;
+							 driver.dontPush = false; };
 
     /* Statement List */
 stmt_list : stmt stmt_list {}
             | /* empty */;
 stmt : assign_stmt { driver.pushBackCurNode();
 					 driver.treeStack.clear();
-					 multiVars.clear();
-					 last_stmt = false; }
+					 driver.multiVars.clear();
+					 driver.last_stmt = false; }
             | read_stmt { driver.pushBackCurNode();
             			driver.treeStack.clear();
-            			multiVars.clear();
-            			last_stmt = false; }
+            			driver.multiVars.clear();
+            			driver.last_stmt = false; }
             | write_stmt { driver.pushBackCurNode();
             			driver.treeStack.clear();
-            			multiVars.clear();
-            			last_stmt = false; }
+            			driver.multiVars.clear();
+            			driver.last_stmt = false; }
             | return_stmt { driver.treeStack.clear();
-            			multiVars.clear();
-            			last_stmt = true; }
+            			driver.multiVars.clear();
+            			driver.last_stmt = true; }
             | if_stmt { driver.treeStack.clear();
-            			multiVars.clear();
-            			last_stmt = false; }
+            			driver.multiVars.clear();
+            			driver.last_stmt = false; }
             | do_stmt { driver.treeStack.clear();
-            			multiVars.clear();
-            			last_stmt = false; };
+            			driver.multiVars.clear();
+            			driver.last_stmt = false; };
 
     /* Basic Statements */
 assign_stmt : assign_expr SEMICOLON {  };
@@ -185,19 +183,19 @@ assign_expr_butt : ASSIGN expr { driver.interpretTree();
 				driver.curNode.op1 = driver.treeStack[0];
 				driver.treeStack.clear(); };
 read_stmt : READ LPAREN id_list_part RPAREN SEMICOLON { 
-				for (int i=0; i<multiVars.size()-1; i++)
+				for (int i=0; i<driver.multiVars.size()-1; i++)
 				{
 					driver.curNode.opCode = "READ";
-					driver.curNode.Result = multiVars[i];
+					driver.curNode.Result = driver.multiVars[i];
 					driver.pushBackCurNode();
 				}
 				driver.curNode.opCode = "READ";
 				driver.curNode.Result = *$3; };
 write_stmt : WRITE LPAREN id_list_part RPAREN SEMICOLON { 
-				for (int i=0; i<multiVars.size()-1; i++)
+				for (int i=0; i<driver.multiVars.size()-1; i++)
 				{
 					driver.curNode.opCode = "WRITE";
-					driver.curNode.Result = multiVars[i];
+					driver.curNode.Result = driver.multiVars[i];
 					driver.pushBackCurNode();
 				}
 				driver.curNode.opCode = "WRITE";
@@ -223,28 +221,30 @@ factor_tail : mulop postfix_expr factor_tail {  }
             | /* empty */;
 postfix_expr : primary {  }
             | call_expr { driver.curNode.opCode = "JSR";
+            			  little::littleTypes retType =
+            			  			driver.getCallType(driver.curNode.Result);
             			  driver.pushBackCurNode();
-            			  driver.popParams(numParamsWorry);
-            			  numParamsWorry = 0;
+            			  driver.popParams(driver.numParamsWorry);
+            			  driver.numParamsWorry = 0;
             			  driver.fs[driver.fs.size()-1].assVar =
-            			  			driver.createTempVar(little::FLOAT);
+            			  			driver.createTempVar(retType);
             			  // pop return value
             			  driver.popRetVal();
             			  driver.treeStack.push_back(driver.fs[driver.fs.size()-1].assVar);
-						  multiVars.clear(); };
+						  driver.multiVars.clear(); };
 call_expr : call_expr_head expr_list RPAREN { 
 						driver.curNode.opCode = "PUSH";
 						driver.curNode.op1 = "";
 						driver.curNode.op2 = "";
 						driver.curNode.Result = "";
 						driver.pushBackCurNode();
-						driver.pushParams(multiVars);
-						numParamsWorry = multiVars.size();
+						driver.pushParams(driver.callArgs.top());
+						driver.numParamsWorry = driver.callArgs.top().size();
+						driver.callArgs.pop();
 						driver.curNode.Result = *$1;
 						
-						driver.treeStack.clear();
-						driver.treeStack.insert(driver.treeStack.begin(), tempTreeStack.begin(), tempTreeStack.end());
-						tempTreeStack.clear();
+						driver.treeStack = driver.savedTreeStacks.top();
+						driver.savedTreeStacks.pop();
 					}
             | id LPAREN RPAREN { driver.curNode.opCode = "PUSH";
 								 driver.curNode.op1 = "";
@@ -253,36 +253,25 @@ call_expr : call_expr_head expr_list RPAREN {
 								 driver.pushBackCurNode();
             					 driver.curNode.Result = *$1; };
 call_expr_head :  id LPAREN {
-								tempTreeStack = driver.treeStack;
+								driver.savedTreeStacks.push(driver.treeStack);
 								driver.treeStack.clear();
+								driver.callArgs.push(std::vector< std::string>());
 								$$ = $1;
 							}
-expr_list : expr expr_list_tail { 
-								  if (numCommas == 0 &&
-								  		!driver.treeStack.empty())
-								  {
-								      driver.interpretTree();
-								      multiVars.clear();
-								      multiVars.push_back(driver.treeStack[0]);
-								  }
-								  numCommas = 0; };
-expr_list_tail : COMMA expr expr_list_tail { 
-						driver.interpretTree();
-						multiVars.push_back(driver.treeStack[0]);
-						for (int i=numCommas; i<multiVars.size()-1; i++) {
-							multiVars.erase(multiVars.begin());
-						}
-						numCommas++;
-						}
+expr_list : arg_expr expr_list_tail {  };
+expr_list_tail : COMMA arg_expr expr_list_tail {  }
             | /* empty */;
+arg_expr : expr { driver.interpretTree();
+				  driver.callArgs.top().push_back(driver.treeStack[0]);
+				  driver.treeStack.clear(); };
 start_primary_paren : LPAREN { driver.treeStack.push_back("("); };
 primary : start_primary_paren expr RPAREN { driver.treeStack.push_back(")"); }
             | id { driver.treeStack.push_back(*$1);
-            	   multiVars.push_back(*$1);   }
+            	   driver.multiVars.push_back(*$1);   }
             | INTLITERAL { driver.treeStack.push_back(*$1);
-            	   multiVars.push_back(*$1); }
+            	   driver.multiVars.push_back(*$1); }
             | FLOATLITERAL { driver.treeStack.push_back(*$1);
-            	   multiVars.push_back(*$1); };
+            	   driver.multiVars.push_back(*$1); };
 addop : PLUS { driver.treeStack.push_back("ADD"); }
             | MINUS { driver.treeStack.push_back("SUB"); };
 mulop : MULT { driver.treeStack.push_back("MULT"); } 
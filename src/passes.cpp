@@ -0,0 +1,195 @@
+/* The pass manager. Every IR pass has a line in the table below, and the
+ * pipeline is the list of names to run, in order. A pass either works on
+ * the whole program or is handed one function at a time; only the second
+ * kind can run with -stream. -O picks the passes up to a level, the old
+ * flags and -passes= name them, and -time shows what each one cost. */
+
+#include <algorithm>
+#include <sys/time.h>
+
+#include "driver.h"
+
+namespace little {
+
+// in the order they run when picked by level or flag
+const Driver::PassInfo Driver::passes[] = {
+	{"tailcall", 1, NULL, &Driver::eliminateTailCalls},
+	{"ipa", 2, &Driver::performInterproceduralOpts, NULL},
+	{"inline", 2, &Driver::performInlining, NULL},
+	{"wholeprogram", 2, &Driver::performWholeProgramOpts, NULL},
+	{"layout", 1, NULL, &Driver::layoutFunction}
+};
+const int Driver::numPasses = sizeof(passes) / sizeof(passes[0]);
+
+static double passClock() {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec*1000.0 + tv.tv_usec/1000.0;
+}
+
+const Driver::PassInfo *Driver::findPass(std::string name) {
+	for (int i=0; i<numPasses; i++) {
+		if (name == passes[i].name) {
+			return &passes[i];
+		}
+	}
+	*errStream << "unknown pass " << name << ", the passes are:";
+	for (int i=0; i<numPasses; i++) {
+		*errStream << " " << passes[i].name;
+	}
+	*errStream << std::endl;
+	return NULL;
+}
+
+bool Driver::enablePass(std::string name) {
+	const PassInfo *p = findPass(name);
+	if (p == NULL) {
+		return false;
+	}
+	// goes in front of the first one that comes after it in the table
+	std::vector< std::string>::iterator it;
+	for (it = pipeline.begin(); it != pipeline.end(); it++) {
+		if (*it == name) {
+			return true;
+		}
+		if (findPass(*it) > p) {
+			break;
+		}
+	}
+	pipeline.insert(it, name);
+	tailCalls = tailCalls || name == "tailcall";
+	return true;
+}
+
+bool Driver::setPipeline(std::string names) {
+	// a comma separated list, run as given
+	pipeline.clear();
+	tailCalls = false;
+	std::stringstream ss(names);
+	std::string name;
+	while (std::getline(ss, name, ',')) {
+		if (name.empty()) {
+			continue;
+		}
+		if (findPass(name) == NULL) {
+			return false;
+		}
+		pipeline.push_back(name);
+		tailCalls = tailCalls || name == "tailcall";
+	}
+	return true;
+}
+
+bool Driver::setPrintAfter(std::string name) {
+	if (name != "all" && findPass(name) == NULL) {
+		return false;
+	}
+	printAfter.insert(name);
+	return true;
+}
+
+void Driver::setOptLevel(int level) {
+	for (int i=0; i<numPasses; i++) {
+		if (passes[i].level > 0 && passes[i].level <= level) {
+			enablePass(passes[i].name);
+		}
+	}
+	// -live stays its own flag, the levels keep the default temp pool
+}
+
+std::string Driver::getPipeline() {
+	std::string s;
+	for (int i=0; i<pipeline.size(); i++) {
+		s += (i > 0 ? "," : "") + pipeline[i];
+	}
+	return s;
+}
+
+bool Driver::hasModulePasses() {
+	for (int i=0; i<pipeline.size(); i++) {
+		if (findPass(pipeline[i])->runModule != NULL) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static long long countNodes(std::map< std::string, std::list< IRNode> > &m) {
+	long long n = 0;
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = m.begin(); fIt != m.end(); fIt++) {
+		n += fIt->second.size();
+	}
+	return n;
+}
+
+void Driver::printPassIR(std::string pass, std::string fname,
+						 std::list< IRNode> &nodes) {
+	if (printAfter.count(pass) == 0 && printAfter.count("all") == 0) {
+		return;
+	}
+	*errStream << "; " << fname << " after " << pass << std::endl;
+	printNodes(*errStream, nodes, false);
+}
+
+void Driver::runPasses() {
+	for (int i=0; i<pipeline.size(); i++) {
+		const PassInfo *p = findPass(pipeline[i]);
+		double start = passClock();
+		long long before = countNodes(functionMap);
+		if (p->runModule != NULL) {
+			(this->*p->runModule)();
+		} else {
+			std::map< std::string, std::list< IRNode> >::iterator fIt;
+			for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+				// a hit found while parsing has its code and no IR
+				if (cachedTiny.count(fIt->first) == 0) {
+					(this->*p->runFunction)(fIt->first, fIt->second);
+				}
+			}
+		}
+		PassStats &s = passStats[p->name];
+		s.ms += passClock() - start;
+		s.removed += before - countNodes(functionMap);
+		std::map< std::string, std::list< IRNode> >::iterator fIt;
+		for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+			printPassIR(p->name, fIt->first, fIt->second);
+		}
+	}
+	return;
+}
+
+void Driver::runFunctionPasses(std::string fname, std::list< IRNode> &nodes) {
+	// for -stream, which has already turned away the whole program ones
+	for (int i=0; i<pipeline.size(); i++) {
+		const PassInfo *p = findPass(pipeline[i]);
+		if (p->runFunction == NULL) {
+			continue;
+		}
+		double start = passClock();
+		long long before = nodes.size();
+		(this->*p->runFunction)(fname, nodes);
+		PassStats &s = passStats[p->name];
+		s.ms += passClock() - start;
+		s.removed += before - (long long)nodes.size();
+		printPassIR(p->name, fname, nodes);
+	}
+	return;
+}
+
+void Driver::printPassStats() {
+	for (int i=0; i<pipeline.size(); i++) {
+		// a pass named twice was counted as one
+		if (passStats.count(pipeline[i]) == 0 ||
+				std::find(pipeline.begin(), pipeline.begin() + i,
+						  pipeline[i]) != pipeline.begin() + i) {
+			continue;
+		}
+		PassStats &s = passStats[pipeline[i]];
+		*errStream << "pass " << pipeline[i] << ": " << s.ms << " ms, "
+				   << s.removed << " IR nodes removed" << std::endl;
+	}
+	return;
+}
+
+} // namespace little
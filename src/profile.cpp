@@ -0,0 +1,236 @@
+/* Block execution profiles, and the passes they drive. A profile is
+ * a text file with a "function label count" line for every label, written
+ * by micro --run -profile-gen and read back by -profile-use. */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+
+#include "driver.h"
+
+#define PROFILE_HOT_PERCENT 5 // of the hottest block, to count as hot
+
+namespace little {
+
+void Driver::setProfileGen(std::string filename) {
+	profileGen = filename;
+}
+
+bool Driver::loadProfile(std::string filename) {
+	std::ifstream is(filename.c_str());
+	if (!is) {
+		*errStream << "could not open profile " << filename << std::endl;
+		return false;
+	}
+	profile.clear();
+	profileMax = 0;
+	std::string line;
+	int lineNumber = 0;
+	while (std::getline(is, line)) {
+		lineNumber++;
+		if (line.empty() || line[0] == '#') {
+			continue;
+		}
+		std::istringstream ls(line);
+		std::string fname;
+		std::string label;
+		long long count;
+		if (!(ls >> fname >> label >> count) || count < 0) {
+			*errStream << filename << ":" << lineNumber
+					  << ": expected function label count" << std::endl;
+			return false;
+		}
+		profile[fname][label] = count;
+		if (count > profileMax) {
+			profileMax = count;
+		}
+	}
+	return true;
+}
+
+void Driver::writeProfile(std::map< std::string, unsigned long long> &counts) {
+	// labels are global in TINY, so the IR says whose each one is
+	std::ofstream os(profileGen.c_str());
+	if (!os) {
+		*errStream << "could not write profile " << profileGen << std::endl;
+		return;
+	}
+	os << "# function label count" << std::endl;
+	std::map< std::string, std::list< IRNode> >::iterator fIt;
+	for (fIt = functionMap.begin(); fIt != functionMap.end(); fIt++) {
+		std::list< IRNode>::iterator it;
+		for (it = fIt->second.begin(); it != fIt->second.end(); it++) {
+			if (it->opCode == "LABEL" && counts.count(it->Result) == 1) {
+				os << fIt->first << " " << it->Result << " "
+				   << counts[it->Result] << std::endl;
+			}
+		}
+	}
+	return;
+}
+
+long long Driver::getLabelCount(std::string fname, std::string label) {
+	// -1 if the profile never saw it
+	std::map< std::string, std::map< std::string, long long> >::iterator fIt;
+	fIt = profile.find(fname);
+	if (fIt == profile.end() || fIt->second.count(label) == 0) {
+		return -1;
+	}
+	return fIt->second[label];
+}
+
+long long Driver::getBlockCount(std::string fname, std::list< IRNode> &nodes,
+								std::list< IRNode>::iterator it) {
+	// straight line code runs as often as the label it follows
+	if (profile.empty()) {
+		return -1;
+	}
+	while (it != nodes.begin()) {
+		it--;
+		if (it->opCode == "LABEL") {
+			return getLabelCount(fname, it->Result);
+		}
+	}
+	return -1;
+}
+
+bool Driver::isHotCount(long long hits) {
+	return hits > 0 && hits*100 >= profileMax*PROFILE_HOT_PERCENT;
+}
+
+void Driver::findVarWeights(std::string fname, std::list< IRNode> &nodes,
+							std::map< std::string, long long> &weights) {
+	// every use or def of a variable, times how often it ran
+	weights.clear();
+	if (profile.empty()) {
+		return;
+	}
+	long long hits = 0;
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		if (it->opCode == "LABEL") {
+			long long count = getLabelCount(fname, it->Result);
+			if (count >= 0) {
+				hits = count;
+			}
+			continue;
+		}
+		if (!it->op1.empty()) weights[it->op1] += hits;
+		if (!it->op2.empty()) weights[it->op2] += hits;
+		if (!it->Result.empty() && !isBranch(it->opCode) &&
+				it->opCode != "JUMP" && it->opCode != "JSR") {
+			weights[it->Result] += hits;
+		}
+	}
+	return;
+}
+
+void Driver::layoutIfElse(std::string fname, std::list< IRNode> &nodes,
+						  std::list< IRNode>::iterator condIt) {
+	// cond (jumps to else), then, JUMP end, LABEL else, else, LABEL end;
+	// find this IF's else and end past any nested ones
+	std::list< IRNode>::iterator elseIt = nodes.end();
+	std::list< IRNode>::iterator endIt = nodes.end();
+	std::list< IRNode>::iterator it = condIt;
+	int depth = 0;
+	for (it++; it != nodes.end(); it++) {
+		if (it->ifFlags == 1) {
+			depth++;
+		} else if (it->ifFlags == 2 && depth == 0) {
+			elseIt = it;
+		} else if (it->ifFlags == 3) {
+			if (depth == 0) {
+				endIt = it;
+				break;
+			}
+			depth--;
+		}
+	}
+	if (elseIt == nodes.end() || endIt == nodes.end() ||
+			elseIt->Result != condIt->Result) {
+		return;
+	}
+	std::list< IRNode>::iterator jumpIt = elseIt;
+	jumpIt--;
+	if (jumpIt->opCode != "JUMP" || jumpIt->Result != endIt->Result) {
+		return;
+	}
+
+	// the else label only runs when the branch is taken
+	long long total = getBlockCount(fname, nodes, condIt);
+	long long elseHits = getLabelCount(fname, elseIt->Result);
+	if (total < 0 || elseHits < 0 || total - elseHits <= elseHits) {
+		return;
+	}
+
+	// a taken branch costs tiny no more than one that falls through, but
+	// the first body pays for the JUMP past the second, so the hot body
+	// goes second and runs straight into the end. Swap the bodies and
+	// the sense of the test; the IF/ELSE/ENDIF flags stay put for liveness
+	std::list< IRNode>::iterator thenIt = condIt;
+	thenIt++;
+	std::list< IRNode>::iterator elseBodyIt = elseIt;
+	elseBodyIt++;
+	condIt->opCode = invertBranch(condIt->opCode);
+	nodes.splice(thenIt, nodes, elseBodyIt, endIt);
+	nodes.splice(endIt, nodes, thenIt, jumpIt);
+	profile[fname][elseIt->Result] = total - elseHits;
+	return;
+}
+
+void Driver::rotateLoop(std::string fname, std::list< IRNode> &nodes,
+						std::list< IRNode>::iterator jumpIt) {
+	// a DO-WHILE ends cond (jumps to exit), JUMP top, LABEL exit; turn
+	// that around so the back edge is the one branch and the exit falls
+	// through
+	if (jumpIt == nodes.begin()) {
+		return;
+	}
+	std::list< IRNode>::iterator condIt = jumpIt;
+	condIt--;
+	std::list< IRNode>::iterator exitIt = jumpIt;
+	exitIt++;
+	if (exitIt == nodes.end() || !isBranch(condIt->opCode) ||
+			condIt->ifFlags != 0 || exitIt->opCode != "LABEL" ||
+			exitIt->ifFlags != 0 || condIt->Result != exitIt->Result) {
+		return;
+	}
+	// only backwards jumps, to a loop the profile saw run
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != jumpIt; it++) {
+		if (it->opCode == "LABEL" && it->Result == jumpIt->Result) {
+			break;
+		}
+	}
+	if (it == jumpIt || getLabelCount(fname, jumpIt->Result) <= 0) {
+		return;
+	}
+	condIt->opCode = invertBranch(condIt->opCode);
+	condIt->Result = jumpIt->Result;
+	nodes.erase(jumpIt);
+	return;
+}
+
+void Driver::layoutFunction(std::string fname, std::list< IRNode> &nodes) {
+	if (profile.empty()) {
+		return;
+	}
+	std::list< IRNode>::iterator it = nodes.begin();
+	while (it != nodes.end()) {
+		// whatever ends up after an IF is still to be looked at, but
+		// rotating a loop erases the JUMP
+		std::list< IRNode>::iterator next = it;
+		next++;
+		if (isBranch(it->opCode) && it->ifFlags == 1) {
+			layoutIfElse(fname, nodes, it);
+			next = it;
+			next++;
+		} else if (it->opCode == "JUMP") {
+			rotateLoop(fname, nodes, it);
+		}
+		it = next;
+	}
+	return;
+}
+
+} // namespace little
@@ -0,0 +1,200 @@
+/* Registers for the temporaries when there's no -live. Every temp gets the
+ * range of IR nodes from its first mention to its last, stretched over any
+ * loop it's live around, and the ranges take the registers below the
+ * scratch one in the order they start (a linear scan). When they run out,
+ * whichever range ends last goes to a stack slot after the locals. Ranges
+ * include both ends, so a node's result only shares a register with its
+ * first operand, when that dies there: the code moves op1 into the result
+ * before op2 is read. */
+
+#include <algorithm>
+
+#include "driver.h"
+
+namespace little {
+
+struct TempRange {
+	std::string id;
+	int start;
+	int end;
+};
+
+static bool startsBefore(const TempRange &a, const TempRange &b) {
+	if (a.start != b.start) {
+		return a.start < b.start;
+	}
+	return a.id < b.id;
+}
+
+void Driver::allocateTempRegisters(std::string fname,
+								   std::list< IRNode> &nodes) {
+	int scopeNum = getScopeNumber(fname);
+	if (symbolTable.count(scopeNum) == 0) {
+		return;
+	}
+	std::vector< VarStruct_s> &vars = symbolTable[scopeNum];
+	funcStruct_s f;
+	findFuncData(fname, f);
+
+	std::map< std::string, int> index; // temp -> its entry in vars
+	for (int i=0; i<vars.size(); i++) {
+		if (vars[i].identifier.find(TEMP_VAR_PRE) == 0) {
+			index[vars[i].identifier] = i;
+		}
+	}
+
+	std::map< std::string, TempRange> ranges;
+	std::map< std::string, int> labels;
+	std::vector< std::pair< int, std::string> > jumps;
+	std::vector< std::string> args; // read again by the JSR's moves
+	std::map< int, std::pair< std::string, std::string> > handOver;
+	int numRets = 0;
+	int i = 0;
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++, i++) {
+		std::vector< std::string> ids;
+		ids.push_back(it->op1);
+		ids.push_back(it->op2);
+		ids.push_back(it->Result);
+		if (index.count(it->op1) == 1 && index.count(it->Result) == 1 &&
+				it->op2 != it->op1) {
+			handOver[i] = std::make_pair(it->op1, it->Result);
+		}
+		if (it->opCode == "LABEL") {
+			labels[it->Result] = i;
+		} else if (it->opCode == "JUMP" || isBranch(it->opCode)) {
+			jumps.push_back(std::make_pair(i, it->Result));
+		} else if (it->opCode == "PUSH" && index.count(it->Result) == 1) {
+			args.push_back(it->Result);
+		} else if (it->opCode == "JSR") {
+			ids.insert(ids.end(), args.begin(), args.end());
+			args.clear();
+		} else if (it->opCode == "RETURN" && numRets < f.retVals.size()) {
+			ids.push_back(f.retVals[numRets++]);
+		}
+		for (int k=0; k<ids.size(); k++) {
+			if (index.count(ids[k]) == 0) {
+				continue;
+			}
+			if (ranges.count(ids[k]) == 0) {
+				TempRange r;
+				r.id = ids[k];
+				r.start = i;
+				ranges[ids[k]] = r;
+			}
+			ranges[ids[k]].end = i;
+		}
+	}
+
+	// a temp that comes into a loop from before it is live all the way
+	// round to the jump back
+	bool changed = true;
+	while (changed) {
+		changed = false;
+		for (int j=0; j<jumps.size(); j++) {
+			if (labels.count(jumps[j].second) == 0) {
+				continue;
+			}
+			int top = labels[jumps[j].second];
+			int bottom = jumps[j].first;
+			if (top > bottom) {
+				continue;
+			}
+			std::map< std::string, TempRange>::iterator rIt;
+			for (rIt = ranges.begin(); rIt != ranges.end(); rIt++) {
+				TempRange &r = rIt->second;
+				if (r.start < top && r.end >= top && r.end < bottom) {
+					r.end = bottom;
+					changed = true;
+				}
+			}
+		}
+	}
+
+	std::vector< TempRange> order;
+	std::map< std::string, TempRange>::iterator rIt;
+	for (rIt = ranges.begin(); rIt != ranges.end(); rIt++) {
+		order.push_back(rIt->second);
+	}
+	std::sort(order.begin(), order.end(), startsBefore);
+
+	int numLocals = getNumLocals(fname);
+	int numSpills = 0;
+	std::vector< bool> taken(MAX_NUM_REGISTERS - 1, false);
+	std::map< std::string, int> reg;
+	std::vector< TempRange> active;
+	std::vector< std::string> spilled;
+	for (int k=0; k<order.size(); k++) {
+		TempRange &r = order[k];
+		int free = taken.size();
+		for (int a=active.size()-1; a>=0; a--) {
+			bool ends = active[a].end < r.start;
+			if (active[a].end == r.start && handOver.count(r.start) == 1 &&
+					handOver[r.start] == std::make_pair(active[a].id, r.id)) {
+				// saves the move of op1 into the result
+				ends = true;
+				free = reg[active[a].id];
+			}
+			if (ends) {
+				taken[reg[active[a].id]] = false;
+				active.erase(active.begin() + a);
+			}
+		}
+		if (free == taken.size()) {
+			free = 0;
+			while (free < taken.size() && taken[free]) {
+				free++;
+			}
+		}
+		if (free < taken.size()) {
+			taken[free] = true;
+			reg[r.id] = free;
+			active.push_back(r);
+			continue;
+		}
+		int last = 0;
+		for (int a=1; a<active.size(); a++) {
+			if (active[a].end > active[last].end) {
+				last = a;
+			}
+		}
+		if (active[last].end > r.end) {
+			reg[r.id] = reg[active[last].id];
+			reg.erase(active[last].id);
+			spilled.push_back(active[last].id);
+			active[last] = r;
+		} else {
+			spilled.push_back(r.id);
+		}
+	}
+
+	std::map< std::string, int>::iterator gIt;
+	for (gIt = reg.begin(); gIt != reg.end(); gIt++) {
+		std::stringstream tstr;
+		tstr << "r" << gIt->second;
+		vars[index[gIt->first]].altName = tstr.str();
+	}
+	for (int k=0; k<spilled.size(); k++) {
+		std::stringstream tstr;
+		tstr << "$-" << numLocals + ++numSpills;
+		vars[index[spilled[k]]].altName = tstr.str();
+	}
+	return;
+}
+
+int Driver::getNumSpilledTemps(std::string scope) {
+	int scopeNum = getScopeNumber(scope);
+	int num = 0;
+	if (symbolTable.count(scopeNum) == 1) {
+		std::vector< VarStruct_s> &vars = symbolTable[scopeNum];
+		for (int i=0; i<vars.size(); i++) {
+			if (vars[i].identifier.find(TEMP_VAR_PRE) == 0 &&
+					vars[i].altName[0] == '$') {
+				num++;
+			}
+		}
+	}
+	return num;
+}
+
+} // namespace little
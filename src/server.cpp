@@ -0,0 +1,323 @@
+/* The compile server and its client, see server.h. The server keeps one
+ * process warm and gives every connection a thread of its own, which
+ * compiles each request with a fresh Driver into strings. */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "server.h"
+
+// anything bigger isn't a request or a reply
+#define MAX_STRING_SIZE (256*1024*1024)
+#define MAX_REQUEST_ARGS 1024
+
+namespace little {
+
+static bool writeAll(int fd, const char *p, size_t n) {
+	while (n > 0) {
+		ssize_t w = write(fd, p, n);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			return false;
+		}
+		p += w;
+		n -= w;
+	}
+	return true;
+}
+
+static bool writeString(int fd, const std::string &s) {
+	std::ostringstream head;
+	head << s.size() << "\n";
+	return writeAll(fd, head.str().data(), head.str().size()) &&
+			writeAll(fd, s.data(), s.size());
+}
+
+static bool readString(int fd, std::string &s) {
+	size_t n = 0;
+	bool digits = false;
+	char c;
+	while (true) {
+		ssize_t r = read(fd, &c, 1);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r != 1) {
+			return false;
+		}
+		if (c == '\n' && digits) {
+			break;
+		}
+		if (c < '0' || c > '9') {
+			return false;
+		}
+		n = n*10 + (c - '0');
+		digits = true;
+		if (n > MAX_STRING_SIZE) {
+			return false;
+		}
+	}
+	s.resize(n);
+	size_t got = 0;
+	while (got < n) {
+		ssize_t r = read(fd, &s[got], n - got);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return false;
+		}
+		got += r;
+	}
+	return true;
+}
+
+int connectServer(std::string path) {
+	struct sockaddr_un addr;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		return -1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool sendRequest(int fd, std::vector< std::string> &args,
+				 const std::string &input) {
+	std::ostringstream count;
+	count << args.size();
+	if (!writeString(fd, count.str())) {
+		return false;
+	}
+	for (int i=0; i<args.size(); i++) {
+		if (!writeString(fd, args[i])) {
+			return false;
+		}
+	}
+	return writeString(fd, input);
+}
+
+bool readReply(int fd, int &status, std::string &out, std::string &err) {
+	std::string s;
+	if (!readString(fd, s) || !readString(fd, out) || !readString(fd, err)) {
+		return false;
+	}
+	status = atoi(s.c_str());
+	return true;
+}
+
+static bool readRequest(int fd, std::vector< std::string> &args,
+						std::string &input) {
+	std::string s;
+	if (!readString(fd, s)) {
+		return false;
+	}
+	int count = atoi(s.c_str());
+	if (count > MAX_REQUEST_ARGS) {
+		return false;
+	}
+	args.assign(count, "");
+	for (int i=0; i<args.size(); i++) {
+		if (!readString(fd, args[i])) {
+			return false;
+		}
+	}
+	return readString(fd, input);
+}
+
+struct ServerConnection {
+	int fd;
+	CompileFunction compile;
+};
+
+// the user's program runs in the client, never in a server thread
+static bool runsProgram(std::vector< std::string> &args) {
+	for (int i=0; i<args.size(); i++) {
+		if (args[i] == "--run" || args[i] == "-jit") {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void *serveConnection(void *arg) {
+	ServerConnection *conn = (ServerConnection *)arg;
+	std::vector< std::string> args;
+	std::string input;
+	while (readRequest(conn->fd, args, input)) {
+		std::istringstream in(input);
+		std::ostringstream out;
+		std::ostringstream err;
+		std::ostringstream status;
+		if (runsProgram(args)) {
+			err << "the server doesn't run programs, micro --client runs"
+				<< " them itself" << std::endl;
+			status << 1;
+		} else {
+			status << conn->compile(args, in, out, err);
+		}
+		if (!writeString(conn->fd, status.str()) ||
+				!writeString(conn->fd, out.str()) ||
+				!writeString(conn->fd, err.str())) {
+			break;
+		}
+	}
+	close(conn->fd);
+	delete conn;
+	return NULL;
+}
+
+static char serverPath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+static void stopServer(int sig) {
+	unlink(serverPath);
+	_exit(0);
+}
+
+int runServer(std::string path, CompileFunction compile) {
+	// a client that hangs up mustn't take the server with it
+	signal(SIGPIPE, SIG_IGN);
+	int fd = connectServer(path);
+	if (fd >= 0) {
+		close(fd);
+		std::cerr << "a server is already running on " << path << std::endl;
+		return 1;
+	}
+	// nobody answers, so anything there is left from a server that died
+	unlink(path.c_str());
+	struct sockaddr_un addr;
+	if (path.size() >= sizeof(addr.sun_path)) {
+		std::cerr << "socket path too long: " << path << std::endl;
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, path.c_str());
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+			listen(fd, SOMAXCONN) != 0) {
+		std::cerr << "could not listen on " << path << ": "
+				  << strerror(errno) << std::endl;
+		return 1;
+	}
+	strcpy(serverPath, path.c_str());
+	signal(SIGINT, stopServer);
+	signal(SIGTERM, stopServer);
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	while (true) {
+		int c = accept(fd, NULL, NULL);
+		if (c < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			std::cerr << "accept: " << strerror(errno) << std::endl;
+			break;
+		}
+		ServerConnection *conn = new ServerConnection;
+		conn->fd = c;
+		conn->compile = compile;
+		pthread_t t;
+		if (pthread_create(&t, &attr, serveConnection, conn) != 0) {
+			// out of threads, so this one waits its turn
+			serveConnection(conn);
+		}
+	}
+	unlink(serverPath);
+	return 1;
+}
+
+static std::string absolutePath(std::string p) {
+	char cwd[4096];
+	if (p.empty() || p[0] == '/' || getcwd(cwd, sizeof(cwd)) == NULL) {
+		return p;
+	}
+	return std::string(cwd) + "/" + p;
+}
+
+int runClient(std::string path, std::vector< std::string> args,
+			  CompileFunction compile, RunFunction run) {
+	// the server has its own working directory, so files go by their
+	// absolute paths; stdin is sent along when it's the source. A --run
+	// asks for -obj instead, and stdin stays here for the program
+	std::vector< std::string> sent;
+	bool needInput = true;
+	bool running = false;
+	bool profiling = false;
+	for (int i=0; i<args.size(); i++) {
+		std::string a = args[i];
+		sent.push_back(a);
+		if ((a == "-profile-gen" || a == "-profile-use" ||
+				a == "-func-cache" || a == "--cache-dir") &&
+				i+1 < args.size()) {
+			sent.push_back(absolutePath(args[++i]));
+			profiling = profiling || a == "-profile-gen";
+		} else if ((a == "-j" || a == "--cache-size") && i+1 < args.size()) {
+			sent.push_back(args[++i]);
+		} else if (a == "--run") {
+			running = true;
+			sent.back() = "-obj";
+		} else if (a == "-jit" || a == "-stats") {
+			sent.pop_back();
+		} else if (a == "--cache-stats") {
+			needInput = false;
+		} else if (!a.empty() && a[0] != '-') {
+			sent.back() = absolutePath(a);
+			needInput = false;
+		}
+	}
+
+	// with no server it's the same compile, only slower; a profile is
+	// written by the compile that ran the program, so that stays here too
+	int fd = (running && profiling) ? -1 : connectServer(path);
+	if (fd < 0) {
+		return compile(args, std::cin, std::cout, std::cerr);
+	}
+	signal(SIGPIPE, SIG_IGN);
+	std::string input;
+	if (needInput && !running) {
+		std::ostringstream is;
+		is << std::cin.rdbuf();
+		input = is.str();
+	}
+	int status;
+	std::string out;
+	std::string err;
+	bool ok = sendRequest(fd, sent, input) &&
+			readReply(fd, status, out, err);
+	close(fd);
+	if (!ok) {
+		// the server went away in the middle, do it here instead
+		std::istringstream in(input);
+		return compile(args, running ? std::cin : in, std::cout, std::cerr);
+	}
+	std::cerr << err;
+	if (running && status == 0) {
+		return run(out, args, std::cin, std::cout, std::cerr);
+	}
+	std::cout << out;
+	return status;
+}
+
+} // namespace little
@@ -0,0 +1,38 @@
+#ifndef LITTLE_SERVER_H
+#define LITTLE_SERVER_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace little {
+
+/* micro --server keeps a compiler running on a unix socket, and
+ * micro --client hands it a command line. A request is the arguments and
+ * stdin, a reply is the exit status, stdout and stderr. Every string goes
+ * as its length in decimal and a newline, then the bytes, and a connection
+ * can carry any number of requests. The server only compiles: it turns
+ * down --run and -jit, and the client gets the object code for those and
+ * runs it itself, so a program that traps or loops can't hurt the server. */
+
+typedef int (*CompileFunction)(std::vector< std::string> &args,
+							   std::istream &in, std::ostream &out,
+							   std::ostream &err);
+// runs what a server compiled for a --run, with the command line's flags
+typedef int (*RunFunction)(const std::string &object,
+						   std::vector< std::string> &args, std::istream &in,
+						   std::ostream &out, std::ostream &err);
+
+int runServer(std::string path, CompileFunction compile);
+int runClient(std::string path, std::vector< std::string> args,
+			  CompileFunction compile, RunFunction run);
+
+// for anything else that talks to a server; -1 if there isn't one
+int connectServer(std::string path);
+bool sendRequest(int fd, std::vector< std::string> &args,
+				 const std::string &input);
+bool readReply(int fd, int &status, std::string &out, std::string &err);
+
+} // namespace little
+
+#endif // LITTLE_SERVER_H
@@ -0,0 +1,80 @@
+/* Streaming compiles (-stream). The parser hands over each function as soon
+ * as its END is reduced, and its TINY goes out and its IR and local scope
+ * are dropped before the next one is parsed, so what stays in memory is the
+ * globals, one line per function in fs and the function being compiled.
+ * Only the passes that look at one function at a time can run this way
+ * (see passes.cpp). */
+
+#include "driver.h"
+
+namespace little {
+
+void Driver::setStreaming(bool s) {
+	streaming = s;
+}
+
+void Driver::startStream() {
+	// all the globals come before the first function
+	tinyCode.clear();
+	tinyVariableDeclaration();
+	tinyCode.push_back(tinyInst("push"));
+	tinyCode.push_back(tinyInst("jsr", "main"));
+	tinyCode.push_back(tinyInst("sys halt"));
+	writeTinyCode(*outStream, tinyCode);
+	tinyCode.clear();
+	streamStarted = true;
+	return;
+}
+
+void Driver::streamFunction(std::string fname) {
+	if (streaming == false) {
+		return;
+	}
+	if (streamStarted == false) {
+		startStream();
+	}
+	std::list< IRNode> &nodes = functionMap[fname];
+	runFunctionPasses(fname, nodes);
+	if (liveness) {
+		funcStruct_s f;
+		findFuncData(fname, f);
+		modifyTempVarAltNames(f);
+		functionalLiveness(nodes, f);
+		overwriteFuncData(f);
+	} else {
+		allocateTempRegisters(fname, nodes);
+	}
+	// callers that came first pushed its params and return slot, so
+	// those go on the stack like main's (see assignCallingConventions)
+	assignCallingConventions();
+	findCallSaveSets();
+	std::vector< TinyInst> code;
+	tinyGenerateNormalCode(nodes, code);
+	writeTinyCode(*outStream, code);
+
+	streamDone.insert(fname);
+	std::list< IRNode>::iterator it;
+	for (it = nodes.begin(); it != nodes.end(); it++) {
+		if (it->opCode == "JSR" && streamDone.count(it->Result) == 0) {
+			streamCalled.insert(it->Result);
+		}
+	}
+	int scopeNum = getScopeNumber(fname);
+	symbolTable.erase(scopeNum);
+	functionMap.erase(fname);
+	nodeList.clear();
+	return;
+}
+
+void Driver::finishStream() {
+	if (streaming == false) {
+		return;
+	}
+	if (streamStarted == false) {
+		startStream();
+	}
+	*outStream << "end" << std::endl;
+	return;
+}
+
+} // namespace little
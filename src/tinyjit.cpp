@@ -0,0 +1,580 @@
+/* \file tinyjit.cpp The x86-64 tier of little::TinyVM. */
+
+#include "tinyvm.h"
+
+#include <cstring>
+#include <climits>
+
+#if defined(__x86_64__) && defined(__linux__)
+#include <sys/mman.h>
+#define TINY_NATIVE
+#endif
+
+// Every jsr is a native call, so native code gets a stack with room for
+// a return address per TINY stack cell, plus some for the I/O helpers.
+#define NATIVE_STACK_SIZE (TINY_STACK_SIZE*8 + (1 << 20))
+
+namespace little {
+
+// error codes come back from native code as instruction*8 + one of these
+enum NativeError
+{
+	NATIVE_OK, NATIVE_BAD_STACK, NATIVE_OVERFLOW, NATIVE_UNDERFLOW,
+	NATIVE_DIVIDE, NATIVE_BAD_FP, NATIVE_INT_OVERFLOW
+} ;
+
+static const char *nativeErrors[] = {
+	"", "illegal data stack reference", "stack overflow", "stack underflow",
+	"division by zero", "illegal fp stack reference", "integer overflow"
+};
+
+void TinyVM::nativeReadInt(TinyVM *vm, TinyCell *c) {
+	if (!(*vm->jitIn >> c->i)) {
+		c->i = 0;
+	}
+	c->f = (float)c->i;
+}
+
+void TinyVM::nativeReadFloat(TinyVM *vm, TinyCell *c) {
+	if (!(*vm->jitIn >> c->f)) {
+		c->f = 0.0f;
+	}
+	c->i = (int)c->f;
+}
+
+void TinyVM::nativeWriteInt(TinyVM *vm, TinyCell *c) {
+	*vm->jitOut << c->i;
+}
+
+void TinyVM::nativeWriteFloat(TinyVM *vm, TinyCell *c) {
+	*vm->jitOut << c->f;
+}
+
+void TinyVM::nativeWriteString(TinyVM *vm, std::string *s) {
+	*vm->jitOut << *s;
+}
+
+void TinyVM::freeNative() {
+#ifdef TINY_NATIVE
+	if (nativeCode != NULL) {
+		munmap(nativeCode, nativeSize);
+	}
+	if (nativeStack != NULL) {
+		munmap(nativeStack, NATIVE_STACK_SIZE);
+	}
+#endif
+	nativeCode = NULL;
+	nativeSize = 0;
+	nativeStack = NULL;
+	return;
+}
+
+#ifdef TINY_NATIVE
+
+// Just enough of an x86-64 assembler for the translation below. Every
+// memory operand is base + index*8 + disp32.
+
+typedef std::vector< unsigned char> Bytes;
+
+enum X86Register
+{
+	RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+	R8, R9, R10, R11, R12, R13, R14, R15
+} ;
+
+enum X86Condition
+{
+	CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_BE = 0x6,
+	CC_A = 0x7, CC_L = 0xC, CC_GE = 0xD, CC_LE = 0xE, CC_G = 0xF
+} ;
+
+struct X86Mem
+{
+	int base;
+	int index; // -1 for none
+	int disp;
+} ;
+
+// a rel32 that gets filled in once everything has an address
+struct X86Fixup
+{
+	size_t at;
+	int kind; // FIX_INSTRUCTION, FIX_EXIT
+	int value; // the instruction, or the exit code
+} ;
+#define FIX_INSTRUCTION 0
+#define FIX_EXIT 1
+
+static void emit8(Bytes &c, int b) {
+	c.push_back((unsigned char)(b & 0xff));
+}
+
+static void emit32(Bytes &c, int v) {
+	for (int i=0; i<4; i++) {
+		emit8(c, v >> (8*i));
+	}
+}
+
+static void emit64(Bytes &c, unsigned long long v) {
+	for (int i=0; i<8; i++) {
+		emit8(c, (int)(v >> (8*i)));
+	}
+}
+
+static void emitRex(Bytes &c, bool w, int reg, int index, int base) {
+	int rex = 0x40 | (w ? 8 : 0) | ((reg & 8) ? 4 : 0) |
+			  ((index & 8) ? 2 : 0) | ((base & 8) ? 1 : 0);
+	if (rex != 0x40) {
+		emit8(c, rex);
+	}
+}
+
+static void emitOpcode(Bytes &c, int opcode, int len) {
+	for (int i=len-1; i>=0; i--) {
+		emit8(c, opcode >> (8*i));
+	}
+}
+
+static void memOp(Bytes &c, int prefix, bool w, int opcode, int len,
+				  int reg, X86Mem m) {
+	if (prefix) emit8(c, prefix);
+	emitRex(c, w, reg, m.index < 0 ? 0 : m.index, m.base);
+	emitOpcode(c, opcode, len);
+	if (m.index < 0 && (m.base & 7) != RSP) {
+		emit8(c, 0x80 | ((reg & 7) << 3) | (m.base & 7));
+	} else {
+		emit8(c, 0x80 | ((reg & 7) << 3) | 4);
+		if (m.index < 0) {
+			emit8(c, (4 << 3) | (m.base & 7));
+		} else {
+			emit8(c, (3 << 6) | ((m.index & 7) << 3) | (m.base & 7));
+		}
+	}
+	emit32(c, m.disp);
+}
+
+static void regOp(Bytes &c, int prefix, bool w, int opcode, int len,
+				  int reg, int rm) {
+	if (prefix) emit8(c, prefix);
+	emitRex(c, w, reg, 0, rm);
+	emitOpcode(c, opcode, len);
+	emit8(c, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void movImm64(Bytes &c, int reg, unsigned long long v) {
+	emitRex(c, true, 0, 0, reg);
+	emit8(c, 0xB8 + (reg & 7));
+	emit64(c, v);
+}
+
+static void pushReg(Bytes &c, int reg) {
+	if (reg & 8) emit8(c, 0x41);
+	emit8(c, 0x50 + (reg & 7));
+}
+
+static void popReg(Bytes &c, int reg) {
+	if (reg & 8) emit8(c, 0x41);
+	emit8(c, 0x58 + (reg & 7));
+}
+
+static void cmpImm64(Bytes &c, int reg, int imm) {
+	regOp(c, 0, true, 0x81, 1, 7, reg);
+	emit32(c, imm);
+}
+
+static X86Mem mem(int base, int index, int disp) {
+	X86Mem m;
+	m.base = base;
+	m.index = index;
+	m.disp = disp;
+	return m;
+}
+
+static void jumpTo(Bytes &c, std::vector< X86Fixup> &fixups, int opcode,
+				   int len, int kind, int value) {
+	emitOpcode(c, opcode, len);
+	X86Fixup f;
+	f.at = c.size();
+	f.kind = kind;
+	f.value = value;
+	fixups.push_back(f);
+	emit32(c, 0);
+}
+
+// leaves on error code when the condition holds
+static void exitIf(Bytes &c, std::vector< X86Fixup> &fixups, int cc,
+				   int index, NativeError e) {
+	jumpTo(c, fixups, 0x0F80 | cc, 2, FIX_EXIT, index*8 + e);
+}
+
+// the cell an operand names, with scratch holding any computed address
+static X86Mem cellOf(Bytes &c, std::vector< X86Fixup> &fixups,
+					 TinyOperand &o, int scratch, int index) {
+	if (o.kind == TINY_REGISTER) {
+		return mem(RBX, -1, o.index*sizeof(TinyCell));
+	} else if (o.kind == TINY_VARIABLE) {
+		return mem(R12, -1, o.index*sizeof(TinyCell));
+	} else if (o.kind == TINY_STACK) {
+		// fp + offset, and it has to land inside the stack
+		memOp(c, 0, true, 0x8D, 1, scratch, mem(R15, -1, o.index));
+		cmpImm64(c, scratch, TINY_STACK_SIZE);
+		exitIf(c, fixups, CC_AE, index, NATIVE_BAD_STACK);
+		return mem(R13, scratch, 0);
+	}
+	movImm64(c, scratch, (unsigned long long)&o.literal);
+	return mem(scratch, -1, 0);
+}
+
+static X86Mem floatHalf(X86Mem m) {
+	m.disp += 4;
+	return m;
+}
+
+// eax holds a new int value for m, keep the float view in step
+static void storeInt(Bytes &c, X86Mem m) {
+	memOp(c, 0, false, 0x89, 1, RAX, m);
+	regOp(c, 0xF3, false, 0x0F2A, 2, 0, RAX);
+	memOp(c, 0xF3, false, 0x0F11, 2, 0, floatHalf(m));
+}
+
+// xmm0 holds a new float value for m
+static void storeFloat(Bytes &c, X86Mem m) {
+	memOp(c, 0xF3, false, 0x0F11, 2, 0, floatHalf(m));
+	regOp(c, 0xF3, false, 0x0F2C, 2, RAX, 0);
+	memOp(c, 0, false, 0x89, 1, RAX, m);
+}
+
+// turn two setcc results in al and cl into -1, 0 or 1 in ebp
+static void compareResult(Bytes &c) {
+	regOp(c, 0, false, 0x0FB6, 2, RAX, RAX);
+	regOp(c, 0, false, 0x0FB6, 2, RCX, RCX);
+	regOp(c, 0, false, 0x2B, 1, RAX, RCX);
+	regOp(c, 0, false, 0x8B, 1, RBP, RAX);
+}
+
+// keep the lowest sp seen, for the high water mark
+static void trackLowWater(Bytes &c, long *lowSp) {
+	movImm64(c, RAX, (unsigned long long)lowSp);
+	memOp(c, 0, true, 0x3B, 1, R14, mem(RAX, -1, 0));
+	emit8(c, 0x73); // jae over the store
+	size_t skip = c.size();
+	emit8(c, 0);
+	memOp(c, 0, true, 0x89, 1, R14, mem(RAX, -1, 0));
+	c[skip] = (unsigned char)(c.size() - skip - 1);
+}
+
+// helpers follow the C calling convention, so line the stack up first
+static void callHelper(Bytes &c, void *fn) {
+	movImm64(c, RAX, (unsigned long long)fn);
+	regOp(c, 0, true, 0x89, 1, RSP, R8);
+	emit8(c, 0x48); emit8(c, 0x83); emit8(c, 0xE4); emit8(c, 0xF0);
+	pushReg(c, R8);
+	pushReg(c, R8);
+	emit8(c, 0xFF); emit8(c, 0xD0);
+	memOp(c, 0, true, 0x8B, 1, RSP, mem(RSP, -1, 0));
+}
+
+#endif // TINY_NATIVE
+
+bool TinyVM::compileNative() {
+#ifdef TINY_NATIVE
+	// Native state: rbx registers, r12 variables, r13 the stack, r14 sp,
+	// r15 fp and ebp the last comparison. TINY registers stay in memory
+	// with both of their views, and a jsr is a native call with a cell
+	// pushed on the TINY stack so the frame layout doesn't change.
+	Bytes c;
+	std::vector< size_t> starts(code.size());
+	std::vector< X86Fixup> fixups;
+	int aluOps[TINY_NUM_OPCODES];
+	aluOps[TINY_ADDI] = 0x03;
+	aluOps[TINY_SUBI] = 0x2B;
+	aluOps[TINY_MULI] = 0x0FAF;
+	aluOps[TINY_ADDR] = 0x0F58;
+	aluOps[TINY_SUBR] = 0x0F5C;
+	aluOps[TINY_MULR] = 0x0F59;
+	aluOps[TINY_DIVR] = 0x0F5E;
+	int branches[TINY_NUM_OPCODES];
+	branches[TINY_JGT] = CC_G;
+	branches[TINY_JLT] = CC_L;
+	branches[TINY_JGE] = CC_GE;
+	branches[TINY_JLE] = CC_LE;
+	branches[TINY_JEQ] = CC_E;
+	branches[TINY_JNE] = CC_NE;
+
+	// int entry(regs, vars, stack, sp, fp, native stack top)
+	pushReg(c, RBX);
+	pushReg(c, RBP);
+	pushReg(c, R12);
+	pushReg(c, R13);
+	pushReg(c, R14);
+	pushReg(c, R15);
+	regOp(c, 0, true, 0x8B, 1, RBX, RDI);
+	regOp(c, 0, true, 0x8B, 1, R12, RSI);
+	regOp(c, 0, true, 0x8B, 1, R13, RDX);
+	regOp(c, 0, true, 0x8B, 1, R14, RCX);
+	regOp(c, 0, true, 0x8B, 1, R15, R8);
+	regOp(c, 0, false, 0x33, 1, RBP, RBP);
+	movImm64(c, RAX, (unsigned long long)&savedStack);
+	memOp(c, 0, true, 0x89, 1, RSP, mem(RAX, -1, 0));
+	regOp(c, 0, true, 0x8B, 1, RSP, R9);
+
+	for (int i=0; i<code.size(); i++) {
+		TinyInstruction &inst = code[i];
+		starts[i] = c.size();
+		X86Mem a;
+		X86Mem b;
+		switch (inst.opCode) {
+		case TINY_MOVE:
+			a = cellOf(c, fixups, inst.a, RCX, i);
+			b = cellOf(c, fixups, inst.b, RSI, i);
+			memOp(c, 0, true, 0x8B, 1, RAX, a);
+			memOp(c, 0, true, 0x89, 1, RAX, b);
+			break;
+		case TINY_ADDI: case TINY_SUBI: case TINY_MULI:
+			a = cellOf(c, fixups, inst.a, RCX, i);
+			b = cellOf(c, fixups, inst.b, RSI, i);
+			memOp(c, 0, false, 0x8B, 1, RAX, b);
+			memOp(c, 0, false, aluOps[inst.opCode],
+				  inst.opCode == TINY_MULI ? 2 : 1, RAX, a);
+			storeInt(c, b);
+			break;
+		case TINY_DIVI: {
+			a = cellOf(c, fixups, inst.a, RCX, i);
+			b = cellOf(c, fixups, inst.b, RSI, i);
+			memOp(c, 0, false, 0x8B, 1, R8, a);
+			regOp(c, 0, false, 0x85, 1, R8, R8);
+			exitIf(c, fixups, CC_E, i, NATIVE_DIVIDE);
+			memOp(c, 0, false, 0x8B, 1, RAX, b);
+			// idiv traps on INT_MIN / -1, the interpreter's error instead
+			regOp(c, 0, false, 0x83, 1, 7, R8);
+			emit8(c, -1);
+			emit8(c, 0x75); // jne over the check
+			size_t skip = c.size();
+			emit8(c, 0);
+			regOp(c, 0, false, 0x81, 1, 7, RAX);
+			emit32(c, INT_MIN);
+			exitIf(c, fixups, CC_E, i, NATIVE_INT_OVERFLOW);
+			c[skip] = (unsigned char)(c.size() - skip - 1);
+			emit8(c, 0x99);
+			regOp(c, 0, false, 0xF7, 1, 7, R8);
+			storeInt(c, b);
+			break;
+		}
+		case TINY_ADDR: case TINY_SUBR: case TINY_MULR: case TINY_DIVR:
+			a = cellOf(c, fixups, inst.a, RCX, i);
+			b = cellOf(c, fixups, inst.b, RSI, i);
+			memOp(c, 0xF3, false, 0x0F10, 2, 0, floatHalf(b));
+			memOp(c, 0xF3, false, aluOps[inst.opCode], 2, 0, floatHalf(a));
+			storeFloat(c, b);
+			break;
+		case TINY_INCI: case TINY_DECI:
+			a = cellOf(c, fixups, inst.a, RCX, i);
+			memOp(c, 0, false, 0x8B, 1, RAX, a);
+			regOp(c, 0, false, 0x81, 1, inst.opCode == TINY_INCI ? 0 : 5,
+				  RAX);
+			emit32(c, 1);
+			storeInt(c, a);
+			break;
+		case TINY_CMPI:
+			a = cellOf(c, fixups, inst.a, RCX, i);
+			b = cellOf(c, fixups, inst.b, RSI, i);
+			memOp(c, 0, false, 0x8B, 1, RAX, a);
+			memOp(c, 0, false, 0x3B, 1, RAX, b);
+			regOp(c, 0, false, 0x0F90 | CC_G, 2, 0, RAX);
+			regOp(c, 0, false, 0x0F90 | CC_L, 2, 0, RCX);
+			compareResult(c);
+			break;
+		case TINY_CMPR:
+			// seta both ways round, so a NaN compares equal like it
+			// does in the interpreter
+			a = cellOf(c, fixups, inst.a, RCX, i);
+			b = cellOf(c, fixups, inst.b, RSI, i);
+			memOp(c, 0xF3, false, 0x0F10, 2, 0, floatHalf(a));
+			memOp(c, 0xF3, false, 0x0F10, 2, 1, floatHalf(b));
+			regOp(c, 0, false, 0x0F2E, 2, 0, 1);
+			regOp(c, 0, false, 0x0F90 | CC_A, 2, 0, RAX);
+			regOp(c, 0, false, 0x0F2E, 2, 1, 0);
+			regOp(c, 0, false, 0x0F90 | CC_A, 2, 0, RCX);
+			compareResult(c);
+			break;
+		case TINY_PUSH:
+			regOp(c, 0, true, 0x85, 1, R14, R14);
+			exitIf(c, fixups, CC_E, i, NATIVE_OVERFLOW);
+			if (inst.a.kind == TINY_NONE) {
+				regOp(c, 0, false, 0x33, 1, RAX, RAX);
+			} else {
+				a = cellOf(c, fixups, inst.a, RCX, i);
+				memOp(c, 0, true, 0x8B, 1, RAX, a);
+			}
+			regOp(c, 0, true, 0xFF, 1, 1, R14);
+			memOp(c, 0, true, 0x89, 1, RAX, mem(R13, R14, 0));
+			trackLowWater(c, &nativeLowSp);
+			break;
+		case TINY_POP:
+			cmpImm64(c, R14, TINY_STACK_SIZE);
+			exitIf(c, fixups, CC_AE, i, NATIVE_UNDERFLOW);
+			if (inst.a.kind != TINY_NONE) {
+				a = cellOf(c, fixups, inst.a, RCX, i);
+				memOp(c, 0, true, 0x8B, 1, RAX, mem(R13, R14, 0));
+				memOp(c, 0, true, 0x89, 1, RAX, a);
+			}
+			regOp(c, 0, true, 0xFF, 1, 0, R14);
+			break;
+		case TINY_JSR: {
+			TinyCell ret = {i+1, (float)(i+1)};
+			unsigned long long bits;
+			memcpy(&bits, &ret, sizeof(bits));
+			regOp(c, 0, true, 0x85, 1, R14, R14);
+			exitIf(c, fixups, CC_E, i, NATIVE_OVERFLOW);
+			regOp(c, 0, true, 0xFF, 1, 1, R14);
+			movImm64(c, RAX, bits);
+			memOp(c, 0, true, 0x89, 1, RAX, mem(R13, R14, 0));
+			trackLowWater(c, &nativeLowSp);
+			jumpTo(c, fixups, 0xE8, 1, FIX_INSTRUCTION, inst.target);
+			break;
+		}
+		case TINY_RET:
+			cmpImm64(c, R14, TINY_STACK_SIZE);
+			exitIf(c, fixups, CC_AE, i, NATIVE_UNDERFLOW);
+			regOp(c, 0, true, 0xFF, 1, 0, R14);
+			emit8(c, 0xC3);
+			break;
+		case TINY_LINK:
+			cmpImm64(c, R14, inst.target);
+			exitIf(c, fixups, CC_BE, i, NATIVE_OVERFLOW);
+			regOp(c, 0, true, 0xFF, 1, 1, R14);
+			memOp(c, 0, false, 0x89, 1, R15, mem(R13, R14, 0));
+			regOp(c, 0xF3, false, 0x0F2A, 2, 0, R15);
+			memOp(c, 0xF3, false, 0x0F11, 2, 0, mem(R13, R14, 4));
+			regOp(c, 0, true, 0x8B, 1, R15, R14);
+			regOp(c, 0, true, 0x81, 1, 5, R14);
+			emit32(c, inst.target);
+			trackLowWater(c, &nativeLowSp);
+			break;
+		case TINY_UNLNK:
+			cmpImm64(c, R15, TINY_STACK_SIZE);
+			exitIf(c, fixups, CC_AE, i, NATIVE_UNDERFLOW);
+			regOp(c, 0, true, 0x8B, 1, R14, R15);
+			memOp(c, 0, true, 0x63, 1, R15, mem(R13, R14, 0));
+			regOp(c, 0, true, 0xFF, 1, 0, R14);
+			cmpImm64(c, R15, TINY_STACK_SIZE);
+			exitIf(c, fixups, CC_A, i, NATIVE_BAD_FP);
+			break;
+		case TINY_JMP:
+			jumpTo(c, fixups, 0xE9, 1, FIX_INSTRUCTION, inst.target);
+			break;
+		case TINY_JGT: case TINY_JLT: case TINY_JGE:
+		case TINY_JLE: case TINY_JEQ: case TINY_JNE:
+			regOp(c, 0, false, 0x85, 1, RBP, RBP);
+			jumpTo(c, fixups, 0x0F80 | branches[inst.opCode], 2,
+				   FIX_INSTRUCTION, inst.target);
+			break;
+		case TINY_READI: case TINY_READR:
+		case TINY_WRITEI: case TINY_WRITER:
+			a = cellOf(c, fixups, inst.a, RCX, i);
+			memOp(c, 0, true, 0x8D, 1, RSI, a);
+			movImm64(c, RDI, (unsigned long long)this);
+			callHelper(c, inst.opCode == TINY_READI ? (void *)nativeReadInt :
+						  inst.opCode == TINY_READR ? (void *)nativeReadFloat :
+						  inst.opCode == TINY_WRITEI ?
+						  (void *)nativeWriteInt : (void *)nativeWriteFloat);
+			break;
+		case TINY_WRITES:
+			movImm64(c, RSI, (unsigned long long)&strings[inst.a.index]);
+			movImm64(c, RDI, (unsigned long long)this);
+			callHelper(c, (void *)nativeWriteString);
+			break;
+		case TINY_HALT:
+			jumpTo(c, fixups, 0xE9, 1, FIX_EXIT, NATIVE_OK);
+			break;
+		default:
+			// anything new stays in the interpreter
+			return false;
+		}
+	}
+
+	// one stub per exit code loads it and unwinds everything
+	std::map< int, size_t> stubs;
+	for (int i=0; i<fixups.size(); i++) {
+		if (fixups[i].kind == FIX_EXIT && stubs.count(fixups[i].value) == 0) {
+			stubs[fixups[i].value] = c.size();
+			emit8(c, 0xB8);
+			emit32(c, fixups[i].value);
+			emit8(c, 0xE9);
+			emit32(c, 0);
+		}
+	}
+	size_t epilogue = c.size();
+	movImm64(c, RCX, (unsigned long long)&savedStack);
+	memOp(c, 0, true, 0x8B, 1, RSP, mem(RCX, -1, 0));
+	popReg(c, R15);
+	popReg(c, R14);
+	popReg(c, R13);
+	popReg(c, R12);
+	popReg(c, RBP);
+	popReg(c, RBX);
+	emit8(c, 0xC3);
+
+	std::map< int, size_t>::iterator sIt;
+	for (sIt = stubs.begin(); sIt != stubs.end(); sIt++) {
+		size_t at = sIt->second + 6;
+		int rel = (int)(epilogue - (at + 4));
+		memcpy(&c[at], &rel, 4);
+	}
+	for (int i=0; i<fixups.size(); i++) {
+		size_t target = fixups[i].kind == FIX_INSTRUCTION ?
+						starts[fixups[i].value] : stubs[fixups[i].value];
+		int rel = (int)(target - (fixups[i].at + 4));
+		memcpy(&c[fixups[i].at], &rel, 4);
+	}
+
+	void *p = mmap(NULL, c.size(), PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (p == MAP_FAILED) {
+		return false;
+	}
+	memcpy(p, &c[0], c.size());
+	if (mprotect(p, c.size(), PROT_READ | PROT_EXEC) != 0) {
+		munmap(p, c.size());
+		return false;
+	}
+	void *s = mmap(NULL, NATIVE_STACK_SIZE, PROT_READ | PROT_WRITE,
+				   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (s == MAP_FAILED) {
+		munmap(p, c.size());
+		return false;
+	}
+	nativeCode = p;
+	nativeSize = c.size();
+	nativeStack = s;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool TinyVM::runNative(std::istream &in, std::ostream &out) {
+#ifdef TINY_NATIVE
+	typedef int (*NativeEntry)(TinyCell *, TinyCell *, TinyCell *,
+							   long, long, char *);
+	nativeLowSp = TINY_STACK_SIZE;
+	jitIn = &in;
+	jitOut = &out;
+	NativeEntry entry = (NativeEntry)nativeCode;
+	int result = entry(registers.empty() ? NULL : &registers[0],
+					   variables.empty() ? NULL : &variables[0],
+					   stack, TINY_STACK_SIZE, TINY_STACK_SIZE,
+					   (char *)nativeStack + NATIVE_STACK_SIZE);
+	out.flush();
+	stackHighWater = TINY_STACK_SIZE - nativeLowSp;
+	if (result != NATIVE_OK) {
+		setError(code[result / 8].line, nativeErrors[result % 8]);
+		return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+} // namespace little
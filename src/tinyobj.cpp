@@ -0,0 +1,421 @@
+/* \file tinyobj.cpp Implementation of the little::TinyObject class. */
+
+#include "tinyobj.h"
+
+#include <sstream>
+#include <iterator>
+#include <cstdlib>
+#include <cstdio>
+
+// 0x7f can't start a line of text, so one byte tells the formats apart
+#define TOBJ_MAGIC "\x7fTOB"
+#define TOBJ_MAGIC_LEN 4
+#define TOBJ_VERSION 1
+
+namespace little {
+
+static const char *pseudoNames[] = { "label", "var", "str", "end", "" };
+
+static void writeNumber(std::ostream &os, unsigned int n) {
+	// seven bits at a time, high bit set on all but the last byte
+	while (n >= 0x80) {
+		os.put((char)((n & 0x7f) | 0x80));
+		n >>= 7;
+	}
+	os.put((char)n);
+}
+
+static bool readNumber(std::istream &is, unsigned int &n) {
+	n = 0;
+	for (int shift = 0; shift < 35; shift += 7) {
+		int c = is.get();
+		if (c == EOF) {
+			return false;
+		}
+		n |= (unsigned int)(c & 0x7f) << shift;
+		if ((c & 0x80) == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// signed values go small side up, so -1 is as short as 1
+static unsigned int zigzag(int v) {
+	return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+static int unzigzag(unsigned int v) {
+	return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+static std::string numberText(int v) {
+	// called for nearly every operand, so no stringstream
+	char buf[16];
+	snprintf(buf, sizeof(buf), "%d", v);
+	return buf;
+}
+
+// true if s is exactly how v would print, so it can be stored as v
+static bool isNumber(std::string s, int &v) {
+	if (s.empty() || s.size() > 11) {
+		return false;
+	}
+	v = atoi(s.c_str());
+	return numberText(v) == s;
+}
+
+TinyObject::TinyObject()
+	: finalNewline(true)
+{
+}
+
+std::string TinyObject::getError() {
+	return errorMessage;
+}
+
+std::string TinyObject::unescape(std::string s) {
+	std::string r;
+	for (int i=0; i<s.size(); i++) {
+		if (s[i] == '\\' && i+1 < s.size()) {
+			i++;
+			if (s[i] == 'n') {
+				r += '\n';
+			} else if (s[i] == 't') {
+				r += '\t';
+			} else {
+				r += s[i];
+			}
+		} else {
+			r += s[i];
+		}
+	}
+	return r;
+}
+
+bool TinyObject::tokenize(std::string text, std::vector< std::string> &tokens,
+						  std::string &error) {
+	tokens.clear();
+	std::istringstream tstream(text);
+	std::string token;
+	if (!(tstream >> token) || token[0] == ';') {
+		return false;
+	}
+	tokens.push_back(token);
+	if (token == "str") {
+		// the value is everything between the quotes
+		std::string name;
+		tstream >> name;
+		tokens.push_back(name);
+		size_t first = text.find('"');
+		size_t last = text.rfind('"');
+		if (first == std::string::npos || last == first) {
+			error = "bad string";
+			return false;
+		}
+		tokens.push_back(unescape(text.substr(first+1, last-first-1)));
+	} else {
+		while (tstream >> token && token[0] != ';') {
+			tokens.push_back(token);
+		}
+	}
+	return true;
+}
+
+bool TinyObject::isObject(std::istream &is) {
+	return is.peek() == TOBJ_MAGIC[0];
+}
+
+int TinyObject::addString(std::string s) {
+	std::map< std::string, int>::iterator it = stringIndex.find(s);
+	if (it != stringIndex.end()) {
+		return it->second;
+	}
+	int index = strings.size();
+	strings.push_back(s);
+	stringIndex[s] = index;
+	return index;
+}
+
+unsigned int TinyObject::encodeOperand(std::string s) {
+	int v;
+	if (s.size() > 1 && s[0] == 'r' && s[1] != '-' &&
+			isNumber(s.substr(1), v)) {
+		return (unsigned int)v << 2 | TOBJ_REGISTER;
+	}
+	if (s.size() > 1 && s[0] == '$' && isNumber(s.substr(1), v)) {
+		return zigzag(v) << 2 | TOBJ_STACK;
+	}
+	// small enough that the shift doesn't lose anything
+	if (isNumber(s, v) && v < (1 << 28) && v >= -(1 << 28)) {
+		return zigzag(v) << 2 | TOBJ_INTEGER;
+	}
+	return (unsigned int)addString(s) << 2 | TOBJ_STRING;
+}
+
+int TinyObject::getOperandKind(unsigned int o) {
+	return o & 3;
+}
+
+int TinyObject::getOperandValue(unsigned int o) {
+	// registers can't be negative, the rest can
+	return (o & 3) == TOBJ_REGISTER ? (int)(o >> 2) : unzigzag(o >> 2);
+}
+
+std::string TinyObject::getOperandText(unsigned int o) {
+	unsigned int v = o >> 2;
+	switch (o & 3) {
+	case TOBJ_REGISTER:
+		return "r" + numberText((int)v);
+	case TOBJ_STACK:
+		return "$" + numberText(unzigzag(v));
+	case TOBJ_INTEGER:
+		return numberText(unzigzag(v));
+	default:
+		return v < strings.size() ? strings[v] : "";
+	}
+}
+
+std::string TinyObject::lineText(TinyRecord &r) {
+	if (r.op == TOBJ_RAW) {
+		return getOperandText(r.operands[0]);
+	}
+	std::string text = r.op < TINY_NUM_OPCODES ?
+			TinyVM::getOpcodeName((TinyOpcode)r.op) :
+			pseudoNames[r.op - TINY_NUM_OPCODES];
+	for (int i=0; i<r.operands.size(); i++) {
+		text += " " + getOperandText(r.operands[i]);
+	}
+	if (r.trailingSpace) {
+		text += " ";
+	}
+	return text;
+}
+
+bool TinyObject::encodeLine(std::string text, TinyRecord &r) {
+	r.trailingSpace = false;
+	r.operands.clear();
+	if (text.find_first_of("\t\r;") != std::string::npos) {
+		return false;
+	}
+	std::vector< std::string> words;
+	size_t start = 0;
+	while (true) {
+		size_t space = text.find(' ', start);
+		words.push_back(text.substr(start, space - start));
+		if (space == std::string::npos) {
+			break;
+		}
+		start = space + 1;
+	}
+	std::string name = words[0];
+	int first = 1;
+	if (name == "sys" && words.size() > 1) {
+		name += " " + words[1];
+		first = 2;
+	}
+	r.op = 0;
+	while (r.op < TINY_NUM_OPCODES &&
+			name != TinyVM::getOpcodeName((TinyOpcode)r.op)) {
+		r.op++;
+	}
+	while (r.op >= TINY_NUM_OPCODES && r.op < TOBJ_RAW &&
+			name != pseudoNames[r.op - TINY_NUM_OPCODES]) {
+		r.op++;
+	}
+	if (r.op == TOBJ_RAW) {
+		return false;
+	}
+	if (r.op == TOBJ_STR) {
+		// the value can have spaces in it
+		if (words.size() < 3) {
+			return false;
+		}
+		r.operands.push_back(addString(words[1]) << 2 | TOBJ_STRING);
+		std::string value = text.substr(name.size() + words[1].size() + 2);
+		r.operands.push_back(addString(value) << 2 | TOBJ_STRING);
+		return true;
+	}
+	if (words.size() == first + 1 && words[first].empty()) {
+		r.trailingSpace = true;
+		words.pop_back();
+	}
+	if (words.size() - first > 2) {
+		return false;
+	}
+	for (int i=first; i<words.size(); i++) {
+		if (words[i].empty()) {
+			return false;
+		}
+		r.operands.push_back(encodeOperand(words[i]));
+	}
+	// anything that wouldn't come back the same stays text
+	return lineText(r) == text;
+}
+
+bool TinyObject::assemble(std::istream &is) {
+	records.clear();
+	strings.clear();
+	stringIndex.clear();
+	std::string all((std::istreambuf_iterator<char>(is)),
+					std::istreambuf_iterator<char>());
+	std::vector< std::string> texts;
+	size_t start = 0;
+	while (!all.empty()) {
+		size_t end = all.find('\n', start);
+		texts.push_back(all.substr(start, end - start));
+		if (end == std::string::npos) {
+			break;
+		}
+		start = end + 1;
+	}
+	// the newline after the last line is kept as a flag
+	finalNewline = texts.size() > 1 && texts.back().empty();
+	if (finalNewline) {
+		texts.pop_back();
+	}
+	for (int i=0; i<texts.size(); i++) {
+		TinyRecord r;
+		if (!encodeLine(texts[i], r)) {
+			r.op = TOBJ_RAW;
+			r.trailingSpace = false;
+			r.operands.clear();
+			r.operands.push_back(addString(texts[i]) << 2 | TOBJ_STRING);
+		}
+		records.push_back(r);
+	}
+	return true;
+}
+
+void TinyObject::disassemble(std::ostream &os) {
+	for (int i=0; i<records.size(); i++) {
+		os << lineText(records[i]);
+		if (i+1 < records.size() || finalNewline) {
+			os << "\n";
+		}
+	}
+	return;
+}
+
+void TinyObject::write(std::ostream &os) {
+	os.write(TOBJ_MAGIC, TOBJ_MAGIC_LEN);
+	os.put((char)TOBJ_VERSION);
+	os.put((char)(finalNewline ? 1 : 0));
+	writeNumber(os, strings.size());
+	for (int i=0; i<strings.size(); i++) {
+		writeNumber(os, strings[i].size());
+		os.write(strings[i].data(), strings[i].size());
+	}
+	writeNumber(os, records.size());
+	for (int i=0; i<records.size(); i++) {
+		// the op and how many operands follow share a byte
+		TinyRecord &r = records[i];
+		int count = r.trailingSpace ? 3 : r.operands.size();
+		os.put((char)(r.op | count << 6));
+		for (int j=0; j<r.operands.size(); j++) {
+			writeNumber(os, r.operands[j]);
+		}
+	}
+	return;
+}
+
+bool TinyObject::read(std::istream &is) {
+	records.clear();
+	strings.clear();
+	stringIndex.clear();
+	char magic[TOBJ_MAGIC_LEN];
+	if (!is.read(magic, TOBJ_MAGIC_LEN) ||
+			std::string(magic, TOBJ_MAGIC_LEN) !=
+			std::string(TOBJ_MAGIC, TOBJ_MAGIC_LEN)) {
+		errorMessage = "not a tiny object";
+		return false;
+	}
+	if (is.get() != TOBJ_VERSION) {
+		errorMessage = "unknown tiny object version";
+		return false;
+	}
+	finalNewline = is.get() == 1;
+	unsigned int n;
+	if (!readNumber(is, n)) {
+		errorMessage = "truncated tiny object";
+		return false;
+	}
+	for (unsigned int i=0; i<n; i++) {
+		unsigned int len;
+		if (!readNumber(is, len)) {
+			errorMessage = "truncated tiny object";
+			return false;
+		}
+		std::string s(len, '\0');
+		if (len > 0 && !is.read(&s[0], len)) {
+			errorMessage = "truncated tiny object";
+			return false;
+		}
+		strings.push_back(s);
+	}
+	if (!readNumber(is, n)) {
+		errorMessage = "truncated tiny object";
+		return false;
+	}
+	records.reserve(n);
+	for (unsigned int i=0; i<n; i++) {
+		int c = is.get();
+		TinyRecord r;
+		r.op = c & 0x3f;
+		r.trailingSpace = (c >> 6) == 3;
+		int count = r.trailingSpace ? 0 : c >> 6;
+		if (c == EOF || r.op >= TOBJ_NUM_OPS ||
+				(r.op == TOBJ_RAW && count != 1)) {
+			errorMessage = "bad tiny object record";
+			return false;
+		}
+		for (int j=0; j<count; j++) {
+			unsigned int o;
+			if (!readNumber(is, o) ||
+					((o & 3) == TOBJ_STRING && (o >> 2) >= strings.size())) {
+				errorMessage = "bad tiny object record";
+				return false;
+			}
+			r.operands.push_back(o);
+		}
+		records.push_back(r);
+	}
+	return true;
+}
+
+bool TinyObject::getLines(std::vector< std::vector< std::string> > &lines,
+						  std::vector< int> &lineNumbers,
+						  std::vector< TinyRecord *> &instructions) {
+	for (int i=0; i<records.size(); i++) {
+		TinyRecord &r = records[i];
+		std::vector< std::string> tokens;
+		if (r.op < TINY_NUM_OPCODES) {
+			lines.push_back(tokens);
+			lineNumbers.push_back(i+1);
+			instructions.push_back(&r);
+			continue;
+		}
+		if (r.op == TOBJ_END) {
+			break;
+		}
+		if (r.op == TOBJ_LABEL || r.op == TOBJ_VAR) {
+			tokens.push_back(pseudoNames[r.op - TINY_NUM_OPCODES]);
+			for (int j=0; j<r.operands.size(); j++) {
+				tokens.push_back(getOperandText(r.operands[j]));
+			}
+		} else if (!tokenize(lineText(r), tokens, errorMessage)) {
+			if (!errorMessage.empty()) {
+				return false;
+			}
+			continue;
+		} else if (tokens[0] == "end") {
+			break;
+		}
+		lines.push_back(tokens);
+		lineNumbers.push_back(i+1);
+		instructions.push_back(NULL);
+	}
+	return true;
+}
+
+} // namespace little
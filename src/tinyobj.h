@@ -0,0 +1,77 @@
+/* \file tinyobj.h Declaration of the little::TinyObject class. */
+
+#ifndef LITTLE_TINYOBJ_H
+#define LITTLE_TINYOBJ_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+#include "tinyvm.h"
+
+// the lines that aren't instructions, after the TinyOpcodes
+#define TOBJ_LABEL (TINY_NUM_OPCODES)
+#define TOBJ_VAR (TINY_NUM_OPCODES + 1)
+#define TOBJ_STR (TINY_NUM_OPCODES + 2)
+#define TOBJ_END (TINY_NUM_OPCODES + 3)
+#define TOBJ_RAW (TINY_NUM_OPCODES + 4) // kept as text, anything odd
+#define TOBJ_NUM_OPS (TINY_NUM_OPCODES + 5)
+
+// operand kinds, in the low two bits
+#define TOBJ_REGISTER 0
+#define TOBJ_STACK 1
+#define TOBJ_INTEGER 2
+#define TOBJ_STRING 3
+
+namespace little {
+
+// one line of TINY, with the instruction and operands encoded
+struct TinyRecord
+{
+	int op; // a TinyOpcode, or one of the TOBJ_ pseudo ops
+	bool trailingSpace; // "push " and "pop " as the generator writes them
+	std::vector< unsigned int> operands; // value << 2 | kind
+} ;
+
+class TinyObject
+{
+public:
+	TinyObject();
+	// text to records and back, keeping every byte of the text
+	bool assemble(std::istream &is);
+	void disassemble(std::ostream &os);
+	// records to the binary format and back
+	void write(std::ostream &os);
+	bool read(std::istream &is);
+	// the lines as the vm tokenizes them, comments and blanks left out;
+	// an instruction gets no tokens, just its record in instructions
+	bool getLines(std::vector< std::vector< std::string> > &lines,
+				  std::vector< int> &lineNumbers,
+				  std::vector< TinyRecord *> &instructions);
+	std::string getOperandText(unsigned int o);
+	std::string getError();
+
+	static bool isObject(std::istream &is);
+	// false for a blank or comment line, or a bad one if error gets set
+	static bool tokenize(std::string text, std::vector< std::string> &tokens,
+						 std::string &error);
+	static std::string unescape(std::string s);
+	static int getOperandKind(unsigned int o);
+	static int getOperandValue(unsigned int o);
+private:
+	std::vector< TinyRecord> records;
+	std::vector< std::string> strings;
+	std::map< std::string, int> stringIndex;
+	bool finalNewline;
+	std::string errorMessage;
+
+	bool encodeLine(std::string text, TinyRecord &r);
+	unsigned int encodeOperand(std::string s);
+	std::string lineText(TinyRecord &r);
+	int addString(std::string s);
+};
+
+} // namespace little
+
+#endif // LITTLE_TINYOBJ_H
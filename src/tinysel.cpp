@@ -0,0 +1,210 @@
+/* Instruction selection for the TINY backend. Most IR nodes can be covered
+ * by more than one sequence of TINY instructions: the operands of an add or
+ * a multiply go either way round, a compare can be turned about when only
+ * its first operand is in a register, a literal or a register can be moved
+ * straight to memory, and an op on two literals or with an identity
+ * (x + 0, x * 1) is just a move. Every sequence that's legal for the
+ * operands' allocation is priced with the vm's cost model and the cheapest
+ * one is written. */
+
+#include <cstdlib>
+
+#include "driver.h"
+
+namespace little {
+
+Driver::TinyInst Driver::tinyInst(std::string op, std::string a,
+								  std::string b) {
+	TinyInst inst;
+	inst.op = op;
+	inst.a = a;
+	inst.b = b;
+	return inst;
+}
+
+bool Driver::isMemoryOperand(std::string s) {
+	// globals and stack slots; literals can be negative once folded
+	return !s.empty() && !isRegister(s) && !isLiteral(s) && s[0] != '-';
+}
+
+int Driver::getTinyCost(std::vector< TinyInst> &seq) {
+	// the same model as TinyVM::getCost
+	int cost = 0;
+	for (int i=0; i<seq.size(); i++) {
+		int c = 1;
+		if (seq[i].op.compare(0, 3, "mul") == 0) {
+			c = 3;
+		} else if (seq[i].op.compare(0, 3, "div") == 0) {
+			c = 6;
+		}
+		if (isMemoryOperand(seq[i].a)) c++;
+		if (isMemoryOperand(seq[i].b)) c++;
+		if (seq[i].op == "push" || seq[i].op == "pop") c++;
+		cost += c;
+	}
+	return cost;
+}
+
+void Driver::emitCheapest(std::vector< TinyInst> &out,
+						  std::vector< std::vector< TinyInst> > &choices) {
+	// the first one wins a tie, so list the plainest first
+	int best = -1;
+	int bestCost = 0;
+	for (int i=0; i<choices.size(); i++) {
+		int cost = getTinyCost(choices[i]);
+		if (best < 0 || cost < bestCost) {
+			best = i;
+			bestCost = cost;
+		}
+	}
+	if (best < 0) {
+		return;
+	}
+	out.insert(out.end(), choices[best].begin(), choices[best].end());
+	return;
+}
+
+void Driver::addScratchSaves(std::vector< TinyInst> &seq,
+							 std::vector< std::string> &saved) {
+	// push and pop around what's already in seq
+	for (int i=0; i<saved.size(); i++) {
+		seq.insert(seq.begin(), tinyInst("push", saved[i]));
+		seq.push_back(tinyInst("pop", saved[i]));
+	}
+	return;
+}
+
+void Driver::selectTinyMove(std::vector< TinyInst> &out, std::string from,
+							std::string to, std::string scratch,
+							std::vector< std::string> &saved) {
+	std::vector< std::vector< TinyInst> > choices;
+	if (from == to) {
+		return;
+	}
+	// tiny won't move from memory to memory in one go
+	if (!isMemoryOperand(from) || !isMemoryOperand(to)) {
+		choices.push_back(std::vector< TinyInst>());
+		choices.back().push_back(tinyInst("move", from, to));
+	}
+	std::vector< TinyInst> viaScratch;
+	viaScratch.push_back(tinyInst("move", from, scratch));
+	viaScratch.push_back(tinyInst("move", scratch, to));
+	addScratchSaves(viaScratch, saved);
+	choices.push_back(viaScratch);
+	emitCheapest(out, choices);
+	return;
+}
+
+static bool foldLiterals(std::string op, std::string x, std::string y,
+						 std::string &value) {
+	// only ints, and only what tiny would have computed itself
+	if (x.find('.') != std::string::npos ||
+			y.find('.') != std::string::npos) {
+		return false;
+	}
+	long long a = atoll(x.c_str());
+	long long b = atoll(y.c_str());
+	long long v;
+	if (op == "addi") {
+		v = a + b;
+	} else if (op == "subi") {
+		v = a - b;
+	} else if (op == "muli") {
+		v = a * b;
+	} else if (op == "divi" && b != 0) {
+		v = a / b;
+	} else {
+		return false;
+	}
+	if (v < 0 || v > 2147483647LL) {
+		return false;
+	}
+	std::stringstream vstr;
+	vstr << v;
+	value = vstr.str();
+	return true;
+}
+
+void Driver::addArithChoice(std::vector< std::vector< TinyInst> > &choices,
+							std::string op, std::string x, std::string y,
+							std::string dest, std::string result,
+							std::vector< std::string> &saved) {
+	// two-address: x is moved to dest and y applied to it, so y can't be
+	// in dest unless x is too
+	if (y == dest && x != dest) {
+		return;
+	}
+	std::vector< TinyInst> seq;
+	if (x != dest) {
+		seq.push_back(tinyInst("move", x, dest));
+	}
+	seq.push_back(tinyInst(op, y, dest));
+	if (dest != result) {
+		seq.push_back(tinyInst("move", dest, result));
+		addScratchSaves(seq, saved);
+	}
+	choices.push_back(seq);
+	return;
+}
+
+void Driver::selectTinyArith(std::vector< TinyInst> &out, const TinyPatternInfo &p,
+							 std::string op1, std::string op2,
+							 std::string result, std::string scratch,
+							 std::vector< std::string> &saved) {
+	std::string op = p.mnemonic;
+	bool isInt = op[op.size()-1] == 'i';
+	std::string identity = (op == "addi" || op == "subi") ? "0" : "1";
+	std::string value;
+	if (isInt && isLiteral(op1) && isLiteral(op2) &&
+			foldLiterals(op, op1, op2, value)) {
+	} else if (isInt && op2 == identity) {
+		value = op1;
+	} else if (isInt && p.swapped != NULL && op1 == identity) {
+		value = op2;
+	}
+	if (!value.empty()) {
+		selectTinyMove(out, value, result, scratch, saved);
+		return;
+	}
+
+	// the result has to be built in a register
+	std::string dest = isRegister(result) ? result : scratch;
+	std::vector< std::vector< TinyInst> > choices;
+	addArithChoice(choices, op, op1, op2, dest, result, saved);
+	if (p.swapped != NULL) {
+		addArithChoice(choices, p.swapped, op2, op1, dest, result, saved);
+	}
+	if (choices.empty()) {
+		// op2 is already in the result register
+		addArithChoice(choices, op, op1, op2, scratch, result, saved);
+	}
+	emitCheapest(out, choices);
+	return;
+}
+
+void Driver::selectTinyBranch(std::vector< TinyInst> &out, const TinyPatternInfo &p,
+							  std::string op1, std::string op2,
+							  std::string label, bool isFloat,
+							  std::string scratch) {
+	// the second operand of a compare must be a register
+	std::string cmp = isFloat ? "cmpr" : "cmpi";
+	std::vector< std::vector< TinyInst> > choices;
+	if (isRegister(op2)) {
+		choices.push_back(std::vector< TinyInst>());
+		choices.back().push_back(tinyInst(cmp, op1, op2));
+		choices.back().push_back(tinyInst(p.mnemonic, label));
+	}
+	if (isRegister(op1)) {
+		choices.push_back(std::vector< TinyInst>());
+		choices.back().push_back(tinyInst(cmp, op2, op1));
+		choices.back().push_back(tinyInst(p.swapped, label));
+	}
+	choices.push_back(std::vector< TinyInst>());
+	choices.back().push_back(tinyInst("move", op2, scratch));
+	choices.back().push_back(tinyInst(cmp, op1, scratch));
+	choices.back().push_back(tinyInst(p.mnemonic, label));
+	emitCheapest(out, choices);
+	return;
+}
+
+} // namespace little
@@ -0,0 +1,886 @@
+/* \file tinyvm.cpp Implementation of the little::TinyVM class. */
+
+#include "tinyvm.h"
+#include "tinyobj.h"
+
+#include <sstream>
+#include <cstdlib>
+#include <cctype>
+#include <climits>
+#include <algorithm>
+
+// gcc and clang can jump straight to the next handler
+#if defined(__GNUC__)
+#define TINY_COMPUTED_GOTO
+#endif
+
+namespace little {
+
+static const char *opcodeNames[TINY_NUM_OPCODES] = {
+	"move",
+	"addi", "addr", "subi", "subr",
+	"muli", "mulr", "divi", "divr",
+	"inci", "deci", "cmpi", "cmpr",
+	"push", "pop", "jsr", "ret", "link", "unlnk",
+	"jmp", "jgt", "jlt", "jge", "jle", "jeq", "jne",
+	"sys readi", "sys readr", "sys writei", "sys writer", "sys writes",
+	"sys halt"
+};
+
+TinyVM::TinyVM(int numRegisters)
+	: maxRegisters(numRegisters), stack(NULL), jit(false), ranNatively(false),
+	  nativeCode(NULL), nativeSize(0), nativeStack(NULL), savedStack(NULL),
+	  nativeLowSp(0), jitIn(NULL),
+	  jitOut(NULL), cycles(0), loads(0), stores(0), stackHighWater(0)
+{
+	for (int i=0; i<TINY_NUM_OPCODES; i++) {
+		opCounts[i] = 0;
+	}
+}
+
+TinyVM::~TinyVM()
+{
+	freeNative();
+	free(stack);
+}
+
+void TinyVM::setJIT(bool j) {
+	jit = j;
+}
+
+const char *TinyVM::getOpcodeName(TinyOpcode op) {
+	return opcodeNames[op];
+}
+
+std::string TinyVM::getError() {
+	return errorMessage;
+}
+
+unsigned long long TinyVM::getCycles() {
+	return cycles;
+}
+
+unsigned long long TinyVM::getInstructions() {
+	unsigned long long total = 0;
+	for (int i=0; i<TINY_NUM_OPCODES; i++) {
+		total += opCounts[i];
+	}
+	return total;
+}
+
+unsigned long long TinyVM::getLoads() {
+	return loads;
+}
+
+unsigned long long TinyVM::getStores() {
+	return stores;
+}
+
+unsigned long long TinyVM::getCalls() {
+	return opCounts[TINY_JSR];
+}
+
+void TinyVM::getLabelCounts(std::map< std::string,
+							unsigned long long> &counts) {
+	// a label's first instruction runs every time control reaches it
+	counts.clear();
+	std::map< std::string, int>::iterator it;
+	for (it = labels.begin(); it != labels.end(); it++) {
+		counts[it->first] = it->second < code.size() ?
+							code[it->second].count : 0;
+	}
+	return;
+}
+
+void TinyVM::setError(int line, std::string message) {
+	if (errorMessage.empty()) {
+		std::stringstream tstr;
+		tstr << "error on line " << line << " : " << message;
+		errorMessage = tstr.str();
+	}
+	return;
+}
+
+bool TinyVM::load(std::istream &is) {
+	// Decoding happens once, up front: every operand is resolved to the
+	// cell it names (or a frame offset) and every jump to an index, so
+	// the run loop never looks at text.
+	std::vector< std::vector< std::string> > lines;
+	std::vector< int> lineNumbers;
+	std::vector< TinyRecord *> records; // instructions from an object
+	int lineNum = 0;
+	TinyObject obj;
+	bool object = TinyObject::isObject(is);
+	if (object) {
+		// already split up, see tinyobj.cpp
+		if (!obj.read(is) || !obj.getLines(lines, lineNumbers, records)) {
+			errorMessage = obj.getError();
+			return false;
+		}
+		lineNum = lineNumbers.empty() ? 0 : lineNumbers.back();
+	}
+	std::string text;
+	while (!object && std::getline(is, text)) {
+		lineNum++;
+		std::vector< std::string> tokens;
+		std::string error;
+		if (!TinyObject::tokenize(text, tokens, error)) {
+			if (!error.empty()) {
+				setError(lineNum, error);
+				return false;
+			}
+			continue;
+		}
+		if (tokens[0] == "end") {
+			break;
+		}
+		lines.push_back(tokens);
+		lineNumbers.push_back(lineNum);
+		records.push_back(NULL);
+	}
+	return loadLines(lines, lineNumbers, records, obj, lineNum);
+}
+
+bool TinyVM::load(std::vector< std::vector< std::string> > &program) {
+	// already split the way tokenize would, a line each, so the line
+	// numbers are the same as the program's text would have
+	std::vector< std::vector< std::string> > lines;
+	std::vector< int> lineNumbers;
+	std::vector< TinyRecord *> records;
+	int lineNum = 0;
+	for (int i=0; i<program.size(); i++) {
+		lineNum++;
+		if (program[i].empty()) {
+			continue;
+		}
+		if (program[i][0] == "end") {
+			break;
+		}
+		lines.push_back(program[i]);
+		lineNumbers.push_back(lineNum);
+		records.push_back(NULL);
+	}
+	TinyObject obj;
+	return loadLines(lines, lineNumbers, records, obj, lineNum);
+}
+
+bool TinyVM::loadLines(std::vector< std::vector< std::string> > &lines,
+					   std::vector< int> &lineNumbers,
+					   std::vector< TinyRecord *> &records, TinyObject &obj,
+					   int lineNum) {
+	// labels, variables and strings can all be used before they show up
+	int numInstructions = 0;
+	for (int i=0; i<lines.size(); i++) {
+		std::vector< std::string> &t = lines[i];
+		if (records[i] != NULL) {
+			numInstructions++;
+		} else if (t[0] == "label" && t.size() == 2) {
+			labels[t[1]] = numInstructions;
+		} else if (t[0] == "var" && t.size() == 2) {
+			int index = variables.size();
+			varIndex[t[1]] = index;
+			TinyCell zero = {0, 0.0f};
+			variables.push_back(zero);
+		} else if (t[0] == "str" && t.size() == 3) {
+			strIndex[t[1]] = strings.size();
+			strings.push_back(t[2]);
+		} else {
+			numInstructions++;
+		}
+	}
+
+	code.clear();
+	for (int i=0; i<lines.size(); i++) {
+		std::vector< std::string> &t = lines[i];
+		if (records[i] != NULL) {
+			if (!decodeRecord(obj, *records[i], lineNumbers[i])) {
+				return false;
+			}
+		} else if (t[0] == "label" || t[0] == "var" || t[0] == "str") {
+			continue;
+		} else if (!decodeLine(t, lineNumbers[i])) {
+			return false;
+		}
+	}
+
+	// running off the end stops the program
+	TinyInstruction halt;
+	halt.opCode = TINY_HALT;
+	halt.a.kind = TINY_NONE;
+	halt.b.kind = TINY_NONE;
+	halt.target = 0;
+	halt.cost = 0;
+	halt.line = lineNum;
+	halt.count = 0;
+	code.push_back(halt);
+
+	// the tables are done growing, so it's safe to point into them now
+	TinyCell zero = {0, 0.0f};
+	if (maxRegisters != TINY_UNLIMITED_REGISTERS) {
+		registers.assign(maxRegisters, zero);
+	}
+	for (int i=0; i<code.size(); i++) {
+		TinyOperand *ops[2] = { &code[i].a, &code[i].b };
+		for (int j=0; j<2; j++) {
+			if (ops[j]->kind == TINY_LITERAL) {
+				ops[j]->cell = &ops[j]->literal;
+			} else if (ops[j]->kind == TINY_REGISTER) {
+				ops[j]->cell = &registers[ops[j]->index];
+			} else if (ops[j]->kind == TINY_VARIABLE) {
+				ops[j]->cell = &variables[ops[j]->index];
+			} else {
+				ops[j]->cell = NULL;
+			}
+		}
+	}
+	return true;
+}
+
+bool TinyVM::decodeOperand(std::string s, TinyOperand &o, int line) {
+	o.kind = TINY_NONE;
+	o.index = 0;
+	o.literal.i = 0;
+	o.literal.f = 0.0f;
+	o.cell = NULL;
+	if (s.empty()) {
+		return true;
+	}
+	if (s[0] == 'r' && s.size() > 1 &&
+			s.find_first_not_of("0123456789", 1) == std::string::npos) {
+		return decodeRegister(atoi(s.c_str()+1), o, line);
+	} else if (s[0] == '$') {
+		o.kind = TINY_STACK;
+		o.index = atoi(s.c_str()+1);
+	} else if (isdigit(s[0]) || s[0] == '-' || s[0] == '.') {
+		o.kind = TINY_LITERAL;
+		if (s.find_first_of(".eE") != std::string::npos) {
+			o.literal.f = (float)atof(s.c_str());
+			o.literal.i = (int)o.literal.f;
+		} else {
+			o.literal.i = atoi(s.c_str());
+			o.literal.f = (float)o.literal.i;
+		}
+	} else if (varIndex.count(s) == 1) {
+		o.kind = TINY_VARIABLE;
+		o.index = varIndex[s];
+	} else {
+		setError(line, "identifier " + s + " not defined");
+		return false;
+	}
+	return true;
+}
+
+bool TinyVM::decodeRegister(int index, TinyOperand &o, int line) {
+	o.kind = TINY_REGISTER;
+	o.index = index;
+	if (maxRegisters != TINY_UNLIMITED_REGISTERS) {
+		if (index >= maxRegisters) {
+			std::stringstream tstr;
+			tstr << "identifier r" << index << " not defined";
+			setError(line, tstr.str());
+			return false;
+		}
+	} else if (index >= registers.size()) {
+		TinyCell zero = {0, 0.0f};
+		registers.resize(index+1, zero);
+	}
+	return true;
+}
+
+bool TinyVM::decodeRecord(TinyObject &obj, TinyRecord &r, int line) {
+	// the same as decodeLine, but numbers come already parsed and only
+	// names need looking up
+	TinyInstruction inst;
+	inst.opCode = (TinyOpcode)r.op;
+	inst.target = 0;
+	inst.line = line;
+	inst.handler = NULL;
+	decodeOperand("", inst.a, line);
+	decodeOperand("", inst.b, line);
+	int first = 0;
+	std::string str;
+	if (inst.opCode == TINY_JSR || inst.opCode == TINY_LINK ||
+			inst.opCode == TINY_WRITES ||
+			(inst.opCode >= TINY_JMP && inst.opCode <= TINY_JNE)) {
+		std::string a;
+		if (!r.operands.empty()) {
+			a = obj.getOperandText(r.operands[0]);
+		}
+		first = 1;
+		if (inst.opCode == TINY_LINK) {
+			inst.target = atoi(a.c_str());
+		} else if (inst.opCode == TINY_WRITES) {
+			str = a;
+		} else if (labels.count(a) == 0) {
+			setError(line, "label " + a + " not defined");
+			return false;
+		} else {
+			inst.target = labels[a];
+		}
+	}
+	TinyOperand *ops[2] = { &inst.a, &inst.b };
+	for (int i=first; i<r.operands.size() && i-first < 2; i++) {
+		unsigned int o = r.operands[i];
+		TinyOperand &op = *ops[i-first];
+		int value = TinyObject::getOperandValue(o);
+		switch (TinyObject::getOperandKind(o)) {
+		case TOBJ_REGISTER:
+			if (!decodeRegister(value, op, line)) {
+				return false;
+			}
+			break;
+		case TOBJ_STACK:
+			op.kind = TINY_STACK;
+			op.index = value;
+			break;
+		case TOBJ_INTEGER:
+			op.kind = TINY_LITERAL;
+			op.literal.i = value;
+			op.literal.f = (float)value;
+			break;
+		default:
+			if (!decodeOperand(obj.getOperandText(o), op, line)) {
+				return false;
+			}
+		}
+	}
+	return addInstruction(inst, str);
+}
+
+bool TinyVM::decodeLine(std::vector< std::string> &tokens, int line) {
+	TinyInstruction inst;
+	inst.target = 0;
+	inst.line = line;
+	inst.handler = NULL;
+	std::string name = tokens[0];
+	int first = 1;
+	if (name == "sys" && tokens.size() > 1) {
+		name += " " + tokens[1];
+		first = 2;
+	}
+	int op = 0;
+	while (op < TINY_NUM_OPCODES && name != opcodeNames[op]) {
+		op++;
+	}
+	if (op == TINY_NUM_OPCODES) {
+		setError(line, "unknown instruction " + name);
+		return false;
+	}
+	inst.opCode = (TinyOpcode)op;
+	std::string a = tokens.size() > first ? tokens[first] : "";
+	std::string b = tokens.size() > first+1 ? tokens[first+1] : "";
+
+	if (inst.opCode == TINY_JSR ||
+			(inst.opCode >= TINY_JMP && inst.opCode <= TINY_JNE)) {
+		if (labels.count(a) == 0) {
+			setError(line, "label " + a + " not defined");
+			return false;
+		}
+		inst.target = labels[a];
+		a = "";
+	} else if (inst.opCode == TINY_LINK) {
+		inst.target = atoi(a.c_str());
+		a = "";
+	}
+	std::string str;
+	if (inst.opCode == TINY_WRITES) {
+		str = a;
+		a = "";
+	}
+	if (!decodeOperand(a, inst.a, line) || !decodeOperand(b, inst.b, line)) {
+		return false;
+	}
+	return addInstruction(inst, str);
+}
+
+bool TinyVM::addInstruction(TinyInstruction &inst, std::string str) {
+	// str is the string a writes prints
+	if (inst.opCode == TINY_WRITES && strIndex.count(str) == 0) {
+		setError(inst.line, "string " + str + " not defined");
+		return false;
+	}
+	if (!checkOperands(inst)) {
+		return false;
+	}
+	if (inst.opCode == TINY_WRITES) {
+		inst.a.index = strIndex[str];
+	}
+	inst.cost = getCost(inst);
+	inst.count = 0;
+	code.push_back(inst);
+	return true;
+}
+
+bool TinyVM::isMemory(TinyOperand &o) {
+	return o.kind == TINY_VARIABLE || o.kind == TINY_STACK;
+}
+
+bool TinyVM::checkOperands(TinyInstruction &inst) {
+	// the same rules tiny enforces
+	switch (inst.opCode) {
+	case TINY_MOVE:
+		if (inst.a.kind == TINY_NONE || inst.b.kind == TINY_NONE) {
+			setError(inst.line, "missing operand");
+			return false;
+		}
+		if (isMemory(inst.a) && isMemory(inst.b)) {
+			setError(inst.line, "both  operands are memory refs");
+			return false;
+		}
+		if (inst.b.kind == TINY_LITERAL) {
+			setError(inst.line, "illegal operand type");
+			return false;
+		}
+		return true;
+	case TINY_ADDI: case TINY_ADDR: case TINY_SUBI: case TINY_SUBR:
+	case TINY_MULI: case TINY_MULR: case TINY_DIVI: case TINY_DIVR:
+	case TINY_CMPI: case TINY_CMPR:
+		if (inst.a.kind == TINY_NONE || inst.b.kind != TINY_REGISTER) {
+			setError(inst.line, "illegal operand type");
+			return false;
+		}
+		return true;
+	case TINY_INCI: case TINY_DECI:
+		if (inst.a.kind != TINY_REGISTER) {
+			setError(inst.line, "operand must be a register");
+			return false;
+		}
+		return true;
+	case TINY_POP: case TINY_READI: case TINY_READR:
+		if (inst.a.kind == TINY_LITERAL) {
+			setError(inst.line, "illegal operand type");
+			return false;
+		}
+		return true;
+	default:
+		return true;
+	}
+}
+
+int TinyVM::getCost(TinyInstruction &inst) {
+	// A made up but stable cost model: one cycle per instruction, more
+	// for multiplies and divides, and one more for every trip to memory.
+	// Stack instructions always touch memory.
+	int cost = 1;
+	if (inst.opCode == TINY_MULI || inst.opCode == TINY_MULR) {
+		cost = 3;
+	} else if (inst.opCode == TINY_DIVI || inst.opCode == TINY_DIVR) {
+		cost = 6;
+	}
+	if (isMemory(inst.a)) cost++;
+	if (isMemory(inst.b)) cost++;
+	if (inst.opCode >= TINY_PUSH && inst.opCode <= TINY_UNLNK) {
+		cost++;
+	}
+	return cost;
+}
+
+void TinyVM::resetMemory() {
+	// only the part of the stack the last run got to needs clearing
+	TinyCell zero = {0, 0.0f};
+	registers.assign(registers.size(), zero);
+	variables.assign(variables.size(), zero);
+	if (stack == NULL) {
+		stack = (TinyCell *)calloc(TINY_STACK_SIZE, sizeof(TinyCell));
+	} else {
+		std::fill(stack + TINY_STACK_SIZE - stackHighWater,
+				  stack + TINY_STACK_SIZE, zero);
+	}
+	stackHighWater = 0;
+	return;
+}
+
+bool TinyVM::run(std::istream &in, std::ostream &out) {
+	if (!errorMessage.empty() || code.empty()) {
+		return false;
+	}
+	resetMemory();
+	if (stack == NULL) {
+		setError(0, "out of memory for the stack");
+		return false;
+	}
+	ranNatively = false;
+	if (jit && (nativeCode != NULL || compileNative())) {
+		ranNatively = true;
+		return runNative(in, out);
+	}
+	TinyCell zero = {0, 0.0f};
+	for (int i=0; i<code.size(); i++) {
+		code[i].count = 0;
+	}
+
+	TinyCell *mem = stack;
+	TinyInstruction *base = &code[0];
+	TinyInstruction *ip = base;
+	TinyCell *x = NULL;
+	TinyCell *y = NULL;
+	TinyCell v;
+	int sp = TINY_STACK_SIZE;
+	int fp = TINY_STACK_SIZE;
+	int lowSp = sp;
+	int cmp = 0;
+	int at;
+	bool ok = true;
+
+#ifdef TINY_COMPUTED_GOTO
+	static void *handlers[TINY_NUM_OPCODES] = {
+		&&op_move,
+		&&op_addi, &&op_addr, &&op_subi, &&op_subr,
+		&&op_muli, &&op_mulr, &&op_divi, &&op_divr,
+		&&op_inci, &&op_deci, &&op_cmpi, &&op_cmpr,
+		&&op_push, &&op_pop, &&op_jsr, &&op_ret, &&op_link, &&op_unlnk,
+		&&op_jmp, &&op_jgt, &&op_jlt, &&op_jge, &&op_jle, &&op_jeq, &&op_jne,
+		&&op_readi, &&op_readr, &&op_writei, &&op_writer, &&op_writes,
+		&&op_halt
+	};
+	for (int i=0; i<code.size(); i++) {
+		code[i].handler = handlers[code[i].opCode];
+	}
+#define DISPATCH() \
+	do { \
+		ip->count++; \
+		goto *ip->handler; \
+	} while (0)
+#else
+#define DISPATCH() goto dispatch
+#endif
+
+// resolve an operand to its cell, checking frame references
+#define CELL(o, c) \
+	do { \
+		if ((o).kind == TINY_STACK) { \
+			at = fp + (o).index; \
+			if (at < 0 || at >= TINY_STACK_SIZE) goto bad_stack; \
+			c = mem + at; \
+		} else { \
+			c = (o).cell; \
+		} \
+	} while (0)
+
+#define NEXT() do { ip++; DISPATCH(); } while (0)
+#define BRANCH(cond) \
+	do { \
+		if (cond) ip = base + ip->target; else ip++; \
+		DISPATCH(); \
+	} while (0)
+
+	DISPATCH();
+
+#ifndef TINY_COMPUTED_GOTO
+dispatch:
+	ip->count++;
+	switch (ip->opCode) {
+	case TINY_MOVE: goto op_move;
+	case TINY_ADDI: goto op_addi;
+	case TINY_ADDR: goto op_addr;
+	case TINY_SUBI: goto op_subi;
+	case TINY_SUBR: goto op_subr;
+	case TINY_MULI: goto op_muli;
+	case TINY_MULR: goto op_mulr;
+	case TINY_DIVI: goto op_divi;
+	case TINY_DIVR: goto op_divr;
+	case TINY_INCI: goto op_inci;
+	case TINY_DECI: goto op_deci;
+	case TINY_CMPI: goto op_cmpi;
+	case TINY_CMPR: goto op_cmpr;
+	case TINY_PUSH: goto op_push;
+	case TINY_POP: goto op_pop;
+	case TINY_JSR: goto op_jsr;
+	case TINY_RET: goto op_ret;
+	case TINY_LINK: goto op_link;
+	case TINY_UNLNK: goto op_unlnk;
+	case TINY_JMP: goto op_jmp;
+	case TINY_JGT: goto op_jgt;
+	case TINY_JLT: goto op_jlt;
+	case TINY_JGE: goto op_jge;
+	case TINY_JLE: goto op_jle;
+	case TINY_JEQ: goto op_jeq;
+	case TINY_JNE: goto op_jne;
+	case TINY_READI: goto op_readi;
+	case TINY_READR: goto op_readr;
+	case TINY_WRITEI: goto op_writei;
+	case TINY_WRITER: goto op_writer;
+	case TINY_WRITES: goto op_writes;
+	default: goto op_halt;
+	}
+#endif
+
+op_move:
+	CELL(ip->a, x);
+	CELL(ip->b, y);
+	*y = *x;
+	NEXT();
+op_addi:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	y->i = (int)((unsigned)y->i + (unsigned)x->i);
+	y->f = (float)y->i;
+	NEXT();
+op_addr:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	y->f = y->f + x->f;
+	y->i = (int)y->f;
+	NEXT();
+op_subi:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	y->i = (int)((unsigned)y->i - (unsigned)x->i);
+	y->f = (float)y->i;
+	NEXT();
+op_subr:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	y->f = y->f - x->f;
+	y->i = (int)y->f;
+	NEXT();
+op_muli:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	y->i = (int)((unsigned)y->i * (unsigned)x->i);
+	y->f = (float)y->i;
+	NEXT();
+op_mulr:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	y->f = y->f * x->f;
+	y->i = (int)y->f;
+	NEXT();
+op_divi:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	if (x->i == 0) {
+		setError(ip->line, "division by zero");
+		goto fail;
+	}
+	if (x->i == -1 && y->i == INT_MIN) {
+		// the one quotient an int can't hold
+		setError(ip->line, "integer overflow");
+		goto fail;
+	}
+	y->i = y->i / x->i;
+	y->f = (float)y->i;
+	NEXT();
+op_divr:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	y->f = y->f / x->f;
+	y->i = (int)y->f;
+	NEXT();
+op_inci:
+	x = ip->a.cell;
+	x->i++;
+	x->f = (float)x->i;
+	NEXT();
+op_deci:
+	x = ip->a.cell;
+	x->i--;
+	x->f = (float)x->i;
+	NEXT();
+op_cmpi:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	cmp = x->i > y->i ? 1 : (x->i < y->i ? -1 : 0);
+	NEXT();
+op_cmpr:
+	CELL(ip->a, x);
+	y = ip->b.cell;
+	cmp = x->f > y->f ? 1 : (x->f < y->f ? -1 : 0);
+	NEXT();
+op_push:
+	if (sp == 0) goto overflow;
+	if (ip->a.kind == TINY_NONE) {
+		v = zero;
+	} else {
+		CELL(ip->a, x);
+		v = *x;
+	}
+	mem[--sp] = v;
+	if (sp < lowSp) lowSp = sp;
+	NEXT();
+op_pop:
+	if (sp >= TINY_STACK_SIZE) goto underflow;
+	if (ip->a.kind != TINY_NONE) {
+		CELL(ip->a, x);
+		*x = mem[sp];
+	}
+	sp++;
+	NEXT();
+op_jsr:
+	if (sp == 0) goto overflow;
+	sp--;
+	mem[sp].i = ip - base + 1;
+	mem[sp].f = (float)mem[sp].i;
+	if (sp < lowSp) lowSp = sp;
+	ip = base + ip->target;
+	DISPATCH();
+op_ret:
+	if (sp >= TINY_STACK_SIZE) goto underflow;
+	at = mem[sp++].i;
+	if (at < 0 || at >= code.size()) {
+		setError(ip->line, "illegal pc stack reference");
+		goto fail;
+	}
+	ip = base + at;
+	DISPATCH();
+op_link:
+	if (sp <= ip->target) goto overflow;
+	sp--;
+	mem[sp].i = fp;
+	mem[sp].f = (float)fp;
+	fp = sp;
+	sp -= ip->target;
+	if (sp < lowSp) lowSp = sp;
+	NEXT();
+op_unlnk:
+	if (fp >= TINY_STACK_SIZE) goto underflow;
+	sp = fp;
+	fp = mem[sp++].i;
+	if (fp < 0 || fp > TINY_STACK_SIZE) {
+		setError(ip->line, "illegal fp stack reference");
+		goto fail;
+	}
+	NEXT();
+op_jmp:
+	ip = base + ip->target;
+	DISPATCH();
+op_jgt:
+	BRANCH(cmp > 0);
+op_jlt:
+	BRANCH(cmp < 0);
+op_jge:
+	BRANCH(cmp >= 0);
+op_jle:
+	BRANCH(cmp <= 0);
+op_jeq:
+	BRANCH(cmp == 0);
+op_jne:
+	BRANCH(cmp != 0);
+op_readi:
+	CELL(ip->a, x);
+	if (!(in >> x->i)) {
+		x->i = 0;
+	}
+	x->f = (float)x->i;
+	NEXT();
+op_readr:
+	CELL(ip->a, x);
+	if (!(in >> x->f)) {
+		x->f = 0.0f;
+	}
+	x->i = (int)x->f;
+	NEXT();
+op_writei:
+	CELL(ip->a, x);
+	out << x->i;
+	NEXT();
+op_writer:
+	CELL(ip->a, x);
+	out << x->f;
+	NEXT();
+op_writes:
+	out << strings[ip->a.index];
+	NEXT();
+
+bad_stack:
+	setError(ip->line, "illegal data stack reference");
+	goto fail;
+overflow:
+	setError(ip->line, "stack overflow");
+	goto fail;
+underflow:
+	setError(ip->line, "stack underflow");
+	goto fail;
+fail:
+	ok = false;
+op_halt:
+	out.flush();
+	stackHighWater = TINY_STACK_SIZE - lowSp;
+	tallyCounts();
+
+#undef DISPATCH
+#undef CELL
+#undef NEXT
+#undef BRANCH
+	return ok;
+}
+
+void TinyVM::getMemoryAccesses(TinyInstruction &inst, int &r, int &w) {
+	// a is read and b is written, except that the stack instructions
+	// move a cell through memory themselves
+	r = 0;
+	w = 0;
+	switch (inst.opCode) {
+	case TINY_MOVE:
+		r = isMemory(inst.a);
+		w = isMemory(inst.b);
+		break;
+	case TINY_PUSH:
+		r = isMemory(inst.a);
+		w = 1;
+		break;
+	case TINY_POP:
+		r = 1;
+		w = isMemory(inst.a);
+		break;
+	case TINY_JSR: case TINY_LINK:
+		w = 1;
+		break;
+	case TINY_RET: case TINY_UNLNK:
+		r = 1;
+		break;
+	case TINY_READI: case TINY_READR:
+		w = isMemory(inst.a);
+		break;
+	default:
+		r = isMemory(inst.a);
+	}
+	return;
+}
+
+void TinyVM::tallyCounts() {
+	cycles = 0;
+	loads = 0;
+	stores = 0;
+	for (int i=0; i<TINY_NUM_OPCODES; i++) {
+		opCounts[i] = 0;
+	}
+	for (int i=0; i<code.size(); i++) {
+		int r, w;
+		getMemoryAccesses(code[i], r, w);
+		opCounts[code[i].opCode] += code[i].count;
+		cycles += code[i].count * code[i].cost;
+		loads += code[i].count * r;
+		stores += code[i].count * w;
+	}
+	return;
+}
+
+void TinyVM::printStats(std::ostream &out) {
+	unsigned long long total = getInstructions();
+	out << "STATISTICS _____________________________" << std::endl;
+	if (ranNatively) {
+		out << "   ran as native code, instructions weren't counted"
+			<< std::endl;
+	} else {
+		out << "   #Instructions:" << total << std::endl;
+		out << "   #Loads:" << loads << " #Stores:" << stores
+			<< " #Calls:" << opCounts[TINY_JSR] << std::endl;
+		for (int i=0; i<TINY_NUM_OPCODES; i++) {
+			if (opCounts[i] != 0) {
+				out << "      " << opcodeNames[i] << ": " << opCounts[i]
+					<< std::endl;
+			}
+		}
+	}
+	out << "   Memory Usage (vars:" << variables.size()
+		<< ", strs:" << strings.size()
+		<< ", stack high water:" << stackHighWater
+		<< ", registers:" << registers.size() << ")" << std::endl;
+	if (!ranNatively) {
+		out << "   Total Cycles = " << cycles << std::endl;
+	}
+	return;
+}
+
+} // namespace little
@@ -0,0 +1,146 @@
+/* \file tinyvm.h Declaration of the little::TinyVM class. */
+
+#ifndef LITTLE_TINYVM_H
+#define LITTLE_TINYVM_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+
+#define TINY_UNLIMITED_REGISTERS 0
+#define TINY_STACK_SIZE (1 << 20)
+
+namespace little {
+
+class TinyObject;
+struct TinyRecord;
+
+enum TinyOpcode
+{
+	TINY_MOVE,
+	TINY_ADDI, TINY_ADDR, TINY_SUBI, TINY_SUBR,
+	TINY_MULI, TINY_MULR, TINY_DIVI, TINY_DIVR,
+	TINY_INCI, TINY_DECI, TINY_CMPI, TINY_CMPR,
+	TINY_PUSH, TINY_POP, TINY_JSR, TINY_RET, TINY_LINK, TINY_UNLNK,
+	TINY_JMP, TINY_JGT, TINY_JLT, TINY_JGE, TINY_JLE, TINY_JEQ, TINY_JNE,
+	TINY_READI, TINY_READR, TINY_WRITEI, TINY_WRITER, TINY_WRITES,
+	TINY_HALT,
+	TINY_NUM_OPCODES
+} ;
+
+enum TinyOperandKind
+{
+	TINY_NONE, TINY_LITERAL, TINY_REGISTER, TINY_VARIABLE, TINY_STACK
+} ;
+
+// every location holds both views of its value, like the old simulators
+struct TinyCell
+{
+	int i;
+	float f;
+} ;
+
+struct TinyOperand
+{
+	TinyOperandKind kind;
+	int index; // register, variable or string number, or the $ offset
+	TinyCell literal;
+	TinyCell *cell; // where it lives, for anything but stack references
+} ;
+
+struct TinyInstruction
+{
+	TinyOpcode opCode;
+	TinyOperand a;
+	TinyOperand b;
+	int target; // jump and jsr destination, link size
+	int cost;
+	int line;
+	void *handler;
+	unsigned long long count; // times it ran in the last run
+} ;
+
+class TinyVM
+{
+public:
+	// numRegisters is 4 for the tiny model, or TINY_UNLIMITED_REGISTERS
+	// for the tinyR one
+	TinyVM(int numRegisters = TINY_UNLIMITED_REGISTERS);
+	~TinyVM();
+	void setJIT(bool j);
+	bool load(std::istream &is);
+	// lines of tokens as TinyObject::tokenize gives them, from a compiler
+	// that has its code in that form already
+	bool load(std::vector< std::vector< std::string> > &program);
+	bool run(std::istream &in, std::ostream &out);
+	void printStats(std::ostream &out);
+	std::string getError();
+	unsigned long long getCycles();
+	unsigned long long getInstructions();
+	unsigned long long getLoads();
+	unsigned long long getStores();
+	unsigned long long getCalls();
+	// how many times the code after each label ran, for a profile
+	void getLabelCounts(std::map< std::string, unsigned long long> &counts);
+
+	static const char *getOpcodeName(TinyOpcode op);
+private:
+	int maxRegisters;
+	std::vector< TinyInstruction> code;
+	std::vector< TinyCell> registers;
+	std::vector< TinyCell> variables;
+	std::vector< std::string> strings;
+	std::map< std::string, int> varIndex;
+	std::map< std::string, int> strIndex;
+	std::map< std::string, int> labels;
+	TinyCell *stack; // calloc'd, so untouched pages cost nothing
+	std::string errorMessage;
+
+	// the native tier, see tinyjit.cpp
+	bool jit;
+	bool ranNatively;
+	void *nativeCode;
+	size_t nativeSize;
+	void *nativeStack;
+	void *savedStack;
+	long nativeLowSp;
+	std::istream *jitIn;
+	std::ostream *jitOut;
+	bool compileNative();
+	bool runNative(std::istream &in, std::ostream &out);
+	void freeNative();
+	static void nativeReadInt(TinyVM *vm, TinyCell *c);
+	static void nativeReadFloat(TinyVM *vm, TinyCell *c);
+	static void nativeWriteInt(TinyVM *vm, TinyCell *c);
+	static void nativeWriteFloat(TinyVM *vm, TinyCell *c);
+	static void nativeWriteString(TinyVM *vm, std::string *s);
+
+	// statistics, worked out from the instruction counts after a run
+	unsigned long long cycles;
+	unsigned long long opCounts[TINY_NUM_OPCODES];
+	unsigned long long loads;
+	unsigned long long stores;
+	int stackHighWater;
+	void tallyCounts();
+	void getMemoryAccesses(TinyInstruction &inst, int &r, int &w);
+
+	bool loadLines(std::vector< std::vector< std::string> > &lines,
+				   std::vector< int> &lineNumbers,
+				   std::vector< TinyRecord *> &records, TinyObject &obj,
+				   int lineNum);
+	bool decodeLine(std::vector< std::string> &tokens, int line);
+	bool decodeRecord(TinyObject &obj, TinyRecord &r, int line);
+	bool decodeOperand(std::string s, TinyOperand &o, int line);
+	bool decodeRegister(int index, TinyOperand &o, int line);
+	bool addInstruction(TinyInstruction &inst, std::string str);
+	bool checkOperands(TinyInstruction &inst);
+	void resetMemory();
+	bool isMemory(TinyOperand &o);
+	int getCost(TinyInstruction &inst);
+	void setError(int line, std::string message);
+};
+
+} // namespace little
+
+#endif // LITTLE_TINYVM_H
@@ -0,0 +1,112 @@
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <sstream>
+#include <iterator>
+#include <sys/time.h>
+
+#include "tinyvm.h"
+#include "tinyobj.h"
+
+int main(int argc, char *argv[])
+{
+	int numRegisters = TINY_UNLIMITED_REGISTERS;
+	bool stats = true;
+	bool jit = false;
+	bool timing = false;
+	int repeat = 1;
+	bool disassemble = false;
+	bool assemble = false;
+	std::string filename;
+
+	for (int i=1; i<argc; i++) {
+		if (strcmp(argv[i],"-regs") == 0 && i+1 < argc) {
+			numRegisters = atoi(argv[++i]);
+		} else if (strcmp(argv[i],"-nostats") == 0) {
+			stats = false;
+		} else if (strcmp(argv[i],"-jit") == 0) {
+			jit = true;
+		} else if (strcmp(argv[i],"-time") == 0) {
+			timing = true;
+		} else if (strcmp(argv[i],"-repeat") == 0 && i+1 < argc) {
+			repeat = atoi(argv[++i]);
+		} else if (strcmp(argv[i],"-dis") == 0) {
+			disassemble = true;
+		} else if (strcmp(argv[i],"-asm") == 0) {
+			assemble = true;
+		} else {
+			filename = argv[i];
+		}
+	}
+	if (filename.empty()) {
+		std::cerr << "usage: tinyvm [-regs N] [-jit] [-nostats] [-time] "
+				  << "[-repeat N] srcfile" << std::endl
+				  << "       tinyvm -asm srcfile > objfile" << std::endl
+				  << "       tinyvm -dis objfile > srcfile" << std::endl;
+		return 1;
+	}
+
+	std::ifstream is;
+	is.open(filename.c_str(), std::ios_base::in | std::ios_base::binary);
+	if (!is) {
+		std::cerr << "could not open " << filename << std::endl;
+		return 1;
+	}
+
+	// converting between the text and binary forms, see tinyobj.cpp
+	if (disassemble || assemble) {
+		little::TinyObject obj;
+		if (disassemble && !obj.read(is)) {
+			std::cerr << obj.getError() << std::endl;
+			return 1;
+		}
+		if (assemble) {
+			obj.assemble(is);
+			obj.write(std::cout);
+		} else {
+			obj.disassemble(std::cout);
+		}
+		return 0;
+	}
+
+	little::TinyVM vm(numRegisters);
+	vm.setJIT(jit);
+	if (!vm.load(is)) {
+		std::cerr << vm.getError() << std::endl;
+		return 1;
+	}
+	bool ok = true;
+	struct timeval start, end;
+	if (repeat <= 1) {
+		gettimeofday(&start, NULL);
+		ok = vm.run(std::cin, std::cout);
+		gettimeofday(&end, NULL);
+		repeat = 1;
+	} else {
+		// every run gets the same input, and only the first one's output
+		// is shown
+		std::string input((std::istreambuf_iterator<char>(std::cin)),
+						  std::istreambuf_iterator<char>());
+		gettimeofday(&start, NULL);
+		for (int i=0; i<repeat && ok; i++) {
+			std::istringstream in(input);
+			std::ostringstream discard;
+			ok = vm.run(in, i == 0 ? std::cout : discard);
+		}
+		gettimeofday(&end, NULL);
+	}
+	if (timing) {
+		double ms = (end.tv_sec - start.tv_sec)*1000.0 +
+					(end.tv_usec - start.tv_usec)/1000.0;
+		std::cerr << "run time: " << ms/repeat << " ms" << std::endl;
+	}
+	if (!ok) {
+		std::cerr << std::endl << vm.getError() << std::endl;
+	}
+	if (stats) {
+		std::cout << std::endl;
+		vm.printStats(std::cout);
+	}
+	return ok ? 0 : 1;
+}